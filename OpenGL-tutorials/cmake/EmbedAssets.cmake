@@ -0,0 +1,50 @@
+# embed_assets(<target> <file>...)
+#
+# Compiles the given files into <target> as constexpr byte arrays, in a header generated
+# at build time (EmbeddedAssetData.h), so that common/Assets.cpp can serve them without
+# touching the disk. Each file is found under the path the lessons open it with, i.e.
+# "../" followed by its path relative to the tutorials root ("../resources/cube.obj").
+#
+# Debug builds, or -DASSETS_FROM_DISK=ON, still read the disk first so that edited
+# assets are picked up without rebuilding. Hot-reloaded shaders are read from the disk in
+# every build while the shader watcher runs (see common/ShaderReload.h).
+
+option(ASSETS_FROM_DISK "Read embedded assets from disk first when the file exists" OFF)
+
+set(EMBED_ASSETS_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/GenerateEmbeddedAssets.cmake)
+get_filename_component(EMBED_ASSETS_ROOT ${CMAKE_CURRENT_LIST_DIR}/.. ABSOLUTE)
+
+function(embed_assets target)
+    set(files)
+    foreach(file ${ARGN})
+        get_filename_component(file ${file} ABSOLUTE)
+        list(APPEND files ${file})
+    endforeach()
+
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/generated)
+    set(output ${output_dir}/EmbeddedAssetData.h)
+
+    # The file list is passed through a file: paths contain spaces and semicolons do not
+    # survive a command line.
+    string(REPLACE ";" "\n" file_lines "${files}")
+    file(WRITE ${output_dir}/EmbeddedAssetFiles.txt "${file_lines}\n")
+
+    add_custom_command(
+        OUTPUT ${output}
+        COMMAND ${CMAKE_COMMAND}
+                -DROOT=${EMBED_ASSETS_ROOT}
+                -DLIST=${output_dir}/EmbeddedAssetFiles.txt
+                -DOUTPUT=${output}
+                -P ${EMBED_ASSETS_SCRIPT}
+        DEPENDS ${files} ${EMBED_ASSETS_SCRIPT} ${output_dir}/EmbeddedAssetFiles.txt
+        COMMENT "Embedding ${target} assets"
+        VERBATIM
+    )
+
+    target_sources(${target} PRIVATE ${output})
+    target_include_directories(${target} PRIVATE ${output_dir})
+    target_compile_definitions(${target} PRIVATE
+        EMBEDDED_ASSETS
+        $<$<OR:$<CONFIG:Debug>,$<BOOL:${ASSETS_FROM_DISK}>>:ASSETS_PREFER_DISK>
+    )
+endfunction()
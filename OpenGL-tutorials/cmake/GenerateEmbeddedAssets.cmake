@@ -0,0 +1,43 @@
+# Script mode helper of EmbedAssets.cmake: cmake -DROOT=... -DLIST=... -DOUTPUT=... -P
+# file(STRINGS) would split the lesson directory names at their non-ASCII dash.
+file(READ ${LIST} files)
+string(STRIP "${files}" files)
+string(REPLACE "\n" ";" files "${files}")
+
+# CMake regular expressions have no {n} repetition.
+set(row "")
+foreach(i RANGE 15)
+    set(row "${row}0x..,")
+endforeach()
+
+set(arrays "")
+set(table "")
+set(index 0)
+foreach(file IN LISTS files)
+    file(READ ${file} hex HEX)
+    string(LENGTH "${hex}" size)
+    math(EXPR size "${size} / 2")
+    file(RELATIVE_PATH path ${ROOT} ${file})
+
+    # 16 bytes per line; a trailing 0 keeps empty files valid and text NUL-terminated.
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    string(REGEX REPLACE "${row}" "\\0\n    " bytes "${bytes}")
+    string(APPEND arrays "// ${path}\nconstexpr unsigned char EMBEDDED_ASSET_${index}[] = {\n    ${bytes}0x00\n};\n\n")
+    string(APPEND table "    {\"../${path}\", EMBEDDED_ASSET_${index}, ${size}},\n")
+    math(EXPR index "${index} + 1")
+endforeach()
+
+file(WRITE ${OUTPUT}.tmp
+"// Generated by cmake/GenerateEmbeddedAssets.cmake, do not edit.
+#ifndef EMBEDDEDASSETDATA_H
+#define EMBEDDEDASSETDATA_H
+#include \"Assets.h\"
+
+${arrays}constexpr EmbeddedAsset EMBEDDED_ASSET_TABLE[] = {
+${table}};
+
+#endif
+")
+# Only touch the header when its content changed, to avoid needless recompiles.
+configure_file(${OUTPUT}.tmp ${OUTPUT} COPYONLY)
+file(REMOVE ${OUTPUT}.tmp)
@@ -0,0 +1,100 @@
+#include "Assets.h"
+#include <cstdio>
+
+#ifdef EMBEDDED_ASSETS
+#include "EmbeddedAssetData.h"
+#endif
+
+#ifdef ASSETS_PREFER_DISK
+bool AssetsPreferDisk = true;
+#else
+bool AssetsPreferDisk = false;
+#endif
+
+
+// Collapses "dir/../" and "./" so that paths built by #include resolution match the table.
+static std::string normalizeAssetPath(const std::string & path)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string part = path.substr(start, end - start);
+        start = end + 1;
+
+        if (part == "." || (part.empty() && !parts.empty()))
+            continue;
+        if (part == ".." && !parts.empty() && parts.back() != "..")
+            parts.pop_back();
+        else
+            parts.push_back(part);
+    }
+
+    std::string normalized;
+    for (size_t i = 0; i < parts.size(); i++)
+        normalized += (i ? "/" : "") + parts[i];
+    return normalized;
+}
+
+
+const EmbeddedAsset * findEmbeddedAsset(const std::string & path)
+{
+#ifdef EMBEDDED_ASSETS
+    std::string normalized = normalizeAssetPath(path);
+    for (const EmbeddedAsset & asset : EMBEDDED_ASSET_TABLE)
+    {
+        if (normalized == asset.path)
+            return &asset;
+    }
+#else
+    (void) path;
+#endif
+    return nullptr;
+}
+
+
+static bool readAssetFromDisk(const std::string & path, std::vector<unsigned char> & data)
+{
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data.resize(size > 0 ? size : 0);
+    bool ok = size >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return ok;
+}
+
+
+bool readAsset(const std::string & path, std::vector<unsigned char> & data)
+{
+    if (AssetsPreferDisk && readAssetFromDisk(path, data))
+        return true;
+
+    const EmbeddedAsset * asset = findEmbeddedAsset(path);
+    if (asset)
+    {
+        data.assign(asset->data, asset->data + asset->size);
+        return true;
+    }
+    return !AssetsPreferDisk && readAssetFromDisk(path, data);
+}
+
+
+void setAssetsPreferDisk(bool prefer)
+{
+    AssetsPreferDisk = prefer;
+}
+
+
+bool getAssetsPreferDisk()
+{
+    return AssetsPreferDisk;
+}
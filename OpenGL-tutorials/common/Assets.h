@@ -0,0 +1,31 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * A file compiled into the executable by the embed_assets() CMake function.
+ * `data` holds `size` bytes followed by a 0, so text assets can be used as C strings.
+ */
+struct EmbeddedAsset
+{
+    const char * path;  // As the lessons open it, e.g. "../resources/cube.obj"
+    const unsigned char * data;
+    size_t size;
+};
+
+// Returns the embedded copy of a file, or nullptr. "dir/../" parts of the path are collapsed.
+const EmbeddedAsset * findEmbeddedAsset(const std::string & path);
+
+// Reads a whole file, from the executable when it was embedded and from the disk otherwise.
+// Builds with ASSETS_PREFER_DISK (Debug, or -DASSETS_FROM_DISK=ON) try the disk first so that
+// edited files are picked up without a rebuild.
+bool readAsset(const std::string & path, std::vector<unsigned char> & data);
+
+// Whether readAsset tries the disk first, whatever the build. The shader watcher turns it
+// on while it runs: a hot reload must read the edited file, not the embedded copy.
+void setAssetsPreferDisk(bool prefer);
+bool getAssetsPreferDisk();
+
+#endif
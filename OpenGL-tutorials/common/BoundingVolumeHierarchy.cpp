@@ -0,0 +1,686 @@
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+
+// Surface area heuristic bins per axis.
+static const int BIN_COUNT = 16;
+// Leaves hold at most this many objects.
+static const uint32_t MAX_LEAF_SIZE = 4;
+// Below this depth nodes split at the median instead, which bounds the tree depth.
+static const int MAX_SAH_DEPTH = 64;
+// Traversal stacks: deep enough for MAX_SAH_DEPTH plus median splits of 2^32 objects.
+static const int STACK_SIZE = 128;
+// Nodes with fewer objects are binned by one thread, and not split across threads.
+static const uint32_t PARALLEL_BINNING_MIN = 65536;
+static const uint32_t PARALLEL_SUBTREE_MIN = 4096;
+
+
+static BoundingBox emptyBox()
+{
+    BoundingBox box;
+    box.min = glm::vec3(FLT_MAX);
+    box.max = glm::vec3(-FLT_MAX);
+    return box;
+}
+
+
+static void growBox(BoundingBox & box, const BoundingBox & other)
+{
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+
+static float halfArea(const BoundingBox & box)
+{
+    glm::vec3 size = box.max - box.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+
+static bool boxesOverlap(const glm::vec3 & minA, const glm::vec3 & maxA, const BoundingBox & b)
+{
+    return minA.x <= b.max.x && maxA.x >= b.min.x
+        && minA.y <= b.max.y && maxA.y >= b.min.y
+        && minA.z <= b.max.z && maxA.z >= b.min.z;
+}
+
+
+static BoundingBox nodeBox(const BvhNode & node)
+{
+    BoundingBox box;
+    box.min = node.min;
+    box.max = node.max;
+    return box;
+}
+
+
+bool intersectRayBox(const glm::vec3 & origin, const glm::vec3 & inverseDirection, const BoundingBox & box,
+                     float maxDistance, float & distance)
+{
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 entries = glm::min(t0, t1);
+    glm::vec3 exits = glm::max(t0, t1);
+    float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+    float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+    distance = enter;
+    return enter <= exit;
+}
+
+
+bool intersectRayTriangle(const Ray & ray, const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c,
+                          float & distance)
+{
+    glm::vec3 edge1 = b - a;
+    glm::vec3 edge2 = c - a;
+    glm::vec3 p = glm::cross(ray.direction, edge2);
+    float determinant = glm::dot(edge1, p);
+    if (std::fabs(determinant) < 1e-12f)
+        return false;
+    float inverse = 1.0f / determinant;
+
+    glm::vec3 s = ray.origin - a;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(ray.direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    distance = glm::dot(edge2, q) * inverse;
+    return distance >= 0.0f && distance <= ray.maxDistance;
+}
+
+
+std::vector<BoundingBox> computeTriangleBoxes(const std::vector<glm::vec3> & vertices)
+{
+    std::vector<BoundingBox> boxes(vertices.size() / 3);
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        boxes[i].min = glm::min(vertices[3 * i], glm::min(vertices[3 * i + 1], vertices[3 * i + 2]));
+        boxes[i].max = glm::max(vertices[3 * i], glm::max(vertices[3 * i + 1], vertices[3 * i + 2]));
+    }
+    return boxes;
+}
+
+
+// Runs task(begin, end) over `count` items split into one chunk per thread.
+template <typename Task>
+static void parallelFor(uint32_t count, unsigned int threads, const Task & task)
+{
+    if (threads <= 1)
+    {
+        task(0u, count, 0u);
+        return;
+    }
+    std::vector<std::thread> workers;
+    uint32_t chunk = (count + threads - 1) / threads;
+    for (unsigned int t = 1; t < threads; t++)
+    {
+        uint32_t begin = std::min(count, t * chunk);
+        uint32_t end = std::min(count, begin + chunk);
+        workers.push_back(std::thread([&task, begin, end, t]() { task(begin, end, t); }));
+    }
+    task(0u, std::min(count, chunk), 0u);
+    for (std::thread & worker : workers)
+        worker.join();
+}
+
+
+namespace
+{
+struct Bin
+{
+    BoundingBox box;
+    uint32_t count;
+};
+
+struct Bins
+{
+    BoundingBox bounds;          // Of the object boxes
+    BoundingBox centroidBounds;  // Of their centers
+    Bin bins[3][BIN_COUNT];
+};
+
+// An object during the build. Splits partition these in place, so every pass over a
+// node reads contiguous memory instead of gathering boxes by object index.
+struct BuildReference
+{
+    BoundingBox box;
+    uint32_t object;
+
+    glm::vec3 Centroid() const { return (box.min + box.max) * 0.5f; }
+};
+}
+
+
+// Index of the bin the centroid falls in along `axis`.
+static int binIndex(float centroid, float minimum, float scale)
+{
+    int bin = static_cast<int>((centroid - minimum) * scale);
+    return std::min(std::max(bin, 0), BIN_COUNT - 1);
+}
+
+
+static void boundRange(const std::vector<BuildReference> & references, uint32_t begin, uint32_t end,
+                       BoundingBox & bounds, BoundingBox & centroidBounds)
+{
+    bounds = centroidBounds = emptyBox();
+    for (uint32_t i = begin; i < end; i++)
+    {
+        glm::vec3 centroid = references[i].Centroid();
+        growBox(bounds, references[i].box);
+        centroidBounds.min = glm::min(centroidBounds.min, centroid);
+        centroidBounds.max = glm::max(centroidBounds.max, centroid);
+    }
+}
+
+
+static void computeBounds(const std::vector<BuildReference> & references, uint32_t begin, uint32_t end,
+                          unsigned int threads, BoundingBox & bounds, BoundingBox & centroidBounds)
+{
+    if (threads <= 1)
+    {
+        boundRange(references, begin, end, bounds, centroidBounds);
+        return;
+    }
+    std::vector<BoundingBox> chunkBounds(threads), chunkCentroids(threads);
+    parallelFor(end - begin, threads, [&](uint32_t first, uint32_t last, unsigned int t) {
+        boundRange(references, begin + first, begin + last, chunkBounds[t], chunkCentroids[t]);
+    });
+    bounds = centroidBounds = emptyBox();
+    for (unsigned int t = 0; t < threads; t++)
+    {
+        growBox(bounds, chunkBounds[t]);
+        growBox(centroidBounds, chunkCentroids[t]);
+    }
+}
+
+
+static void binRange(const std::vector<BuildReference> & references, uint32_t begin, uint32_t end,
+                     const glm::vec3 & minimum, const glm::vec3 & scale, Bins & bins)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int b = 0; b < BIN_COUNT; b++)
+        {
+            bins.bins[axis][b].box = emptyBox();
+            bins.bins[axis][b].count = 0;
+        }
+    }
+    for (uint32_t i = begin; i < end; i++)
+    {
+        glm::vec3 centroid = references[i].Centroid();
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Bin & bin = bins.bins[axis][binIndex(centroid[axis], minimum[axis], scale[axis])];
+            growBox(bin.box, references[i].box);
+            bin.count++;
+        }
+    }
+}
+
+
+static void computeBins(const std::vector<BuildReference> & references, uint32_t begin, uint32_t end,
+                        unsigned int threads, Bins & result)
+{
+    glm::vec3 minimum = result.centroidBounds.min;
+    glm::vec3 extent = result.centroidBounds.max - result.centroidBounds.min;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++)
+        scale[axis] = extent[axis] > 0.0f ? BIN_COUNT / extent[axis] : 0.0f;
+
+    if (threads <= 1)
+    {
+        binRange(references, begin, end, minimum, scale, result);
+        return;
+    }
+    std::vector<Bins> chunks(threads);
+    parallelFor(end - begin, threads, [&](uint32_t first, uint32_t last, unsigned int t) {
+        binRange(references, begin + first, begin + last, minimum, scale, chunks[t]);
+    });
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int b = 0; b < BIN_COUNT; b++)
+        {
+            Bin & bin = result.bins[axis][b];
+            bin = chunks[0].bins[axis][b];
+            for (unsigned int t = 1; t < threads; t++)
+            {
+                growBox(bin.box, chunks[t].bins[axis][b].box);
+                bin.count += chunks[t].bins[axis][b].count;
+            }
+        }
+    }
+}
+
+
+/**
+ * Builds the subtree of objects [begin, end) depth first into `out`, whose interior nodes
+ * reference their right child by index in `out`.
+ */
+static void buildNode(std::vector<BuildReference> & references, uint32_t begin, uint32_t end, int depth,
+                      unsigned int threads, std::vector<BvhNode> & out)
+{
+    uint32_t count = end - begin;
+    unsigned int binningThreads = count >= PARALLEL_BINNING_MIN ? threads : 1;
+
+    Bins bins;
+    computeBounds(references, begin, end, binningThreads, bins.bounds, bins.centroidBounds);
+
+    uint32_t index = static_cast<uint32_t>(out.size());
+    BvhNode node;
+    node.min = bins.bounds.min;
+    node.max = bins.bounds.max;
+    node.rightOrFirst = begin;
+    node.count = count;
+    out.push_back(node);
+    // Testing a few objects costs less than another level.
+    if (count <= MAX_LEAF_SIZE)
+        return;
+
+    // Find the split between bins with the least sum of area times object count.
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = FLT_MAX;
+    glm::vec3 extent = bins.centroidBounds.max - bins.centroidBounds.min;
+    if (depth < MAX_SAH_DEPTH)
+    {
+        computeBins(references, begin, end, binningThreads, bins);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (extent[axis] <= 0.0f)
+                continue;
+            // Sweep from the right, then from the left: split s puts bins [0, s) left.
+            float rightCost[BIN_COUNT];
+            BoundingBox box = emptyBox();
+            uint32_t objectCount = 0;
+            for (int b = BIN_COUNT - 1; b > 0; b--)
+            {
+                growBox(box, bins.bins[axis][b].box);
+                objectCount += bins.bins[axis][b].count;
+                rightCost[b] = objectCount ? halfArea(box) * objectCount : 0.0f;
+            }
+            box = emptyBox();
+            objectCount = 0;
+            for (int split = 1; split < BIN_COUNT; split++)
+            {
+                growBox(box, bins.bins[axis][split - 1].box);
+                objectCount += bins.bins[axis][split - 1].count;
+                float cost = (objectCount ? halfArea(box) * objectCount : 0.0f) + rightCost[split];
+                if (objectCount > 0 && objectCount < count && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0)
+    {
+        float minimum = bins.centroidBounds.min[bestAxis];
+        float scale = BIN_COUNT / extent[bestAxis];
+        middle = static_cast<uint32_t>(std::partition(references.begin() + begin, references.begin() + end,
+                [&](const BuildReference & reference) {
+                    return binIndex(reference.Centroid()[bestAxis], minimum, scale) < bestSplit;
+                }) - references.begin());
+    }
+    else
+    {
+        // Identical centroids, or too deep: halve along the longest axis.
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        middle = begin + count / 2;
+        std::nth_element(references.begin() + begin, references.begin() + middle, references.begin() + end,
+                [axis](const BuildReference & a, const BuildReference & b) {
+                    return a.Centroid()[axis] < b.Centroid()[axis];
+                });
+    }
+
+    out[index].count = 0;
+    if (threads > 1 && count >= PARALLEL_SUBTREE_MIN)
+    {
+        // Build the right half on another thread, then append it after the left one.
+        std::vector<BvhNode> right;
+        unsigned int rightThreads = threads / 2;
+        std::thread worker([&]() { buildNode(references, middle, end, depth + 1, rightThreads, right); });
+        buildNode(references, begin, middle, depth + 1, threads - rightThreads, out);
+        worker.join();
+
+        uint32_t base = static_cast<uint32_t>(out.size());
+        out[index].rightOrFirst = base;
+        for (BvhNode & child : right)
+        {
+            if (child.count == 0)
+                child.rightOrFirst += base;
+        }
+        out.insert(out.end(), right.begin(), right.end());
+    }
+    else
+    {
+        buildNode(references, begin, middle, depth + 1, 1, out);
+        out[index].rightOrFirst = static_cast<uint32_t>(out.size());
+        buildNode(references, middle, end, depth + 1, 1, out);
+    }
+}
+
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+}
+
+
+void BoundingVolumeHierarchy::Build(const std::vector<BoundingBox> & boxes, unsigned int threads)
+{
+    Clear();
+    if (boxes.empty())
+        return;
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    uint32_t count = static_cast<uint32_t>(boxes.size());
+    std::vector<BuildReference> references(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        references[i].box = boxes[i];
+        references[i].object = i;
+    }
+
+    nodes.reserve(2 * count / MAX_LEAF_SIZE + 1);
+    buildNode(references, 0, count, 0, threads, nodes);
+
+    // The references end in leaf order.
+    objects.resize(count);
+    leafBoxes.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        objects[i] = references[i].object;
+        leafBoxes[i] = references[i].box;
+    }
+
+    // Links used by incremental refits.
+    positions.resize(count);
+    leafNodes.resize(count);
+    parents.resize(nodes.size());
+    parents[0] = 0;
+    for (uint32_t n = 0; n < nodes.size(); n++)
+    {
+        const BvhNode & node = nodes[n];
+        if (node.count == 0)
+        {
+            parents[n + 1] = n;
+            parents[node.rightOrFirst] = n;
+            continue;
+        }
+        for (uint32_t i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++)
+        {
+            positions[objects[i]] = i;
+            leafNodes[i] = n;
+        }
+    }
+}
+
+
+void BoundingVolumeHierarchy::Clear()
+{
+    nodes.clear();
+    objects.clear();
+    leafBoxes.clear();
+    positions.clear();
+    leafNodes.clear();
+    parents.clear();
+    movedLeaves.clear();
+}
+
+
+bool BoundingVolumeHierarchy::UpdateNode(uint32_t node)
+{
+    BvhNode & current = nodes[node];
+    BoundingBox box;
+    if (current.count == 0)
+    {
+        box = nodeBox(nodes[node + 1]);
+        growBox(box, nodeBox(nodes[current.rightOrFirst]));
+    }
+    else
+    {
+        box = emptyBox();
+        for (uint32_t i = current.rightOrFirst; i < current.rightOrFirst + current.count; i++)
+            growBox(box, leafBoxes[i]);
+    }
+    if (box.min == current.min && box.max == current.max)
+        return false;
+    current.min = box.min;
+    current.max = box.max;
+    return true;
+}
+
+
+void BoundingVolumeHierarchy::Refit(const std::vector<BoundingBox> & boxes)
+{
+    for (size_t i = 0; i < objects.size(); i++)
+        leafBoxes[i] = boxes[objects[i]];
+    // Children follow their parent: a reverse walk sees them first.
+    for (size_t n = nodes.size(); n-- > 0;)
+        UpdateNode(static_cast<uint32_t>(n));
+    movedLeaves.clear();
+}
+
+
+void BoundingVolumeHierarchy::Set(uint32_t object, const BoundingBox & box)
+{
+    uint32_t position = positions[object];
+    leafBoxes[position] = box;
+    movedLeaves.push_back(leafNodes[position]);
+}
+
+
+void BoundingVolumeHierarchy::Refit()
+{
+    // Walk up from each moved leaf until a box is unchanged: the nodes above it already
+    // contain everything below.
+    for (uint32_t leaf : movedLeaves)
+    {
+        uint32_t node = leaf;
+        while (UpdateNode(node) && node != 0)
+            node = parents[node];
+    }
+    movedLeaves.clear();
+}
+
+
+void BoundingVolumeHierarchy::GetSubtreeRange(uint32_t node, uint32_t & first, uint32_t & end) const
+{
+    uint32_t left = node;
+    while (nodes[left].count == 0)
+        left = left + 1;
+    uint32_t right = node;
+    while (nodes[right].count == 0)
+        right = nodes[right].rightOrFirst;
+    first = nodes[left].rightOrFirst;
+    end = nodes[right].rightOrFirst + nodes[right].count;
+}
+
+
+void BoundingVolumeHierarchy::QueryFrustum(const Frustum & frustum, std::vector<uint32_t> & result) const
+{
+    result.clear();
+    if (nodes.empty())
+        return;
+
+    // Each entry carries the planes its box may still cross: those it is entirely in
+    // front of are not tested again below it.
+    struct Entry
+    {
+        uint32_t node;
+        uint32_t planes;
+    };
+    Entry stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = {0, 63};
+
+    glm::vec3 absolutes[6];
+    for (int p = 0; p < 6; p++)
+        absolutes[p] = glm::abs(glm::vec3(frustum.planes[p]));
+
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        const BvhNode & node = nodes[entry.node];
+
+        glm::vec3 center = (node.min + node.max) * 0.5f;
+        glm::vec3 extent = (node.max - node.min) * 0.5f;
+        uint32_t planes = entry.planes;
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++)
+        {
+            if (!((planes >> p) & 1))
+                continue;
+            const glm::vec4 & plane = frustum.planes[p];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float reach = glm::dot(absolutes[p], extent);
+            outside = distance < -reach;
+            if (distance >= reach)
+                planes &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+
+        if (planes == 0)
+        {
+            uint32_t first, end;
+            GetSubtreeRange(entry.node, first, end);
+            result.insert(result.end(), objects.begin() + first, objects.begin() + end);
+        }
+        else if (node.count > 0)
+        {
+            for (uint32_t i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++)
+            {
+                glm::vec3 boxCenter = (leafBoxes[i].min + leafBoxes[i].max) * 0.5f;
+                glm::vec3 boxExtent = (leafBoxes[i].max - leafBoxes[i].min) * 0.5f;
+                bool visible = true;
+                for (int p = 0; p < 6 && visible; p++)
+                {
+                    const glm::vec4 & plane = frustum.planes[p];
+                    if ((planes >> p) & 1)
+                        visible = glm::dot(glm::vec3(plane), boxCenter) + plane.w >= -glm::dot(absolutes[p], boxExtent);
+                }
+                if (visible)
+                    result.push_back(objects[i]);
+            }
+        }
+        else
+        {
+            stack[size++] = {node.rightOrFirst, planes};
+            stack[size++] = {entry.node + 1, planes};
+        }
+    }
+}
+
+
+void BoundingVolumeHierarchy::QueryBox(const BoundingBox & box, std::vector<uint32_t> & result) const
+{
+    result.clear();
+    if (nodes.empty())
+        return;
+
+    uint32_t stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        uint32_t index = stack[--size];
+        const BvhNode & node = nodes[index];
+        if (!boxesOverlap(node.min, node.max, box))
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++)
+            {
+                if (boxesOverlap(leafBoxes[i].min, leafBoxes[i].max, box))
+                    result.push_back(objects[i]);
+            }
+        }
+        else
+        {
+            stack[size++] = node.rightOrFirst;
+            stack[size++] = index + 1;
+        }
+    }
+}
+
+
+bool BoundingVolumeHierarchy::Raycast(const Ray & ray, RayHit & hit, const RayObjectTest & test) const
+{
+    if (nodes.empty())
+        return false;
+
+    // Infinite components of the inverse are what the slab test expects.
+    glm::vec3 inverseDirection = 1.0f / ray.direction;
+    Ray closest = ray;
+    bool found = false;
+
+    // Each entry keeps where the ray enters its box, to skip it once a closer hit is found.
+    struct Entry
+    {
+        uint32_t node;
+        float distance;
+    };
+    Entry stack[STACK_SIZE];
+    int size = 0;
+    float distance;
+    if (!intersectRayBox(ray.origin, inverseDirection, nodeBox(nodes[0]), closest.maxDistance, distance))
+        return false;
+    stack[size++] = {0, distance};
+
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        if (entry.distance > closest.maxDistance)
+            continue;
+        const BvhNode & node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++)
+            {
+                if (!intersectRayBox(ray.origin, inverseDirection, leafBoxes[i], closest.maxDistance, distance))
+                    continue;
+                if (test && !test(objects[i], closest, distance))
+                    continue;
+                if (distance <= closest.maxDistance)
+                {
+                    closest.maxDistance = distance;
+                    hit.object = objects[i];
+                    hit.distance = distance;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // Push the farther child first so that the nearer one is visited next.
+        Entry left = {entry.node + 1, 0.0f};
+        Entry right = {node.rightOrFirst, 0.0f};
+        bool leftHit = intersectRayBox(ray.origin, inverseDirection, nodeBox(nodes[left.node]),
+                                       closest.maxDistance, left.distance);
+        bool rightHit = intersectRayBox(ray.origin, inverseDirection, nodeBox(nodes[right.node]),
+                                        closest.maxDistance, right.distance);
+        if (leftHit && rightHit)
+        {
+            if (left.distance < right.distance)
+                std::swap(left, right);
+            stack[size++] = left;
+            stack[size++] = right;
+        }
+        else if (leftHit)
+            stack[size++] = left;
+        else if (rightHit)
+            stack[size++] = right;
+    }
+    return found;
+}
@@ -0,0 +1,124 @@
+#ifndef BOUNDINGVOLUMEHIERARCHY_H
+#define BOUNDINGVOLUMEHIERARCHY_H
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+
+/**
+ * A ray from `origin` along `direction` (not necessarily normalized: distances are in
+ * units of its length), up to `maxDistance`.
+ */
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+struct RayHit
+{
+    uint32_t object;
+    float distance;
+};
+
+/**
+ * Exact test of a ray against one object, called for the objects whose box the ray
+ * reaches. Returns true and sets `distance` when the object is hit.
+ */
+typedef std::function<bool(uint32_t object, const Ray & ray, float & distance)> RayObjectTest;
+
+// Slab test: distance where the ray enters the box, 0 when it starts inside.
+bool intersectRayBox(const glm::vec3 & origin, const glm::vec3 & inverseDirection, const BoundingBox & box,
+                     float maxDistance, float & distance);
+
+// Möller-Trumbore test against the triangle (a, b, c), both faces.
+bool intersectRayTriangle(const Ray & ray, const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c,
+                          float & distance);
+
+// Boxes of the triangles of a non-indexed mesh, as loadOBJ outputs it.
+std::vector<BoundingBox> computeTriangleBoxes(const std::vector<glm::vec3> & vertices);
+
+/**
+ * A node of the flattened tree, 32 bytes: two per cache line. Nodes are stored depth
+ * first, so the left child of an interior node directly follows it and only the right
+ * one is referenced. A leaf (count > 0) references `count` objects from `rightOrFirst`
+ * in the leaf order of the tree.
+ */
+struct BvhNode
+{
+    glm::vec3 min;
+    uint32_t rightOrFirst;
+    glm::vec3 max;
+    uint32_t count;
+};
+
+/**
+ * Bounding volume hierarchy over object boxes, for hierarchical frustum culling, ray
+ * casts and overlap queries in scenes too large for flat lists.
+ *
+ * Build() splits with the surface area heuristic evaluated on 16 bins per axis. The top
+ * of the tree is built in parallel: nodes with many objects bin them across threads, and
+ * the two halves of a split are built by different threads until every thread has work.
+ *
+ * Moving objects are handled by refitting the boxes without changing the tree, either
+ * all at once or only along the paths of the objects that moved. A refitted tree is
+ * valid but slower than a rebuilt one once objects travel far from where they were.
+ */
+class BoundingVolumeHierarchy
+{
+public:
+    BoundingVolumeHierarchy();
+
+    /**
+     * Builds the tree over `boxes`; the object index of a box is its position.
+     * @param threads Threads to build with, 0 for one per hardware thread.
+     */
+    void Build(const std::vector<BoundingBox> & boxes, unsigned int threads = 0);
+    void Clear();
+
+    // Updates the box of every object, then every node from the leaves up.
+    void Refit(const std::vector<BoundingBox> & boxes);
+
+    // Changes the box of one object; the nodes above it are updated by Refit().
+    void Set(uint32_t object, const BoundingBox & box);
+    // Updates the nodes above the objects changed by Set() since the last refit.
+    void Refit();
+
+    /**
+     * Replaces the content of `objects` with the objects whose box is in or across the
+     * frustum. Subtrees entirely inside are output without testing their objects.
+     */
+    void QueryFrustum(const Frustum & frustum, std::vector<uint32_t> & objects) const;
+
+    // Replaces the content of `objects` with the objects whose box overlaps `box`.
+    void QueryBox(const BoundingBox & box, std::vector<uint32_t> & objects) const;
+
+    /**
+     * Finds the closest object hit by the ray. Without a test, an object is hit where
+     * the ray enters its box. Children are visited nearest first, so most subtrees
+     * behind the hit are skipped.
+     */
+    bool Raycast(const Ray & ray, RayHit & hit, const RayObjectTest & test = RayObjectTest()) const;
+
+    size_t GetSize() const { return objects.size(); }
+    const std::vector<BvhNode> & GetNodes() const { return nodes; }
+
+private:
+    // Range of leaf order positions covered by the subtree of `node`.
+    void GetSubtreeRange(uint32_t node, uint32_t & first, uint32_t & end) const;
+    // Recomputes the box of `node` from its children or objects; false if unchanged.
+    bool UpdateNode(uint32_t node);
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> objects;        // Object of each leaf order position
+    std::vector<BoundingBox> leafBoxes;   // Box of each leaf order position
+    std::vector<uint32_t> positions;      // Leaf order position of each object
+    std::vector<uint32_t> leafNodes;      // Leaf node of each leaf order position
+    std::vector<uint32_t> parents;        // Parent of each node
+    std::vector<uint32_t> movedLeaves;    // Leaves changed by Set()
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "CameraPath.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Assets.h"
+
+
+bool CameraPath::Load(const std::string & path)
+{
+    std::vector<unsigned char> file;
+    if (!readAsset(path, file))
+    {
+        std::cout << "Impossible to open the " << path << " camera path!" << std::endl;
+        return false;
+    }
+    file.push_back('\0');
+
+    keys.clear();
+    for (char * line = reinterpret_cast<char*>(&file[0]); *line; )
+    {
+        char * next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        else
+            next = line + strlen(line);
+
+        CameraKey key;
+        if (line[0] != '#' && sscanf(line, "%f %f %f %f %f %f", &key.position.x, &key.position.y, &key.position.z,
+                                     &key.direction.x, &key.direction.y, &key.direction.z) == 6)
+            keys.push_back(key);
+        line = next;
+    }
+    return true;
+}
+
+
+bool CameraPath::Save(const std::string & path) const
+{
+    FILE * file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "Impossible to write the " << path << " camera path!" << std::endl;
+        return false;
+    }
+
+    fprintf(file, "# position x y z, view direction x y z\n");
+    for (const CameraKey & key : keys)
+        fprintf(file, "%.3f %.3f %.3f %.4f %.4f %.4f\n", key.position.x, key.position.y, key.position.z,
+                key.direction.x, key.direction.y, key.direction.z);
+    return fclose(file) == 0;
+}
+
+
+void CameraPath::Add(const glm::vec3 & position, const glm::vec3 & direction)
+{
+    CameraKey key;
+    key.position = position;
+    key.direction = direction;
+    keys.push_back(key);
+}
+
+
+glm::mat4 CameraPath::GetViewMatrix(size_t index) const
+{
+    const CameraKey & key = keys[index];
+    return glm::lookAt(key.position, key.position + key.direction, glm::vec3(0, 1, 0));
+}
+
+
+glm::vec3 getViewDirection(const glm::mat4 & view)
+{
+    // The third row of the rotation is the camera's backward axis.
+    return -glm::vec3(view[0][2], view[1][2], view[2][2]);
+}
@@ -0,0 +1,44 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * A camera pose: where it is and where it looks. The up direction is the world Y axis,
+ * as in Controls.
+ */
+struct CameraKey
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+};
+
+/**
+ * A recorded sequence of camera poses, replayed to measure or compare rendering along the
+ * same views every time.
+ *
+ * The file is text with one key per line, "px py pz dx dy dz"; lines starting with '#'
+ * are comments.
+ */
+class CameraPath
+{
+public:
+    bool Load(const std::string & path);
+    bool Save(const std::string & path) const;
+
+    void Add(const glm::vec3 & position, const glm::vec3 & direction);
+    void Clear() { keys.clear(); }
+
+    size_t GetSize() const { return keys.size(); }
+    const CameraKey & GetKey(size_t index) const { return keys[index]; }
+    glm::mat4 GetViewMatrix(size_t index) const;
+
+private:
+    std::vector<CameraKey> keys;
+};
+
+// Direction the camera of a view matrix looks towards.
+glm::vec3 getViewDirection(const glm::mat4 & view);
+
+#endif
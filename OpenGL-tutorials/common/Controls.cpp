@@ -20,6 +20,12 @@ glm::mat4 getProjectionMatrix()
 }
 
 
+glm::vec3 getCameraPosition()
+{
+    return position;
+}
+
+
 void computeMatricesFromInputs(GLFWwindow* window)
 {
     // glfwGetTime is called only once, the first time this function is called
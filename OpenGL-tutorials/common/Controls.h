@@ -14,4 +14,5 @@ static const float MOUSE_SPEED = 0.005f;
 void computeMatricesFromInputs(GLFWwindow* window);
 glm::mat4 getViewMatrix();
 glm::mat4 getProjectionMatrix();
+glm::vec3 getCameraPosition();
 #endif
@@ -0,0 +1,242 @@
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// SIMD width of the culling loop: AVX when the compiler targets it, SSE on any x86-64.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_LANES 8
+typedef __m256 Lanes;
+static inline Lanes lanesLoad(const float * p) { return _mm256_loadu_ps(p); }
+static inline Lanes lanesSet(float value) { return _mm256_set1_ps(value); }
+#if defined(__FMA__)
+static inline Lanes lanesMulAdd(Lanes a, Lanes b, Lanes c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+static inline Lanes lanesMulAdd(Lanes a, Lanes b, Lanes c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+static inline Lanes lanesMin(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+static inline Lanes lanesNegate(Lanes a) { return _mm256_sub_ps(_mm256_setzero_ps(), a); }
+static inline int lanesLess(Lanes a, Lanes b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_LANES 4
+typedef __m128 Lanes;
+static inline Lanes lanesLoad(const float * p) { return _mm_loadu_ps(p); }
+static inline Lanes lanesSet(float value) { return _mm_set1_ps(value); }
+static inline Lanes lanesMulAdd(Lanes a, Lanes b, Lanes c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline Lanes lanesNegate(Lanes a) { return _mm_sub_ps(_mm_setzero_ps(), a); }
+static inline int lanesLess(Lanes a, Lanes b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+#endif
+
+#ifdef CULL_LANES
+// For each 4-bit mask, the positions of its set bits, padded, and how many there are:
+// one store writes the visible indices of 4 lanes without branches.
+struct LaneCompaction
+{
+    int32_t offsets[4];
+    int count;
+};
+
+static const LaneCompaction COMPACTION[16] = {
+    {{0, 0, 0, 0}, 0},
+    {{0, 0, 0, 0}, 1},
+    {{1, 0, 0, 0}, 1},
+    {{0, 1, 0, 0}, 2},
+    {{2, 0, 0, 0}, 1},
+    {{0, 2, 0, 0}, 2},
+    {{1, 2, 0, 0}, 2},
+    {{0, 1, 2, 0}, 3},
+    {{3, 0, 0, 0}, 1},
+    {{0, 3, 0, 0}, 2},
+    {{1, 3, 0, 0}, 2},
+    {{0, 1, 3, 0}, 3},
+    {{2, 3, 0, 0}, 2},
+    {{0, 2, 3, 0}, 3},
+    {{1, 2, 3, 0}, 3},
+    {{0, 1, 2, 3}, 4},
+};
+#endif
+
+// The arrays are padded to a multiple of this with objects that are always culled, so
+// the SIMD loop has no remainder.
+static const size_t PADDING = 8;
+
+
+BoundingBox computeBoundingBox(const std::vector<glm::vec3> & positions)
+{
+    BoundingBox box;
+    box.min = glm::vec3(FLT_MAX);
+    box.max = glm::vec3(-FLT_MAX);
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        box.min = glm::min(box.min, positions[i]);
+        box.max = glm::max(box.max, positions[i]);
+    }
+    return box;
+}
+
+
+Frustum extractFrustum(const glm::mat4 & viewProjection)
+{
+    // glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];  // Left
+    frustum.planes[1] = rows[3] - rows[0];  // Right
+    frustum.planes[2] = rows[3] + rows[1];  // Bottom
+    frustum.planes[3] = rows[3] - rows[1];  // Top
+    frustum.planes[4] = rows[3] + rows[2];  // Near
+    frustum.planes[5] = rows[3] - rows[2];  // Far
+    for (int i = 0; i < 6; i++)
+        frustum.planes[i] = frustum.planes[i] / glm::length(glm::vec3(frustum.planes[i]));
+    return frustum;
+}
+
+
+FrustumCuller::FrustumCuller()
+    : count(0)
+{
+}
+
+
+void FrustumCuller::Reserve(size_t objects)
+{
+    size_t padded = (objects + PADDING - 1) / PADDING * PADDING;
+    for (std::vector<float> * array : {&centerX, &centerY, &centerZ, &radius,
+                                       &boxX, &boxY, &boxZ, &extentX, &extentY, &extentZ})
+        array->reserve(padded);
+}
+
+
+void FrustumCuller::Clear()
+{
+    count = 0;
+    for (std::vector<float> * array : {&centerX, &centerY, &centerZ, &radius,
+                                       &boxX, &boxY, &boxZ, &extentX, &extentY, &extentZ})
+        array->clear();
+}
+
+
+uint32_t FrustumCuller::Add(const BoundingBox & box)
+{
+    if (count == centerX.size())
+    {
+        // A new block of padding: a negative radius puts it outside of every plane.
+        for (std::vector<float> * array : {&centerX, &centerY, &centerZ,
+                                           &boxX, &boxY, &boxZ, &extentX, &extentY, &extentZ})
+            array->resize(count + PADDING, 0.0f);
+        radius.resize(count + PADDING, -FLT_MAX);
+    }
+    Set(static_cast<uint32_t>(count), box);
+    return static_cast<uint32_t>(count++);
+}
+
+
+void FrustumCuller::Set(uint32_t object, const BoundingBox & box)
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    centerX[object] = boxX[object] = center.x;
+    centerY[object] = boxY[object] = center.y;
+    centerZ[object] = boxZ[object] = center.z;
+    extentX[object] = extent.x;
+    extentY[object] = extent.y;
+    extentZ[object] = extent.z;
+    radius[object] = std::sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+}
+
+
+bool FrustumCuller::BoxVisible(const Frustum & frustum, size_t object) const
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const glm::vec4 & plane = frustum.planes[p];
+        float distance = plane.x * boxX[object] + plane.y * boxY[object] + plane.z * boxZ[object] + plane.w;
+        float reach = std::fabs(plane.x) * extentX[object] + std::fabs(plane.y) * extentY[object]
+                    + std::fabs(plane.z) * extentZ[object];
+        if (distance < -reach)
+            return false;
+    }
+    return true;
+}
+
+
+size_t FrustumCuller::Cull(const Frustum & frustum, std::vector<uint32_t> & visible) const
+{
+    // Room for every object; only grown, so the vector is not cleared every frame.
+    if (visible.size() < centerX.size())
+        visible.resize(centerX.size());
+    if (count == 0)
+        return 0;
+    uint32_t * out = &visible[0];
+    size_t found = 0;
+
+#ifdef CULL_LANES
+    Lanes planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = lanesSet(frustum.planes[p].x);
+        planeY[p] = lanesSet(frustum.planes[p].y);
+        planeZ[p] = lanesSet(frustum.planes[p].z);
+        planeW[p] = lanesSet(frustum.planes[p].w);
+    }
+
+    for (size_t i = 0; i < count; i += CULL_LANES)
+    {
+        Lanes x = lanesLoad(&centerX[i]);
+        Lanes y = lanesLoad(&centerY[i]);
+        Lanes z = lanesLoad(&centerZ[i]);
+        Lanes r = lanesLoad(&radius[i]);
+
+        // Only the closest plane matters: the sphere is outside when it is entirely
+        // behind it, and may only be partly inside when it is not entirely in front.
+        Lanes nearest = lanesMulAdd(x, planeX[0], lanesMulAdd(y, planeY[0], lanesMulAdd(z, planeZ[0], planeW[0])));
+        for (int p = 1; p < 6; p++)
+            nearest = lanesMin(nearest, lanesMulAdd(x, planeX[p], lanesMulAdd(y, planeY[p], lanesMulAdd(z, planeZ[p], planeW[p]))));
+
+        int inMask = ~lanesLess(nearest, lanesNegate(r)) & ((1 << CULL_LANES) - 1);
+        int crossMask = lanesLess(nearest, r) & inMask;
+
+        // Spheres across a plane are rare: refine them with their box.
+        if (crossMask)
+        {
+            for (int lane = 0; lane < CULL_LANES; lane++)
+            {
+                if (((crossMask >> lane) & 1) && !BoxVisible(frustum, i + lane))
+                    inMask &= ~(1 << lane);
+            }
+        }
+
+        // Store the indices of the visible lanes without branches, 4 at a time.
+        for (int quad = 0; quad < CULL_LANES; quad += 4)
+        {
+            const LaneCompaction & compaction = COMPACTION[(inMask >> quad) & 15];
+            __m128i offsets = _mm_loadu_si128(reinterpret_cast<const __m128i*>(compaction.offsets));
+            __m128i indices = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(i) + quad), offsets);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + found), indices);
+            found += compaction.count;
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+    {
+        bool outside = false;
+        bool crossing = false;
+        for (int p = 0; p < 6; p++)
+        {
+            const glm::vec4 & plane = frustum.planes[p];
+            float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+            outside |= distance < -radius[i];
+            crossing |= distance < radius[i];
+        }
+        if (!outside && (!crossing || BoxVisible(frustum, i)))
+            out[found++] = static_cast<uint32_t>(i);
+    }
+#endif
+    return found;
+}
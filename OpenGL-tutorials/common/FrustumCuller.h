@@ -0,0 +1,78 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Axis-aligned bounding box.
+ */
+struct BoundingBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Smallest box holding every position.
+BoundingBox computeBoundingBox(const std::vector<glm::vec3> & positions);
+
+/**
+ * The six planes of a view frustum (left, right, bottom, top, near, far), taken from the
+ * rows of a projection * view matrix and normalized. A point p is on the inner side of a
+ * plane when dot(plane.xyz, p) + plane.w >= 0.
+ */
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+Frustum extractFrustum(const glm::mat4 & viewProjection);
+
+
+/**
+ * Bounding spheres and boxes of many objects, stored as structure of arrays so that
+ * one SIMD instruction tests the same plane against 8 objects (AVX) or 4 (SSE). Other
+ * CPUs use a scalar loop written for auto-vectorization.
+ *
+ * Cull() tests the spheres first, which only reads 16 bytes per object. Only objects
+ * whose sphere crosses a plane have their box tested as well, so the box refines the
+ * result at the edges of the frustum without being read for every object.
+ */
+class FrustumCuller
+{
+public:
+    FrustumCuller();
+
+    void Reserve(size_t objects);
+    void Clear();
+
+    /**
+     * Adds an object and returns its index, the value Cull() outputs for it. The
+     * sphere is the one around the box.
+     */
+    uint32_t Add(const BoundingBox & box);
+
+    // Moves an object: bounds of moving objects are updated in place.
+    void Set(uint32_t object, const BoundingBox & box);
+
+    /**
+     * Writes the indices of the objects in or across the frustum, in increasing order,
+     * to the start of `visible` and returns their number. The vector is grown to the
+     * padded object count and never shrunk, so it is not cleared again every frame.
+     */
+    size_t Cull(const Frustum & frustum, std::vector<uint32_t> & visible) const;
+
+    size_t GetSize() const { return count; }
+
+private:
+    // Box test of one object whose sphere crosses at least one plane.
+    bool BoxVisible(const Frustum & frustum, size_t object) const;
+
+    size_t count;
+    // Spheres
+    std::vector<float> centerX, centerY, centerZ, radius;
+    // Boxes, as center and half extent
+    std::vector<float> boxX, boxY, boxZ, extentX, extentY, extentZ;
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include "GLState.h"
+#include <cstddef>
+#include <map>
+#include <tuple>
+#include <utility>
+
+
+// Marks a cached value as unknown, so that the next set is issued.
+static const GLuint UNKNOWN = ~0u;
+
+typedef std::tuple<GLuint, GLint, GLenum, GLboolean, GLsizei, GLsizei> AttribPointer;
+
+// The state GL stores inside a vertex array object.
+struct VertexArrayState
+{
+    GLuint elementBuffer = UNKNOWN;
+    std::map<GLuint, bool> enabled;
+    std::map<GLuint, AttribPointer> pointers;
+    std::map<GLuint, GLuint> divisors;
+};
+
+GLuint CurrentProgram = UNKNOWN;
+GLuint CurrentFramebuffer = UNKNOWN;
+GLuint CurrentVertexArray = UNKNOWN;
+GLuint ActiveTextureUnit = UNKNOWN;
+std::map<std::pair<GLuint, GLenum>, GLuint> BoundTextures;  // (unit, target) -> texture
+std::map<GLenum, GLuint> BoundBuffers;                      // Targets not stored in the VAO
+std::map<GLuint, VertexArrayState> VertexArrays;
+std::map<GLenum, bool> Capabilities;
+std::pair<GLenum, GLenum> CurrentBlendFunc(UNKNOWN, UNKNOWN);
+GLenum CurrentDepthFunc = UNKNOWN;
+GLuint CurrentDepthMask = UNKNOWN;
+GLuint CurrentColorMask = UNKNOWN;
+GLenum CurrentCullFace = UNKNOWN;
+std::tuple<GLint, GLint, GLsizei, GLsizei> CurrentViewport(-1, -1, -1, -1);
+GLStateStats StateStats = {0, 0};
+
+
+// Updates `cached` and returns true if the call must reach the driver.
+template <typename T>
+static bool changeState(T & cached, const T & value)
+{
+    if (cached == value)
+    {
+        StateStats.filtered++;
+        return false;
+    }
+    cached = value;
+    StateStats.issued++;
+    return true;
+}
+
+
+void useProgram(GLuint program)
+{
+    if (changeState(CurrentProgram, program))
+        glUseProgram(program);
+}
+
+
+void bindFramebuffer(GLuint framebuffer)
+{
+    if (changeState(CurrentFramebuffer, framebuffer))
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+
+void bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    std::map<std::pair<GLuint, GLenum>, GLuint>::iterator it =
+        BoundTextures.insert(std::make_pair(std::make_pair(unit, target), UNKNOWN)).first;
+    if (!changeState(it->second, texture))
+        return;
+
+    // Selecting the unit is only needed for an actual bind, so it is not counted apart.
+    if (ActiveTextureUnit != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        ActiveTextureUnit = unit;
+    }
+    glBindTexture(target, texture);
+}
+
+
+static VertexArrayState & currentVertexArray()
+{
+    return VertexArrays[CurrentVertexArray];
+}
+
+
+void bindVertexArray(GLuint vertex_array)
+{
+    if (changeState(CurrentVertexArray, vertex_array))
+        glBindVertexArray(vertex_array);
+}
+
+
+void bindBuffer(GLenum target, GLuint buffer)
+{
+    GLuint & cached = target == GL_ELEMENT_ARRAY_BUFFER
+                      ? currentVertexArray().elementBuffer
+                      : BoundBuffers.insert(std::make_pair(target, UNKNOWN)).first->second;
+    if (changeState(cached, buffer))
+        glBindBuffer(target, buffer);
+}
+
+
+static void setVertexAttribArray(GLuint index, bool enable)
+{
+    std::map<GLuint, bool> & enabled = currentVertexArray().enabled;
+    std::map<GLuint, bool>::iterator it = enabled.find(index);
+    if (it != enabled.end() && it->second == enable)
+    {
+        StateStats.filtered++;
+        return;
+    }
+    enabled[index] = enable;
+    StateStats.issued++;
+    if (enable)
+        glEnableVertexAttribArray(index);
+    else
+        glDisableVertexAttribArray(index);
+}
+
+
+void enableVertexAttribArray(GLuint index)
+{
+    setVertexAttribArray(index, true);
+}
+
+
+void disableVertexAttribArray(GLuint index)
+{
+    setVertexAttribArray(index, false);
+}
+
+
+void vertexAttribPointer(GLuint index, GLuint buffer, GLint size, GLenum type, GLboolean normalized,
+                         GLsizei stride, GLsizei offset)
+{
+    AttribPointer pointer = std::make_tuple(buffer, size, type, normalized, stride, offset);
+    std::map<GLuint, AttribPointer> & pointers = currentVertexArray().pointers;
+    std::map<GLuint, AttribPointer>::iterator it = pointers.find(index);
+    if (it != pointers.end() && it->second == pointer)
+    {
+        StateStats.filtered++;
+        return;
+    }
+    pointers[index] = pointer;
+    StateStats.issued++;
+
+    bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(index, size, type, normalized, stride, reinterpret_cast<void*>(static_cast<size_t>(offset)));
+}
+
+
+void vertexAttribDivisor(GLuint index, GLuint divisor)
+{
+    GLuint & cached = currentVertexArray().divisors.insert(std::make_pair(index, UNKNOWN)).first->second;
+    if (changeState(cached, divisor))
+        glVertexAttribDivisor(index, divisor);
+}
+
+
+static void setCapability(GLenum capability, bool enable)
+{
+    std::map<GLenum, bool>::iterator it = Capabilities.find(capability);
+    if (it != Capabilities.end() && it->second == enable)
+    {
+        StateStats.filtered++;
+        return;
+    }
+    Capabilities[capability] = enable;
+    StateStats.issued++;
+    if (enable)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+
+void enableCapability(GLenum capability)
+{
+    setCapability(capability, true);
+}
+
+
+void disableCapability(GLenum capability)
+{
+    setCapability(capability, false);
+}
+
+
+void blendFunc(GLenum source, GLenum destination)
+{
+    if (changeState(CurrentBlendFunc, std::make_pair(source, destination)))
+        glBlendFunc(source, destination);
+}
+
+
+void depthFunc(GLenum function)
+{
+    if (changeState(CurrentDepthFunc, function))
+        glDepthFunc(function);
+}
+
+
+void depthMask(GLboolean write)
+{
+    if (changeState(CurrentDepthMask, static_cast<GLuint>(write)))
+        glDepthMask(write);
+}
+
+
+void colorMask(GLboolean write)
+{
+    if (changeState(CurrentColorMask, static_cast<GLuint>(write)))
+        glColorMask(write, write, write, write);
+}
+
+
+void cullFace(GLenum face)
+{
+    if (changeState(CurrentCullFace, face))
+        glCullFace(face);
+}
+
+
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (changeState(CurrentViewport, std::make_tuple(x, y, width, height)))
+        glViewport(x, y, width, height);
+}
+
+
+void invalidateGLState()
+{
+    CurrentProgram = UNKNOWN;
+    CurrentFramebuffer = UNKNOWN;
+    CurrentVertexArray = UNKNOWN;
+    ActiveTextureUnit = UNKNOWN;
+    BoundTextures.clear();
+    BoundBuffers.clear();
+    VertexArrays.clear();
+    Capabilities.clear();
+    CurrentBlendFunc = std::make_pair(UNKNOWN, UNKNOWN);
+    CurrentDepthFunc = UNKNOWN;
+    CurrentDepthMask = UNKNOWN;
+    CurrentColorMask = UNKNOWN;
+    CurrentCullFace = UNKNOWN;
+    CurrentViewport = std::make_tuple(-1, -1, -1, -1);
+}
+
+
+void forgetBuffer(GLuint buffer)
+{
+    for (std::map<GLenum, GLuint>::iterator it = BoundBuffers.begin(); it != BoundBuffers.end(); ++it)
+    {
+        if (it->second == buffer)
+            it->second = UNKNOWN;
+    }
+    for (std::map<GLuint, VertexArrayState>::iterator vao = VertexArrays.begin(); vao != VertexArrays.end(); ++vao)
+    {
+        if (vao->second.elementBuffer == buffer)
+            vao->second.elementBuffer = UNKNOWN;
+
+        std::map<GLuint, AttribPointer> & pointers = vao->second.pointers;
+        for (std::map<GLuint, AttribPointer>::iterator it = pointers.begin(); it != pointers.end(); )
+        {
+            if (std::get<0>(it->second) == buffer)
+                it = pointers.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+
+void forgetTexture(GLuint texture)
+{
+    for (std::map<std::pair<GLuint, GLenum>, GLuint>::iterator it = BoundTextures.begin(); it != BoundTextures.end(); ++it)
+    {
+        if (it->second == texture)
+            it->second = UNKNOWN;
+    }
+}
+
+
+void forgetVertexArray(GLuint vertex_array)
+{
+    VertexArrays.erase(vertex_array);
+    if (CurrentVertexArray == vertex_array)
+        CurrentVertexArray = UNKNOWN;
+}
+
+
+GLStateStats getGLStateStats()
+{
+    return StateStats;
+}
+
+
+void resetGLStateStats()
+{
+    StateStats.issued = 0;
+    StateStats.filtered = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+#include <GL/glew.h>
+
+/**
+ * Counters of the GL state cache.
+ */
+struct GLStateStats
+{
+    unsigned int issued;    // Calls forwarded to the driver
+    unsigned int filtered;  // Calls dropped because the state was already set
+};
+
+// Shadowed versions of the GL state setters. Each one only calls the driver when the
+// value differs from the one it last set, so per-frame code can state what it needs
+// without checking what is already bound. The cache starts unknown: the first call of
+// each always goes through.
+//
+// Code that changes the same state with raw gl* calls must restore it afterwards, or
+// call invalidateGLState() so the next calls are issued again.
+
+void useProgram(GLuint program);
+void bindFramebuffer(GLuint framebuffer);  // GL_FRAMEBUFFER, both draw and read
+
+// Texture units are tracked per target. Selects the unit with glActiveTexture only
+// when a bind is actually needed.
+void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+// Element array bindings and vertex attributes are tracked per VAO, as GL stores them.
+void bindVertexArray(GLuint vertex_array);
+void bindBuffer(GLenum target, GLuint buffer);
+void enableVertexAttribArray(GLuint index);
+void disableVertexAttribArray(GLuint index);
+// Binds `buffer` to GL_ARRAY_BUFFER and sets the pointer, unless the bound VAO already
+// has exactly this layout for `index`.
+void vertexAttribPointer(GLuint index, GLuint buffer, GLint size, GLenum type, GLboolean normalized,
+                         GLsizei stride, GLsizei offset);
+void vertexAttribDivisor(GLuint index, GLuint divisor);
+
+// Fixed function state.
+void enableCapability(GLenum capability);
+void disableCapability(GLenum capability);
+void blendFunc(GLenum source, GLenum destination);
+void depthFunc(GLenum function);
+void depthMask(GLboolean write);
+void colorMask(GLboolean write);  // All four channels
+void cullFace(GLenum face);
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// Forgets everything: the next call of every setter reaches the driver.
+void invalidateGLState();
+
+// Names are reused by glGen*: forget the bindings of an object before deleting it.
+void forgetBuffer(GLuint buffer);
+void forgetTexture(GLuint texture);
+void forgetVertexArray(GLuint vertex_array);
+
+GLStateStats getGLStateStats();
+void resetGLStateStats();
+
+#endif
@@ -0,0 +1,66 @@
+#include "InstancedRenderer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "GLState.h"
+
+
+bool InstancedRenderer::Create(size_t maxInstances)
+{
+    capacity = maxInstances;
+    return stream.Create(GL_ARRAY_BUFFER, maxInstances * sizeof(InstanceTransform));
+}
+
+
+void InstancedRenderer::Destroy()
+{
+    stream.Destroy();
+    capacity = 0;
+}
+
+
+void InstancedRenderer::Draw(Mesh & mesh, const InstanceTransform * instances, size_t count)
+{
+    GLsizei stride = sizeof(InstanceTransform);
+    while (count > 0)
+    {
+        size_t batch = std::min(count, capacity);
+        size_t offset;
+        void * data = stream.Map(batch * sizeof(InstanceTransform), offset, sizeof(InstanceTransform));
+        if (!data)
+            return;
+        memcpy(data, instances, batch * sizeof(InstanceTransform));
+        stream.Unmap();
+
+        // Only the offsets change from one draw to the next; the cache drops the rest.
+        bindVertexArray(mesh.GetVertexArray());
+        GLsizei base = static_cast<GLsizei>(offset);
+        enableVertexAttribArray(INSTANCE_ROTATION_ATTRIBUTE);
+        vertexAttribPointer(INSTANCE_ROTATION_ATTRIBUTE, stream.GetBuffer(), 4, GL_FLOAT, GL_FALSE, stride,
+                            base + offsetof(InstanceTransform, rotation));
+        vertexAttribDivisor(INSTANCE_ROTATION_ATTRIBUTE, 1);
+        enableVertexAttribArray(INSTANCE_POSITION_ATTRIBUTE);
+        vertexAttribPointer(INSTANCE_POSITION_ATTRIBUTE, stream.GetBuffer(), 4, GL_FLOAT, GL_FALSE, stride,
+                            base + offsetof(InstanceTransform, position));
+        vertexAttribDivisor(INSTANCE_POSITION_ATTRIBUTE, 1);
+
+        mesh.DrawInstanced(static_cast<GLsizei>(batch));
+
+        instances += batch;
+        count -= batch;
+    }
+}
+
+
+void InstancedRenderer::Draw(Mesh & mesh, const std::vector<InstanceTransform> & instances)
+{
+    if (!instances.empty())
+        Draw(mesh, &instances[0], instances.size());
+}
+
+
+void InstancedRenderer::EndFrame()
+{
+    stream.NextRegion();
+}
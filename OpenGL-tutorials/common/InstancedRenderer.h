@@ -0,0 +1,64 @@
+#ifndef INSTANCEDRENDERER_H
+#define INSTANCEDRENDERER_H
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Mesh.h"
+#include "StreamBuffer.h"
+
+// Vertex attributes the instance data is read from, after the mesh's 0 to 2.
+#define INSTANCE_ROTATION_ATTRIBUTE 3  // vec4 quaternion (x, y, z, w)
+#define INSTANCE_POSITION_ATTRIBUTE 4  // vec4 position (xyz) and uniform scale (w)
+
+/**
+ * Placement of one instance: 32 bytes instead of the 64 of a model matrix. The scale is
+ * uniform, so normals are rotated like positions without an inverse transpose.
+ */
+struct InstanceTransform
+{
+    glm::vec4 rotation;  // Unit quaternion, stored x, y, z, w whatever glm's quat layout
+    glm::vec3 position;
+    float scale;
+
+    InstanceTransform() : rotation(0, 0, 0, 1), position(0, 0, 0), scale(1) {}
+    InstanceTransform(const glm::quat & q, const glm::vec3 & p, float s = 1.0f)
+        : rotation(q.x, q.y, q.z, q.w), position(p), scale(s) {}
+};
+static_assert(sizeof(InstanceTransform) == 32, "InstanceTransform must stay tightly packed");
+
+/**
+ * Draws many copies of a mesh with one glDrawElementsInstanced.
+ *
+ * The transforms are written into a StreamBuffer and read by the two instance attributes
+ * with a divisor of 1; the vertex shader builds the model transform from them. Call
+ * EndFrame() once per frame, after the last Draw().
+ */
+class InstancedRenderer
+{
+public:
+    /**
+     * @param maxInstances Instances drawn per frame at most, all Draw() calls included.
+     */
+    bool Create(size_t maxInstances);
+    void Destroy();
+
+    /**
+     * Uploads `count` transforms and draws `mesh` once for each. Counts larger than
+     * the capacity are split into several instanced draws.
+     */
+    void Draw(Mesh & mesh, const InstanceTransform * instances, size_t count);
+    void Draw(Mesh & mesh, const std::vector<InstanceTransform> & instances);
+
+    void EndFrame();
+
+    size_t GetCapacity() const { return capacity; }
+    unsigned int GetStalls() const { return stream.GetStalls(); }
+
+private:
+    StreamBuffer stream;
+    size_t capacity = 0;
+};
+
+#endif
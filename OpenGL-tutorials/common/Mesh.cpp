@@ -0,0 +1,201 @@
+#include "Mesh.h"
+#include <cstddef>
+#include <utility>
+
+#include "GLState.h"
+
+
+Mesh::Mesh()
+    : vertexArray(0),
+      elementBuffer(0),
+      count(0)
+{
+}
+
+
+Mesh::~Mesh()
+{
+    Destroy();
+}
+
+
+Mesh::Mesh(Mesh && other)
+    : vertexArray(0),
+      elementBuffer(0),
+      count(0)
+{
+    *this = std::move(other);
+}
+
+
+Mesh & Mesh::operator=(Mesh && other)
+{
+    if (this != &other)
+    {
+        Destroy();
+        vertexArray = other.vertexArray;
+        buffers.swap(other.buffers);
+        bufferBytes.swap(other.bufferBytes);
+        elementBuffer = other.elementBuffer;
+        count = other.count;
+        other.vertexArray = 0;
+        other.elementBuffer = 0;
+        other.count = 0;
+    }
+    return *this;
+}
+
+
+// Bytes per component of the attribute types the meshes use.
+static size_t typeSize(GLenum type)
+{
+    switch (type)
+    {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+
+// Binds the vertex array, creating it first. The state cache records what is set into it.
+void Mesh::Bind()
+{
+    if (!vertexArray)
+        glGenVertexArrays(1, &vertexArray);
+    bindVertexArray(vertexArray);
+}
+
+
+void Mesh::AddAttribute(GLuint index, const std::vector<glm::vec2> & data)
+{
+    GLuint buffer = AddBuffer(&data[0], data.size() * sizeof(glm::vec2));
+    AddAttribute(index, buffer, 2, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
+
+void Mesh::AddAttribute(GLuint index, const std::vector<glm::vec3> & data)
+{
+    GLuint buffer = AddBuffer(&data[0], data.size() * sizeof(glm::vec3));
+    AddAttribute(index, buffer, 3, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
+
+void Mesh::AddInterleaved(const std::vector<InterleavedVertex> & vertices)
+{
+    GLsizei stride = sizeof(InterleavedVertex);
+    GLuint buffer = AddBuffer(&vertices[0], vertices.size() * stride);
+    AddAttribute(0, buffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertex, position));
+    AddAttribute(1, buffer, 2, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertex, uv));
+    AddAttribute(2, buffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertex, normal));
+}
+
+
+void Mesh::AddInterleaved(const std::vector<InterleavedVertexTBN> & vertices)
+{
+    GLsizei stride = sizeof(InterleavedVertexTBN);
+    GLuint buffer = AddBuffer(&vertices[0], vertices.size() * stride);
+    AddAttribute(0, buffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertexTBN, position));
+    AddAttribute(1, buffer, 2, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertexTBN, uv));
+    AddAttribute(2, buffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertexTBN, normal));
+    AddAttribute(3, buffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertexTBN, tangent));
+    AddAttribute(4, buffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertexTBN, bitangent));
+}
+
+
+GLuint Mesh::AddBuffer(const void * data, size_t bytes, GLenum usage)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, data, usage);
+    buffers.push_back(buffer);
+    bufferBytes.push_back(bytes);
+    return buffer;
+}
+
+
+void Mesh::AddAttribute(GLuint index, GLuint buffer, GLint size, GLenum type, GLboolean normalized,
+                        GLsizei stride, GLsizei offset, GLuint divisor)
+{
+    Bind();
+    enableVertexAttribArray(index);
+    vertexAttribPointer(index, buffer, size, type, normalized, stride, offset);
+    vertexAttribDivisor(index, divisor);
+
+    // Vertices in the buffer, when it is ours: SetIndices replaces this count.
+    if (elementBuffer || count || divisor)
+        return;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        if (buffers[i] != buffer)
+            continue;
+        size_t elementBytes = size * typeSize(type);
+        size_t step = stride ? static_cast<size_t>(stride) : elementBytes;
+        if (bufferBytes[i] >= offset + elementBytes)
+            count = static_cast<GLsizei>((bufferBytes[i] - offset - elementBytes) / step + 1);
+        return;
+    }
+}
+
+
+void Mesh::SetIndices(const std::vector<unsigned short> & indices)
+{
+    Bind();
+    if (!elementBuffer)
+        glGenBuffers(1, &elementBuffer);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+    count = static_cast<GLsizei>(indices.size());
+}
+
+
+void Mesh::Draw() const
+{
+    bindVertexArray(vertexArray);
+    if (elementBuffer)
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, (void*)0);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, count);
+}
+
+
+void Mesh::DrawInstanced(GLsizei instances) const
+{
+    bindVertexArray(vertexArray);
+    if (elementBuffer)
+        glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, (void*)0, instances);
+    else
+        glDrawArraysInstanced(GL_TRIANGLES, 0, count, instances);
+}
+
+
+void Mesh::Destroy()
+{
+    for (size_t i = 0; i < buffers.size(); i++)
+        forgetBuffer(buffers[i]);
+    if (!buffers.empty())
+        glDeleteBuffers(static_cast<GLsizei>(buffers.size()), &buffers[0]);
+    buffers.clear();
+    bufferBytes.clear();
+
+    if (elementBuffer)
+    {
+        forgetBuffer(elementBuffer);
+        glDeleteBuffers(1, &elementBuffer);
+        elementBuffer = 0;
+    }
+    if (vertexArray)
+    {
+        forgetVertexArray(vertexArray);
+        glDeleteVertexArrays(1, &vertexArray);
+        vertexArray = 0;
+    }
+    count = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef MESH_H
+#define MESH_H
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "VBOIndexer.h"
+
+/**
+ * Vertex buffers, an optional index buffer and the vertex array object recording how
+ * they are read. The layout is specified once, when the data is uploaded; drawing is
+ * then a single glBindVertexArray plus the draw call, instead of a glBindBuffer,
+ * glVertexAttribPointer and glEnableVertexAttribArray per attribute and per draw.
+ */
+class Mesh
+{
+public:
+    Mesh();
+    ~Mesh();
+
+    // A mesh owns GL objects: copies would delete them twice, moves hand them over.
+    Mesh(const Mesh &) = delete;
+    Mesh & operator=(const Mesh &) = delete;
+    Mesh(Mesh && other);
+    Mesh & operator=(Mesh && other);
+
+    /**
+     * Uploads `data` into a new buffer read by attribute `index` of the shaders.
+     */
+    void AddAttribute(GLuint index, const std::vector<glm::vec2> & data);
+    void AddAttribute(GLuint index, const std::vector<glm::vec3> & data);
+
+    /**
+     * Uploads interleaved vertices into one buffer and records strided attributes:
+     * 0 position, 1 UV, 2 normal, and 3 tangent, 4 bitangent for the TBN layout.
+     */
+    void AddInterleaved(const std::vector<InterleavedVertex> & vertices);
+    void AddInterleaved(const std::vector<InterleavedVertexTBN> & vertices);
+
+    /**
+     * Uploads a buffer owned by the mesh without reading it from any attribute yet,
+     * for interleaved or instanced data described with AddAttribute(index, buffer, ...).
+     */
+    GLuint AddBuffer(const void * data, size_t bytes, GLenum usage = GL_STATIC_DRAW);
+
+    /**
+     * Records attribute `index` as read from `buffer`, at `offset` bytes with `stride`.
+     * `divisor` is non zero for per-instance attributes. The first per-vertex attribute
+     * read from a buffer of the mesh sets the vertex count of meshes without indices.
+     */
+    void AddAttribute(GLuint index, GLuint buffer, GLint size, GLenum type, GLboolean normalized,
+                      GLsizei stride, GLsizei offset, GLuint divisor = 0);
+
+    /**
+     * Uploads the index buffer into the vertex array. Meshes without one draw their
+     * vertices in order.
+     */
+    void SetIndices(const std::vector<unsigned short> & indices);
+
+    /**
+     * Binds the vertex array (through the GL state cache) and draws every triangle.
+     */
+    void Draw() const;
+    void DrawInstanced(GLsizei instances) const;
+
+    void Destroy();
+
+    GLuint GetVertexArray() const { return vertexArray; }
+    GLsizei GetCount() const { return count; }
+
+private:
+    void Bind();
+
+    GLuint vertexArray;
+    std::vector<GLuint> buffers;
+    std::vector<size_t> bufferBytes;  // Size of each of `buffers`
+    GLuint elementBuffer;
+    GLsizei count;  // Indices, or vertices of the first attribute when not indexed
+};
+
+#endif
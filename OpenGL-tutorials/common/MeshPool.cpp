@@ -0,0 +1,120 @@
+#include "MeshPool.h"
+#include <cstddef>
+#include <iostream>
+
+#include "GLState.h"
+
+
+MeshPool::MeshPool()
+    : vertexArray(0),
+      vertexBuffer(0),
+      indexBuffer(0),
+      maxVertices(0),
+      maxIndices(0),
+      vertexCount(0),
+      indexCount(0)
+{
+}
+
+
+MeshPool::~MeshPool()
+{
+    Destroy();
+}
+
+
+bool MeshPool::Create(size_t maxVertices, size_t maxIndices)
+{
+    Destroy();
+    this->maxVertices = maxVertices;
+    this->maxIndices = maxIndices;
+
+    glGenVertexArrays(1, &vertexArray);
+    bindVertexArray(vertexArray);
+
+    glGenBuffers(1, &vertexBuffer);
+    bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(InterleavedVertex), NULL, GL_STATIC_DRAW);
+
+    GLsizei stride = sizeof(InterleavedVertex);
+    enableVertexAttribArray(0);
+    vertexAttribPointer(0, vertexBuffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertex, position));
+    enableVertexAttribArray(1);
+    vertexAttribPointer(1, vertexBuffer, 2, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertex, uv));
+    enableVertexAttribArray(2);
+    vertexAttribPointer(2, vertexBuffer, 3, GL_FLOAT, GL_FALSE, stride, offsetof(InterleavedVertex, normal));
+
+    glGenBuffers(1, &indexBuffer);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, maxIndices * sizeof(unsigned short), NULL, GL_STATIC_DRAW);
+    return true;
+}
+
+
+void MeshPool::Destroy()
+{
+    if (vertexBuffer)
+    {
+        forgetBuffer(vertexBuffer);
+        glDeleteBuffers(1, &vertexBuffer);
+        vertexBuffer = 0;
+    }
+    if (indexBuffer)
+    {
+        forgetBuffer(indexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        indexBuffer = 0;
+    }
+    if (vertexArray)
+    {
+        forgetVertexArray(vertexArray);
+        glDeleteVertexArrays(1, &vertexArray);
+        vertexArray = 0;
+    }
+    Clear();
+}
+
+
+bool MeshPool::Add(const std::vector<InterleavedVertex> & vertices, const std::vector<unsigned short> & indices,
+                   MeshRange & range)
+{
+    if (vertices.empty() || indices.empty())
+        return false;
+    if (vertexCount + vertices.size() > maxVertices || indexCount + indices.size() > maxIndices)
+    {
+        std::cout << "MeshPool: no room for " << vertices.size() << " vertices and "
+                  << indices.size() << " indices." << std::endl;
+        return false;
+    }
+
+    // The element buffer binding belongs to the vertex array.
+    bindVertexArray(vertexArray);
+    bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(InterleavedVertex),
+                    vertices.size() * sizeof(InterleavedVertex), &vertices[0]);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned short),
+                    indices.size() * sizeof(unsigned short), &indices[0]);
+
+    range.indexCount = static_cast<GLuint>(indices.size());
+    range.firstIndex = static_cast<GLuint>(indexCount);
+    range.baseVertex = static_cast<GLint>(vertexCount);
+    vertexCount += vertices.size();
+    indexCount += indices.size();
+    return true;
+}
+
+
+void MeshPool::Clear()
+{
+    vertexCount = 0;
+    indexCount = 0;
+}
+
+
+void MeshPool::Draw(const MeshRange & range) const
+{
+    bindVertexArray(vertexArray);
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_SHORT,
+                             reinterpret_cast<void*>(range.firstIndex * sizeof(unsigned short)), range.baseVertex);
+}
@@ -0,0 +1,63 @@
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+#include <vector>
+#include <GL/glew.h>
+
+#include "VBOIndexer.h"
+
+/**
+ * Where a mesh lives in a MeshPool: the arguments of glDrawElementsBaseVertex, and the
+ * fields of an indirect draw command.
+ */
+struct MeshRange
+{
+    GLuint indexCount;
+    GLuint firstIndex;  // In indices, not bytes
+    GLint baseVertex;   // Added to every index, so meshes keep their 16-bit indices
+};
+
+/**
+ * One vertex buffer and one index buffer shared by many meshes, read through a single
+ * vertex array. Meshes are appended one after the other and only freed all together,
+ * so drawing any of them never changes the bound buffers, and draws of different
+ * meshes can be merged into one multi-draw call.
+ *
+ * Vertices use the interleaved layout of InterleavedVertex: attributes 0 to 2.
+ */
+class MeshPool
+{
+public:
+    MeshPool();
+    ~MeshPool();
+
+    bool Create(size_t maxVertices, size_t maxIndices);
+    void Destroy();
+
+    /**
+     * Uploads a mesh after the previous ones. Returns false, leaving the pool unchanged,
+     * when it does not fit.
+     */
+    bool Add(const std::vector<InterleavedVertex> & vertices, const std::vector<unsigned short> & indices,
+             MeshRange & range);
+
+    // Forgets every mesh; the next Add() starts at the beginning of the buffers again.
+    void Clear();
+
+    // Draws one mesh with its own draw call.
+    void Draw(const MeshRange & range) const;
+
+    GLuint GetVertexArray() const { return vertexArray; }
+    size_t GetVertexCount() const { return vertexCount; }
+    size_t GetIndexCount() const { return indexCount; }
+
+private:
+    GLuint vertexArray;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    size_t maxVertices;
+    size_t maxIndices;
+    size_t vertexCount;  // Used so far
+    size_t indexCount;
+};
+
+#endif
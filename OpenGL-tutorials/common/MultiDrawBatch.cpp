@@ -0,0 +1,154 @@
+#include "MultiDrawBatch.h"
+#include <cstring>
+#include <iostream>
+
+#include "GLState.h"
+
+
+MultiDrawBatch::MultiDrawBatch()
+    : pool(nullptr),
+      drawIndexBuffer(0),
+      maxDraws(0),
+      drawDataSize(0),
+      storageAlignment(256)
+{
+}
+
+
+MultiDrawBatch::~MultiDrawBatch()
+{
+    Destroy();
+}
+
+
+bool MultiDrawBatch::IsSupported()
+{
+    // Program interface queries connect the storage block to its binding in GLSL 4.10.
+    return GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_base_instance
+        && GLEW_ARB_program_interface_query;
+}
+
+
+bool MultiDrawBatch::Create(MeshPool & pool, size_t maxDraws, size_t drawDataSize)
+{
+    Destroy();
+    if (!IsSupported())
+    {
+        std::cout << "MultiDrawBatch: multi draw indirect or shader storage buffers unavailable." << std::endl;
+        return false;
+    }
+
+    this->pool = &pool;
+    this->maxDraws = maxDraws;
+    this->drawDataSize = drawDataSize;
+
+    GLint offsetAlignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    storageAlignment = static_cast<size_t>(offsetAlignment);
+
+    // Without the streams there is nothing to draw from: let the caller draw object by object.
+    if (!commandStream.Create(GL_DRAW_INDIRECT_BUFFER, maxDraws * sizeof(DrawElementsIndirectCommand)) ||
+        !dataStream.Create(GL_SHADER_STORAGE_BUFFER, maxDraws * drawDataSize + storageAlignment))
+    {
+        Destroy();
+        return false;
+    }
+
+    // Draw i of a call is given baseInstance i: with a divisor of 1, the attribute reads
+    // element i of this buffer.
+    std::vector<GLfloat> drawIndices(maxDraws);
+    for (size_t i = 0; i < maxDraws; i++)
+        drawIndices[i] = static_cast<GLfloat>(i);
+    glGenBuffers(1, &drawIndexBuffer);
+    bindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, maxDraws * sizeof(GLfloat), &drawIndices[0], GL_STATIC_DRAW);
+
+    bindVertexArray(pool.GetVertexArray());
+    enableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+    vertexAttribPointer(DRAW_INDEX_ATTRIBUTE, drawIndexBuffer, 1, GL_FLOAT, GL_FALSE, 0, 0);
+    vertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+
+    commands.reserve(maxDraws);
+    drawData.reserve(maxDraws * drawDataSize);
+    return true;
+}
+
+
+void MultiDrawBatch::Destroy()
+{
+    commandStream.Destroy();
+    dataStream.Destroy();
+    if (drawIndexBuffer)
+    {
+        forgetBuffer(drawIndexBuffer);
+        glDeleteBuffers(1, &drawIndexBuffer);
+        drawIndexBuffer = 0;
+    }
+    pool = nullptr;
+    Clear();
+}
+
+
+void MultiDrawBatch::Clear()
+{
+    commands.clear();
+    drawData.clear();
+}
+
+
+bool MultiDrawBatch::Add(const MeshRange & range, const void * data)
+{
+    if (commands.size() >= maxDraws)
+        return false;
+
+    DrawElementsIndirectCommand command;
+    command.count = range.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = static_cast<GLuint>(commands.size());
+    commands.push_back(command);
+
+    const unsigned char * bytes = static_cast<const unsigned char*>(data);
+    drawData.insert(drawData.end(), bytes, bytes + drawDataSize);
+    return true;
+}
+
+
+void MultiDrawBatch::Draw(GLuint storageBinding)
+{
+    if (commands.empty() || !pool)
+        return;
+
+    size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+    size_t commandOffset;
+    void * commandData = commandStream.Map(commandBytes, commandOffset, sizeof(DrawElementsIndirectCommand));
+    size_t dataOffset;
+    void * storageData = dataStream.Map(drawData.size(), dataOffset, storageAlignment);
+    if (!commandData || !storageData)
+    {
+        commandStream.Unmap();
+        dataStream.Unmap();
+        return;
+    }
+    memcpy(commandData, &commands[0], commandBytes);
+    commandStream.Unmap();
+    memcpy(storageData, &drawData[0], drawData.size());
+    dataStream.Unmap();
+
+    // The indexed binding also sets the generic one: keep the state cache in agreement.
+    bindBuffer(GL_SHADER_STORAGE_BUFFER, dataStream.GetBuffer());
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, storageBinding, dataStream.GetBuffer(), dataOffset, drawData.size());
+
+    bindVertexArray(pool->GetVertexArray());
+    bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream.GetBuffer());
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, reinterpret_cast<void*>(commandOffset),
+                                static_cast<GLsizei>(commands.size()), 0);
+}
+
+
+void MultiDrawBatch::EndFrame()
+{
+    commandStream.NextRegion();
+    dataStream.NextRegion();
+}
@@ -0,0 +1,90 @@
+#ifndef MULTIDRAWBATCH_H
+#define MULTIDRAWBATCH_H
+#include <vector>
+#include <GL/glew.h>
+
+#include "MeshPool.h"
+#include "StreamBuffer.h"
+
+// Vertex attribute holding the index of the draw inside its multi-draw call, for
+// shaders without gl_DrawIDARB (see MultiDrawBatch).
+#define DRAW_INDEX_ATTRIBUTE 3
+
+/**
+ * The layout glMultiDrawElementsIndirect reads its commands in.
+ */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/**
+ * Draws of meshes from one MeshPool, collected during a frame and issued with a single
+ * glMultiDrawElementsIndirect, whatever their mesh.
+ *
+ * Each draw carries a block of per-draw data (a model matrix, a color...) of a size fixed
+ * at creation. The blocks are uploaded into a shader storage buffer bound with
+ * glBindBufferRange, and the shader indexes it with the draw's position in the call:
+ * gl_DrawIDARB where ARB_shader_draw_parameters exists, otherwise the float attribute
+ * DRAW_INDEX_ATTRIBUTE, which reads the command's baseInstance through a divisor of 1.
+ * Commands and blocks go through StreamBuffers: call EndFrame() once per frame.
+ *
+ * Needs GL 4.3 level features; check IsSupported() first.
+ */
+class MultiDrawBatch
+{
+public:
+    MultiDrawBatch();
+    ~MultiDrawBatch();
+
+    // ARB_multi_draw_indirect, ARB_shader_storage_buffer_object, ARB_base_instance and
+    // ARB_program_interface_query.
+    static bool IsSupported();
+
+    /**
+     * @param maxDraws Draws per frame at most.
+     * @param drawDataSize Bytes of per-draw data, the std430 array stride in the shader.
+     * @return false when unsupported or when the streamed buffers can't be mapped.
+     */
+    bool Create(MeshPool & pool, size_t maxDraws, size_t drawDataSize);
+    void Destroy();
+
+    // Forgets the draws added since the last Draw(), keeping the memory.
+    void Clear();
+
+    /**
+     * Adds a draw of `range` with `drawDataSize` bytes of data. Returns false when the
+     * batch already holds `maxDraws` draws.
+     */
+    bool Add(const MeshRange & range, const void * data);
+
+    template <typename T>
+    bool Add(const MeshRange & range, const T & data) { return Add(range, static_cast<const void*>(&data)); }
+
+    /**
+     * Uploads the commands and their data, binds the data to `storageBinding` and issues
+     * every draw with one call. The program must already be in use.
+     */
+    void Draw(GLuint storageBinding);
+
+    void EndFrame();
+
+    size_t GetSize() const { return commands.size(); }
+
+private:
+    MeshPool * pool;
+    StreamBuffer commandStream;
+    StreamBuffer dataStream;
+    GLuint drawIndexBuffer;
+    size_t maxDraws;
+    size_t drawDataSize;
+    size_t storageAlignment;  // GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<unsigned char> drawData;
+};
+
+#endif
@@ -1,5 +1,9 @@
 #include "ObjLoader.h"
 #include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "Assets.h"
 
 bool loadOBJ(
     const char *path,
@@ -13,40 +17,52 @@ bool loadOBJ(
     std::vector<glm::vec2> temp_uvs;
     std::vector<glm::vec3> temp_normals;
 
-    FILE* file = fopen(path, "r");
-    if( file == NULL )
+    std::vector<unsigned char> file;
+    if (!readAsset(path, file))
     {
         std::cout << "Impossible to open the " << path <<  " file!" << std::endl;
         return false;
     }
+    file.push_back('\0');
 
-    while (true)
+    for (char * line = reinterpret_cast<char*>(&file[0]); *line; )
     {
+        char * next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        else
+            next = line + strlen(line);
+
         char lineHeader[128];
+        int consumed = 0;
         // Read the first word of the line.
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break;
+        if (sscanf(line, "%127s%n", lineHeader, &consumed) != 1)
+        {
+            line = next;
+            continue;
+        }
+        const char * rest = line + consumed;
+        line = next;
 
         // Vertex
         if (strcmp(lineHeader, "v") == 0 )
         {
             glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+            sscanf(rest, "%f %f %f", &vertex.x, &vertex.y, &vertex.z);
             temp_vertices.push_back(vertex);
         }
         // Vertex texture
         else if (strcmp(lineHeader, "vt") == 0)
         {
             glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
+            sscanf(rest, "%f %f", &uv.x, &uv.y);
             temp_uvs.push_back(uv);
         }
         // Vertex normal
         else if (strcmp(lineHeader, "vn") == 0)
         {
             glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
+            sscanf(rest, "%f %f %f", &normal.x, &normal.y, &normal.z);
             temp_normals.push_back(normal);
         }
         // Face
@@ -54,7 +70,7 @@ bool loadOBJ(
         {
             std::string vertex1, vertex2, vertex3;
             unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
+            int matches = sscanf(rest, "%d/%d/%d %d/%d/%d %d/%d/%d",
                                  &vertexIndex[0], &uvIndex[0], &normalIndex[0],
                                  &vertexIndex[1], &uvIndex[1], &normalIndex[1],
                                  &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
@@ -94,6 +110,5 @@ bool loadOBJ(
         out_normals .push_back(normal);
     }
 
-    fclose(file);
     return true;
 }
@@ -0,0 +1,9 @@
+#version 330 core
+
+// Color writes are masked: only the depth test of the box matters.
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	color = vec4(1);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+// Bounding box of the queried object, in world space.
+uniform vec3 BoxMin;
+uniform vec3 BoxMax;
+
+#include "UniformBlocks.glsl"
+
+void main()
+{
+	// The 14 vertices of a cube as one triangle strip, without vertex buffer: the masks
+	// hold the x, y and z of each corner in bit gl_VertexID.
+	int bit = 1 << gl_VertexID;
+	vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0);
+	gl_Position = Projection * View * vec4(mix(BoxMin, BoxMax, corner), 1);
+}
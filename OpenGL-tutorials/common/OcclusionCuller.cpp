@@ -0,0 +1,474 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+// Pixels per SIMD instruction in the rasterizer: AVX when the compiler targets it, SSE
+// on any x86-64, otherwise a scalar loop.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define RASTER_LANES 8
+typedef __m256 Lanes;
+static inline Lanes lanesSet(float value) { return _mm256_set1_ps(value); }
+static inline Lanes lanesLoad(const float * p) { return _mm256_loadu_ps(p); }
+static inline void lanesStore(float * p, Lanes a) { _mm256_storeu_ps(p, a); }
+static inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes lanesMul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+static inline Lanes lanesRamp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+// Lanes where a, b and c are all >= 0 take `inside`, the others `outside`.
+static inline Lanes lanesSelectInside(Lanes a, Lanes b, Lanes c, Lanes inside, Lanes outside)
+{
+    Lanes zero = _mm256_setzero_ps();
+    Lanes mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_GE_OQ), _mm256_cmp_ps(b, zero, _CMP_GE_OQ)),
+                               _mm256_cmp_ps(c, zero, _CMP_GE_OQ));
+    return _mm256_blendv_ps(outside, inside, mask);
+}
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_LANES 4
+typedef __m128 Lanes;
+static inline Lanes lanesSet(float value) { return _mm_set1_ps(value); }
+static inline Lanes lanesLoad(const float * p) { return _mm_loadu_ps(p); }
+static inline void lanesStore(float * p, Lanes a) { _mm_storeu_ps(p, a); }
+static inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes lanesMul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline Lanes lanesRamp() { return _mm_setr_ps(0, 1, 2, 3); }
+static inline Lanes lanesSelectInside(Lanes a, Lanes b, Lanes c, Lanes inside, Lanes outside)
+{
+    Lanes zero = _mm_setzero_ps();
+    Lanes mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(a, zero), _mm_cmpge_ps(b, zero)), _mm_cmpge_ps(c, zero));
+    return _mm_or_ps(_mm_and_ps(mask, inside), _mm_andnot_ps(mask, outside));
+}
+#else
+#define RASTER_LANES 1
+typedef float Lanes;
+static inline Lanes lanesSet(float value) { return value; }
+static inline Lanes lanesLoad(const float * p) { return *p; }
+static inline void lanesStore(float * p, Lanes a) { *p = a; }
+static inline Lanes lanesAdd(Lanes a, Lanes b) { return a + b; }
+static inline Lanes lanesMul(Lanes a, Lanes b) { return a * b; }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return std::min(a, b); }
+static inline Lanes lanesRamp() { return 0.0f; }
+static inline Lanes lanesSelectInside(Lanes a, Lanes b, Lanes c, Lanes inside, Lanes outside)
+{
+    return a >= 0.0f && b >= 0.0f && c >= 0.0f ? inside : outside;
+}
+#endif
+
+// Pyramid levels computed inside a tile: down to one texel per tile.
+static const int TILE_LEVELS = 5;
+static_assert((1 << TILE_LEVELS) == OCCLUSION_TILE_SIZE, "TILE_LEVELS must match OCCLUSION_TILE_SIZE");
+// Largest texel span of a tested rectangle, on each side.
+static const int TEST_TEXELS = 4;
+
+
+OcclusionCuller::OcclusionCuller()
+    : width(0),
+      height(0),
+      tilesX(0),
+      tilesY(0),
+      nextTile(0),
+      frame(0),
+      finishedWorkers(0),
+      running(false)
+{
+    stats = {0, 0, 0, 0, 0.0, 0.0};
+}
+
+
+OcclusionCuller::~OcclusionCuller()
+{
+    Destroy();
+}
+
+
+bool OcclusionCuller::Create(int width, int height, unsigned int threads)
+{
+    Destroy();
+    if (width <= 0 || height <= 0)
+        return false;
+
+    tilesX = (width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+    tilesY = (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+    this->width = tilesX * OCCLUSION_TILE_SIZE;
+    this->height = tilesY * OCCLUSION_TILE_SIZE;
+    tileTriangles.resize(tilesX * tilesY);
+
+    // Every level down to a single texel. Odd sizes round up: the last texel of a row
+    // then covers a single source texel, and no source texel is left out of the max.
+    int levelWidth = this->width, levelHeight = this->height;
+    while (true)
+    {
+        levelWidths.push_back(levelWidth);
+        levelHeights.push_back(levelHeight);
+        levels.push_back(std::vector<float>(levelWidth * levelHeight, 1.0f));
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    running = true;
+    for (unsigned int i = 1; i < threads; i++)
+        workers.push_back(std::thread(&OcclusionCuller::WorkerThread, this));
+    return true;
+}
+
+
+void OcclusionCuller::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    frameStarted.notify_all();
+    for (std::thread & worker : workers)
+        worker.join();
+    workers.clear();
+
+    width = height = tilesX = tilesY = 0;
+    triangles.clear();
+    tileTriangles.clear();
+    levels.clear();
+    levelWidths.clear();
+    levelHeights.clear();
+}
+
+
+void OcclusionCuller::SetOccluders(const std::vector<glm::vec3> & triangles)
+{
+    occluders = triangles;
+    stats.occluderTriangles = occluders.size() / 3;
+}
+
+
+void OcclusionCuller::AddTriangle(const glm::vec4 & a, const glm::vec4 & b, const glm::vec4 & c)
+{
+    // To pixels, with y up as in the viewport, and depth in [0, 1].
+    glm::vec3 screen[3];
+    const glm::vec4 * clip[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec4 & v = *clip[i];
+        screen[i] = glm::vec3((v.x / v.w * 0.5f + 0.5f) * width,
+                              (v.y / v.w * 0.5f + 0.5f) * height,
+                              v.z / v.w * 0.5f + 0.5f);
+    }
+
+    // Occluders hide what is behind them from both sides: no face is culled, and the
+    // vertices are put counter-clockwise.
+    float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y)
+               - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+    if (area == 0.0f || std::isnan(area))
+        return;
+    if (area < 0.0f)
+    {
+        std::swap(screen[1], screen[2]);
+        area = -area;
+    }
+
+    // Pixels whose center is inside, clamped to the buffer.
+    float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+    float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+    float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+    float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+    RasterTriangle triangle;
+    triangle.minX = static_cast<int>(std::max(0.0f, std::ceil(minX - 0.5f)));
+    triangle.minY = static_cast<int>(std::max(0.0f, std::ceil(minY - 0.5f)));
+    triangle.maxX = static_cast<int>(std::min(width - 1.0f, std::floor(maxX - 0.5f)));
+    triangle.maxY = static_cast<int>(std::min(height - 1.0f, std::floor(maxY - 0.5f)));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return;
+
+    // Edge i faces vertex i and is >= 0 inside. Each is evaluated at pixel centers.
+    float depthX = 0.0f, depthY = 0.0f, depthOffset = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec3 & from = screen[(i + 1) % 3];
+        const glm::vec3 & to = screen[(i + 2) % 3];
+        triangle.edgeX[i] = from.y - to.y;
+        triangle.edgeY[i] = to.x - from.x;
+        triangle.edgeOffset[i] = from.x * to.y - from.y * to.x
+                               + 0.5f * (triangle.edgeX[i] + triangle.edgeY[i]);
+
+        // The normalized edge function is the barycentric weight of vertex i.
+        depthX += triangle.edgeX[i] / area * screen[i].z;
+        depthY += triangle.edgeY[i] / area * screen[i].z;
+        depthOffset += triangle.edgeOffset[i] / area * screen[i].z;
+    }
+    triangle.depthX = depthX;
+    triangle.depthY = depthY;
+    triangle.depthOffset = depthOffset;
+
+    uint32_t index = static_cast<uint32_t>(triangles.size());
+    triangles.push_back(triangle);
+    for (int y = triangle.minY / OCCLUSION_TILE_SIZE; y <= triangle.maxY / OCCLUSION_TILE_SIZE; y++)
+    {
+        for (int x = triangle.minX / OCCLUSION_TILE_SIZE; x <= triangle.maxX / OCCLUSION_TILE_SIZE; x++)
+            tileTriangles[y * tilesX + x].push_back(index);
+    }
+}
+
+
+void OcclusionCuller::Render(const glm::mat4 & viewProjection)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    this->viewProjection = viewProjection;
+    triangles.clear();
+    for (std::vector<uint32_t> & list : tileTriangles)
+        list.clear();
+
+    for (size_t i = 0; i + 2 < occluders.size(); i += 3)
+    {
+        glm::vec4 clip[3];
+        int outsideMasks[3];
+        for (int v = 0; v < 3; v++)
+        {
+            const glm::vec4 & p = clip[v] = viewProjection * glm::vec4(occluders[i + v], 1.0f);
+            outsideMasks[v] = (p.x < -p.w) | (p.x > p.w) << 1 | (p.y < -p.w) << 2 | (p.y > p.w) << 3
+                            | (p.z < -p.w) << 4 | (p.z > p.w) << 5;
+        }
+        // Entirely outside of one plane.
+        if (outsideMasks[0] & outsideMasks[1] & outsideMasks[2])
+            continue;
+        if (!((outsideMasks[0] | outsideMasks[1] | outsideMasks[2]) & 16))
+        {
+            AddTriangle(clip[0], clip[1], clip[2]);
+            continue;
+        }
+
+        // Clip against the near plane, z >= -w: a quad or a smaller triangle is left.
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int v = 0; v < 3; v++)
+        {
+            const glm::vec4 & current = clip[v];
+            const glm::vec4 & next = clip[(v + 1) % 3];
+            float currentDistance = current.z + current.w;
+            float nextDistance = next.z + next.w;
+            if (currentDistance >= 0.0f)
+                polygon[count++] = current;
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+            {
+                float t = currentDistance / (currentDistance - nextDistance);
+                polygon[count++] = current + (next - current) * t;
+            }
+        }
+        for (int v = 2; v < count; v++)
+            AddTriangle(polygon[0], polygon[v - 1], polygon[v]);
+    }
+    stats.rasterizedTriangles = triangles.size();
+
+    // Hand the tiles to the workers and take some too.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nextTile = 0;
+        finishedWorkers = 0;
+        frame++;
+    }
+    frameStarted.notify_all();
+    RasterizeTiles();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        frameFinished.wait(lock, [this] { return finishedWorkers == workers.size(); });
+    }
+
+    // The levels above one texel per tile combine tiles.
+    for (size_t level = TILE_LEVELS + 1; level < levels.size(); level++)
+    {
+        const std::vector<float> & source = levels[level - 1];
+        int sourceWidth = levelWidths[level - 1], sourceHeight = levelHeights[level - 1];
+        std::vector<float> & target = levels[level];
+        for (int y = 0; y < levelHeights[level]; y++)
+        {
+            for (int x = 0; x < levelWidths[level]; x++)
+            {
+                int x0 = std::min(2 * x, sourceWidth - 1), x1 = std::min(2 * x + 1, sourceWidth - 1);
+                int y0 = std::min(2 * y, sourceHeight - 1), y1 = std::min(2 * y + 1, sourceHeight - 1);
+                target[y * levelWidths[level] + x] = std::max(
+                        std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+                        std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+            }
+        }
+    }
+    stats.renderMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void OcclusionCuller::RasterizeTiles()
+{
+    int tileCount = tilesX * tilesY;
+    for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+        RasterizeTile(tile);
+}
+
+
+void OcclusionCuller::RasterizeTile(int tile)
+{
+    int tileX = (tile % tilesX) * OCCLUSION_TILE_SIZE;
+    int tileY = (tile / tilesX) * OCCLUSION_TILE_SIZE;
+    std::vector<float> & depth = levels[0];
+
+    for (int y = tileY; y < tileY + OCCLUSION_TILE_SIZE; y++)
+        std::fill(depth.begin() + y * width + tileX, depth.begin() + y * width + tileX + OCCLUSION_TILE_SIZE, 1.0f);
+
+    Lanes ramp = lanesRamp();
+    Lanes cleared = lanesSet(1.0f);
+    for (uint32_t index : tileTriangles[tile])
+    {
+        const RasterTriangle & triangle = triangles[index];
+        // Whole lane groups of the tile, so rows stay aligned with the SIMD width.
+        int minX = std::max(triangle.minX, tileX) / RASTER_LANES * RASTER_LANES;
+        int maxX = std::min(triangle.maxX, tileX + OCCLUSION_TILE_SIZE - 1);
+        int minY = std::max(triangle.minY, tileY);
+        int maxY = std::min(triangle.maxY, tileY + OCCLUSION_TILE_SIZE - 1);
+
+        // Per lane offsets inside a group, and steps from one group to the next.
+        Lanes rampEdge[3], stepEdge[3];
+        for (int e = 0; e < 3; e++)
+        {
+            rampEdge[e] = lanesMul(ramp, lanesSet(triangle.edgeX[e]));
+            stepEdge[e] = lanesSet(triangle.edgeX[e] * RASTER_LANES);
+        }
+        Lanes rampDepth = lanesMul(ramp, lanesSet(triangle.depthX));
+        Lanes stepDepth = lanesSet(triangle.depthX * RASTER_LANES);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            // Values at the first pixels of the row, one per lane.
+            Lanes edge[3];
+            for (int e = 0; e < 3; e++)
+            {
+                float start = triangle.edgeX[e] * minX + triangle.edgeY[e] * y + triangle.edgeOffset[e];
+                edge[e] = lanesAdd(lanesSet(start), rampEdge[e]);
+            }
+            float depthStart = triangle.depthX * minX + triangle.depthY * y + triangle.depthOffset;
+            Lanes z = lanesAdd(lanesSet(depthStart), rampDepth);
+
+            float * row = &depth[y * width];
+            for (int x = minX; x <= maxX; x += RASTER_LANES)
+            {
+                Lanes covered = lanesSelectInside(edge[0], edge[1], edge[2], z, cleared);
+                lanesStore(row + x, lanesMin(lanesLoad(row + x), covered));
+                for (int e = 0; e < 3; e++)
+                    edge[e] = lanesAdd(edge[e], stepEdge[e]);
+                z = lanesAdd(z, stepDepth);
+            }
+        }
+    }
+
+    // The levels of the pyramid inside this tile.
+    for (int level = 1; level <= TILE_LEVELS; level++)
+    {
+        const std::vector<float> & source = levels[level - 1];
+        std::vector<float> & target = levels[level];
+        int sourceWidth = levelWidths[level - 1], targetWidth = levelWidths[level];
+        int size = OCCLUSION_TILE_SIZE >> level;
+        int originX = tileX >> level, originY = tileY >> level;
+        for (int y = originY; y < originY + size; y++)
+        {
+            for (int x = originX; x < originX + size; x++)
+            {
+                const float * top = &source[2 * y * sourceWidth + 2 * x];
+                const float * bottom = top + sourceWidth;
+                target[y * targetWidth + x] = std::max(std::max(top[0], top[1]), std::max(bottom[0], bottom[1]));
+            }
+        }
+    }
+}
+
+
+void OcclusionCuller::WorkerThread()
+{
+    unsigned int seenFrame = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameStarted.wait(lock, [&] { return !running || frame != seenFrame; });
+            if (!running)
+                return;
+            seenFrame = frame;
+        }
+        RasterizeTiles();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedWorkers++;
+        }
+        frameFinished.notify_one();
+    }
+}
+
+
+bool OcclusionCuller::IsVisible(const BoundingBox & box) const
+{
+    if (levels.empty())
+        return true;
+
+    // Screen rectangle and nearest depth of the corners.
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 p = viewProjection * glm::vec4(corner & 1 ? box.max.x : box.min.x,
+                                                 corner & 2 ? box.max.y : box.min.y,
+                                                 corner & 4 ? box.max.z : box.min.z, 1.0f);
+        // Across the near plane: no rectangle bounds it on the screen.
+        if (p.z < -p.w)
+            return true;
+        float x = (p.x / p.w * 0.5f + 0.5f) * width;
+        float y = (p.y / p.w * 0.5f + 0.5f) * height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, p.z / p.w * 0.5f + 0.5f);
+    }
+    if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+        return true;  // Off screen: for the frustum culler to decide
+
+    int x0 = static_cast<int>(std::max(0.0f, minX));
+    int y0 = static_cast<int>(std::max(0.0f, minY));
+    int x1 = static_cast<int>(std::min(width - 1.0f, maxX));
+    int y1 = static_cast<int>(std::min(height - 1.0f, maxY));
+
+    // The finest level where the rectangle is at most TEST_TEXELS texels a side.
+    size_t level = 0;
+    while (level + 1 < levels.size()
+           && ((x1 >> level) - (x0 >> level) >= TEST_TEXELS || (y1 >> level) - (y0 >> level) >= TEST_TEXELS))
+        level++;
+
+    const std::vector<float> & depth = levels[level];
+    int levelWidth = levelWidths[level];
+    int lastX = std::min(x1 >> static_cast<int>(level), levelWidth - 1);
+    int lastY = std::min(y1 >> static_cast<int>(level), levelHeights[level] - 1);
+    for (int y = std::min(y0 >> static_cast<int>(level), lastY); y <= lastY; y++)
+    {
+        for (int x = std::min(x0 >> static_cast<int>(level), lastX); x <= lastX; x++)
+        {
+            if (nearest <= depth[y * levelWidth + x])
+                return true;
+        }
+    }
+    return false;
+}
+
+
+size_t OcclusionCuller::Cull(const std::vector<BoundingBox> & boxes, uint32_t * objects, size_t count)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (IsVisible(boxes[objects[i]]))
+            objects[kept++] = objects[i];
+    }
+    stats.tested = count;
+    stats.occluded = count - kept;
+    stats.cullMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return kept;
+}
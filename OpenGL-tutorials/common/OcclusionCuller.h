@@ -0,0 +1,119 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+
+// Side of the square tiles the depth buffer is split into, in pixels.
+#define OCCLUSION_TILE_SIZE 32
+
+/**
+ * Counters of the last Render() and Cull() calls.
+ */
+struct OcclusionStats
+{
+    size_t occluderTriangles;    // Given to SetOccluders
+    size_t rasterizedTriangles;  // Left after clipping, near plane splits included
+    size_t tested;               // Boxes tested by Cull
+    size_t occluded;             // Boxes found hidden by Cull
+    double renderMilliseconds;   // Transform, rasterization and pyramid
+    double cullMilliseconds;
+};
+
+/**
+ * Occlusion culling on the CPU, without a GPU or a GL context.
+ *
+ * Render() draws low-poly occluder triangles into a small depth buffer (256x128 by
+ * default), which keeps the nearest depth of each pixel. Triangles are binned into
+ * OCCLUSION_TILE_SIZE pixel tiles, and worker threads take whole tiles. This way no
+ * two threads write to the same pixel. Each row of a tile evaluates its edge functions
+ * and depth plane 8 pixels per instruction with AVX, or 4 with SSE2.
+ *
+ * Each tile then reduces itself into the levels of a hierarchical depth pyramid. A
+ * texel of level n holds the farthest depth of its 2^n x 2^n pixels. A box is hidden
+ * when it is nearer than none of the texels its screen rectangle covers, at the level
+ * where that rectangle spans at most 4 texels a side.
+ *
+ * Boxes crossing the near plane are always visible. Occluders cover the pixels whose
+ * center they contain, so an object seen only through a gap narrower than a pixel of
+ * the buffer may be culled.
+ */
+class OcclusionCuller
+{
+public:
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    /**
+     * Allocates the depth pyramid and starts the worker threads. The size is rounded up
+     * to whole tiles.
+     * @param threads Threads rasterizing, the calling one included; 0 for one per
+     *                hardware thread.
+     */
+    bool Create(int width = 256, int height = 128, unsigned int threads = 0);
+    void Destroy();
+
+    // World space occluder triangles, three vertices each, kept until replaced.
+    void SetOccluders(const std::vector<glm::vec3> & triangles);
+
+    // Clears the depth buffer, draws the occluders as seen through viewProjection and
+    // builds the pyramid.
+    void Render(const glm::mat4 & viewProjection);
+
+    // Whether any part of the box may be seen past the occluders of the last Render().
+    bool IsVisible(const BoundingBox & box) const;
+
+    /**
+     * Removes the hidden objects from objects[0, count), keeping their order, and returns
+     * the number left. The boxes are indexed by object, as given to FrustumCuller::Add().
+     */
+    size_t Cull(const std::vector<BoundingBox> & boxes, uint32_t * objects, size_t count);
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    // Farthest depth, in [0, 1], of each texel of a pyramid level; level 0 is the buffer.
+    const std::vector<float> & GetDepth(int level = 0) const { return levels[level]; }
+    const OcclusionStats & GetStats() const { return stats; }
+
+private:
+    // A triangle ready to be rasterized: edge functions and depth plane in pixels.
+    struct RasterTriangle
+    {
+        float edgeX[3], edgeY[3], edgeOffset[3];
+        float depthX, depthY, depthOffset;
+        int minX, minY, maxX, maxY;
+    };
+
+    void AddTriangle(const glm::vec4 & a, const glm::vec4 & b, const glm::vec4 & c);
+    void RasterizeTiles();
+    void RasterizeTile(int tile);
+    void WorkerThread();
+
+    int width, height;
+    int tilesX, tilesY;
+    glm::mat4 viewProjection;
+    std::vector<glm::vec3> occluders;
+    std::vector<RasterTriangle> triangles;
+    std::vector<std::vector<uint32_t>> tileTriangles;
+    std::vector<std::vector<float>> levels;
+    std::vector<int> levelWidths, levelHeights;
+    OcclusionStats stats;
+
+    // Workers wait for a new frame, then take tiles until none is left.
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable frameStarted;
+    std::condition_variable frameFinished;
+    std::atomic<int> nextTile;
+    unsigned int frame;
+    unsigned int finishedWorkers;
+    bool running;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "OcclusionQueries.h"
+#include <iostream>
+
+#include "GLState.h"
+#include "Shader.h"
+
+// Frames a visible object is drawn without a query before it is checked again; the
+// object index spreads the checks over 4 more frames.
+static const unsigned int VISIBLE_RECHECK_FRAMES = 8;
+// Vertices of the box triangle strip generated by the box vertex shader.
+static const GLsizei BOX_STRIP_VERTICES = 14;
+
+
+OcclusionQueries::OcclusionQueries()
+    : boxMinUniform(-1),
+      boxMaxUniform(-1),
+      boxVertexArray(0),
+      queryTarget(GL_ANY_SAMPLES_PASSED),
+      frame(0),
+      stats()
+{
+}
+
+
+OcclusionQueries::~OcclusionQueries()
+{
+    Destroy();
+}
+
+
+bool OcclusionQueries::Create(const char * vertexShaderPath, const char * fragmentShaderPath)
+{
+    Destroy();
+    GLuint program = LoadShaders(vertexShaderPath, fragmentShaderPath);
+    if (!program)
+    {
+        std::cout << "OcclusionQueries: the box program could not be loaded." << std::endl;
+        return false;
+    }
+    boxProgram.Reflect(program);
+    boxMinUniform = boxProgram.GetUniform("BoxMin");
+    boxMaxUniform = boxProgram.GetUniform("BoxMax");
+
+    // The strip is generated from gl_VertexID, but core profiles draw nothing without a VAO.
+    glGenVertexArrays(1, &boxVertexArray);
+
+    // Conservative queries may count samples that are not covered, but are cheaper.
+    queryTarget = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+                                                                 : GL_ANY_SAMPLES_PASSED;
+    return true;
+}
+
+
+void OcclusionQueries::Destroy()
+{
+    for (GLuint query : queries)
+    {
+        if (query)
+            glDeleteQueries(1, &query);
+    }
+    queries.clear();
+    boxes.clear();
+    visibility.clear();
+    pending.clear();
+    lastRendered.clear();
+    recheckFrame.clear();
+    pendingObjects.clear();
+
+    if (boxProgram.GetID())
+    {
+        glDeleteProgram(boxProgram.GetID());
+        boxProgram = ShaderProgram();
+    }
+    if (boxVertexArray)
+    {
+        forgetVertexArray(boxVertexArray);
+        glDeleteVertexArrays(1, &boxVertexArray);
+        boxVertexArray = 0;
+    }
+}
+
+
+void OcclusionQueries::SetObjects(const std::vector<BoundingBox> & boxes)
+{
+    if (boxes.size() != this->boxes.size())
+    {
+        queries.resize(boxes.size(), 0);
+        visibility.assign(boxes.size(), UNKNOWN);
+        pending.assign(boxes.size(), 0);
+        lastRendered.assign(boxes.size(), 0);
+        recheckFrame.assign(boxes.size(), 0);
+        pendingObjects.clear();
+    }
+    this->boxes = boxes;
+}
+
+
+void OcclusionQueries::CollectResults()
+{
+    size_t kept = 0;
+    for (uint32_t object : pendingObjects)
+    {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(queries[object], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            pendingObjects[kept++] = object;
+            continue;
+        }
+
+        GLuint passed = GL_FALSE;
+        glGetQueryObjectuiv(queries[object], GL_QUERY_RESULT, &passed);
+        pending[object] = 0;
+        stats.resultsRead++;
+        if (passed)
+        {
+            if (visibility[object] != VISIBLE)
+                recheckFrame[object] = frame + VISIBLE_RECHECK_FRAMES + (object & 3);
+            visibility[object] = VISIBLE;
+        }
+        else
+            visibility[object] = HIDDEN;
+    }
+    pendingObjects.resize(kept);
+}
+
+
+void OcclusionQueries::BeginQuery(uint32_t object)
+{
+    if (!queries[object])
+        glGenQueries(1, &queries[object]);
+    glBeginQuery(queryTarget, queries[object]);
+    pending[object] = 1;
+    pendingObjects.push_back(object);
+    stats.queriesIssued++;
+}
+
+
+// Whether a corner of the box is behind the near plane, where its faces are clipped away.
+static bool crossesNearPlane(const BoundingBox & box, const glm::mat4 & viewProjection)
+{
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 position = viewProjection * glm::vec4(corner & 1 ? box.max.x : box.min.x,
+                                                        corner & 2 ? box.max.y : box.min.y,
+                                                        corner & 4 ? box.max.z : box.min.z, 1.f);
+        if (position.z < -position.w)
+            return true;
+    }
+    return false;
+}
+
+
+void OcclusionQueries::Render(const uint32_t * objects, size_t count, const glm::mat4 & viewProjection,
+                              const DrawObjectCallback & draw)
+{
+    stats = OcclusionQueryStats();
+    frame++;
+    CollectResults();
+
+    // Visible objects first: they hide more of what is queried after them.
+    boxQueries.clear();
+    conditional.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t object = objects[i];
+        // Out of the view last frame: what is known of it is from another viewpoint.
+        if (lastRendered[object] != frame - 1 && !pending[object])
+            visibility[object] = UNKNOWN;
+        lastRendered[object] = frame;
+
+        if (crossesNearPlane(boxes[object], viewProjection))
+        {
+            visibility[object] = VISIBLE;
+            recheckFrame[object] = frame + VISIBLE_RECHECK_FRAMES;
+            draw(object);
+        }
+        else if (visibility[object] == VISIBLE || pending[object])
+        {
+            // The draw itself tells whether the object is still visible.
+            bool recheck = !pending[object] && frame >= recheckFrame[object];
+            if (recheck)
+                BeginQuery(object);
+            if (visibility[object] == HIDDEN)
+                stats.drawsSkipped++;
+            else
+                draw(object);
+            if (recheck)
+                glEndQuery(queryTarget);
+        }
+        else
+        {
+            boxQueries.push_back(object);
+            if (visibility[object] == UNKNOWN)
+                conditional.push_back(object);
+            else
+                stats.drawsSkipped++;
+        }
+    }
+
+    if (!boxQueries.empty())
+    {
+        // Boxes only test depth: they must neither show nor hide anything.
+        boxProgram.Use();
+        bindVertexArray(boxVertexArray);
+        colorMask(GL_FALSE);
+        depthMask(GL_FALSE);
+        disableCapability(GL_CULL_FACE);
+        for (uint32_t object : boxQueries)
+        {
+            boxProgram.Set(boxMinUniform, boxes[object].min);
+            boxProgram.Set(boxMaxUniform, boxes[object].max);
+            BeginQuery(object);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, BOX_STRIP_VERTICES);
+            glEndQuery(queryTarget);
+        }
+        colorMask(GL_TRUE);
+        depthMask(GL_TRUE);
+    }
+
+    // Without waiting, the GPU draws them if their box query has not finished yet.
+    for (uint32_t object : conditional)
+    {
+        glBeginConditionalRender(queries[object], GL_QUERY_NO_WAIT);
+        draw(object);
+        glEndConditionalRender();
+        stats.conditionalDraws++;
+    }
+}
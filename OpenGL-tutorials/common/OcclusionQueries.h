@@ -0,0 +1,103 @@
+#ifndef OCCLUSIONQUERIES_H
+#define OCCLUSIONQUERIES_H
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "ShaderProgram.h"
+
+/**
+ * Counters of the last Render().
+ */
+struct OcclusionQueryStats
+{
+    size_t queriesIssued;     // Box queries and queries around visible draws
+    size_t resultsRead;       // Results that had arrived, from this frame or earlier ones
+    size_t drawsSkipped;      // Objects known to be hidden, not drawn
+    size_t conditionalDraws;  // Objects of unknown visibility, drawn if their box passes
+};
+
+// Draws one object with whatever program and state it needs.
+typedef std::function<void(uint32_t object)> DrawObjectCallback;
+
+/**
+ * Occlusion culling on the GPU with occlusion queries, for when the CPU depth buffer
+ * of OcclusionCuller is too coarse.
+ *
+ * Results are only read once the GPU made them available, usually a frame later, so
+ * the CPU never waits. Visibility is coherent from a frame to the next:
+ *  - Visible objects are drawn without a query, and rechecked every few frames by a
+ *    query around their own draw.
+ *  - Hidden objects are skipped, and their bounding box is queried again (depth test
+ *    only, no color or depth writes) until it is seen.
+ *  - Objects with no history, having just entered the view, are the hard cases: their
+ *    box is queried and they are drawn with glBeginConditionalRender, so the GPU skips
+ *    the draw if the box was hidden without the CPU waiting for the answer.
+ * A hidden object thus appears a frame after it becomes visible.
+ *
+ * Uses GL_ANY_SAMPLES_PASSED_CONSERVATIVE where available (GL 4.3), otherwise
+ * GL_ANY_SAMPLES_PASSED.
+ */
+class OcclusionQueries
+{
+public:
+    OcclusionQueries();
+    ~OcclusionQueries();
+
+    // The box program reads FrameUniforms, and BoxMin and BoxMax in world space.
+    bool Create(const char * vertexShaderPath, const char * fragmentShaderPath);
+    void Destroy();
+
+    /**
+     * Sets the bounding box of every object, indexed as given to Render(). Objects keep
+     * their visibility when the number of objects is unchanged.
+     */
+    void SetObjects(const std::vector<BoundingBox> & boxes);
+
+    /**
+     * Draws the visible ones among objects[0, count), usually the output of a frustum
+     * cull, after the occluders: queries test against the depth buffer drawn so far.
+     * Boxes are drawn without face culling, and `draw` must state the program and the
+     * state it needs. Leaves the color and depth masks enabled.
+     * @param viewProjection The matrix of FrameUniforms, to find boxes crossing the
+     *                       near plane: those are always drawn.
+     */
+    void Render(const uint32_t * objects, size_t count, const glm::mat4 & viewProjection,
+                const DrawObjectCallback & draw);
+
+    const OcclusionQueryStats & GetStats() const { return stats; }
+
+private:
+    enum Visibility : uint8_t
+    {
+        UNKNOWN,
+        VISIBLE,
+        HIDDEN,
+    };
+
+    // Reads the results that arrived, without waiting for the others.
+    void CollectResults();
+    void BeginQuery(uint32_t object);
+
+    ShaderProgram boxProgram;
+    int boxMinUniform, boxMaxUniform;
+    GLuint boxVertexArray;
+    GLenum queryTarget;
+
+    std::vector<BoundingBox> boxes;
+    std::vector<GLuint> queries;              // 0 until the object is first queried
+    std::vector<uint8_t> visibility;          // Visibility of each object
+    std::vector<uint8_t> pending;             // Whether a result is on its way
+    std::vector<unsigned int> lastRendered;   // Frame the object was last in the list
+    std::vector<unsigned int> recheckFrame;   // Frame from which a visible object is queried again
+    std::vector<uint32_t> pendingObjects;
+    std::vector<uint32_t> boxQueries;         // Objects whose box is queried this frame
+    std::vector<uint32_t> conditional;        // Objects drawn on the result of their box
+    unsigned int frame;
+    OcclusionQueryStats stats;
+};
+
+#endif
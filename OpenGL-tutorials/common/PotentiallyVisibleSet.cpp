@@ -0,0 +1,374 @@
+#include "PotentiallyVisibleSet.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "Assets.h"
+
+static const char PVS_MAGIC[4] = {'P', 'V', 'S', '2'};
+// Cells per axis accepted by Load(), far above what a level needs.
+static const int32_t PVS_MAX_CELLS = 4096;
+
+
+// Runs of 0x00 and 0xff bytes become the byte and the run length, up to 255; other
+// bytes are copied. Most objects are either seen or hidden together with their
+// neighbours, so the runs are long.
+static std::vector<uint8_t> compressBits(const std::vector<uint8_t> & bits)
+{
+    std::vector<uint8_t> compressed;
+    for (size_t i = 0; i < bits.size(); )
+    {
+        uint8_t byte = bits[i];
+        compressed.push_back(byte);
+        if (byte != 0x00 && byte != 0xff)
+        {
+            i++;
+            continue;
+        }
+        size_t run = 1;
+        while (run < 255 && i + run < bits.size() && bits[i + run] == byte)
+            run++;
+        compressed.push_back(static_cast<uint8_t>(run));
+        i += run;
+    }
+    return compressed;
+}
+
+
+static void expandBits(const std::vector<uint8_t> & compressed, std::vector<uint8_t> & bits)
+{
+    size_t size = bits.size();
+    bits.clear();
+    for (size_t i = 0; i < compressed.size() && bits.size() < size; i++)
+    {
+        uint8_t byte = compressed[i];
+        if ((byte == 0x00 || byte == 0xff) && i + 1 < compressed.size())
+            bits.insert(bits.end(), static_cast<size_t>(compressed[++i]), byte);
+        else
+            bits.push_back(byte);
+    }
+    // A corrupted bitset shows everything rather than hiding what it lost.
+    bits.resize(size, 0xff);
+}
+
+
+// Whether `compressed` expands to exactly `size` bytes, as written by compressBits.
+static bool checkBits(const std::vector<uint8_t> & compressed, size_t size)
+{
+    size_t expanded = 0;
+    for (size_t i = 0; i < compressed.size(); i++)
+    {
+        uint8_t byte = compressed[i];
+        if (byte == 0x00 || byte == 0xff)
+        {
+            if (i + 1 == compressed.size() || compressed[i + 1] == 0)
+                return false;
+            expanded += compressed[++i];
+        }
+        else
+        {
+            expanded++;
+        }
+    }
+    return expanded == size;
+}
+
+
+// FNV-1a over the bytes of `data`.
+static uint64_t hashBytes(uint64_t hash, const void * data, size_t bytes)
+{
+    const uint8_t * byte = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < bytes; i++)
+        hash = (hash ^ byte[i]) * 1099511628211ull;
+    return hash;
+}
+
+
+static bool boxesOverlap(const BoundingBox & a, const BoundingBox & b)
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y
+        && a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+
+PotentiallyVisibleSet::PotentiallyVisibleSet()
+    : origin(0.f),
+      cellSize(1.f),
+      cellsX(0),
+      cellsY(0),
+      cellsZ(0),
+      objectCount(0),
+      sceneHash(0),
+      currentCell(-1),
+      bakeStats()
+{
+}
+
+
+void PotentiallyVisibleSet::Bake(const BoundingBox & bounds, float cellSize, const std::vector<BoundingBox> & objects,
+                                 const BoundingVolumeHierarchy & occluders, const RayObjectTest & occluderTest,
+                                 unsigned int samples, unsigned int threads)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Clear();
+    glm::vec3 size = bounds.max - bounds.min;
+    origin = bounds.min;
+    this->cellSize = cellSize;
+    cellsX = std::max(1, static_cast<int>(std::ceil(size.x / cellSize)));
+    cellsY = std::max(1, static_cast<int>(std::ceil(size.y / cellSize)));
+    cellsZ = std::max(1, static_cast<int>(std::ceil(size.z / cellSize)));
+    objectCount = static_cast<uint32_t>(objects.size());
+    sceneHash = HashScene(bounds, cellSize, objects);
+    int cellCount = cellsX * cellsY * cellsZ;
+    cells.resize(cellCount);
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    samples = std::max(1u, samples);
+
+    // Cells behind many occluders take more rays: threads take them one at a time.
+    std::atomic<int> nextCell(0);
+    std::vector<size_t> cellRays(cellCount, 0), cellPairs(cellCount, 0);
+    auto bakeCells = [&]()
+    {
+        std::vector<uint8_t> bits((objects.size() + 7) / 8);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        for (int cell = nextCell++; cell < cellCount; cell = nextCell++)
+        {
+            // Seeded by cell, so the result does not depend on the threads.
+            std::mt19937 random(static_cast<uint32_t>(cell) + 1);
+            BoundingBox cellBox;
+            cellBox.min = origin + glm::vec3(static_cast<float>(cell % cellsX),
+                                             static_cast<float>(cell / cellsX % cellsY),
+                                             static_cast<float>(cell / cellsX / cellsY)) * cellSize;
+            cellBox.max = cellBox.min + glm::vec3(cellSize);
+
+            std::fill(bits.begin(), bits.end(), 0);
+            for (uint32_t object = 0; object < objects.size(); object++)
+            {
+                bool visible = boxesOverlap(cellBox, objects[object]);
+                glm::vec3 objectSize = objects[object].max - objects[object].min;
+                for (unsigned int sample = 0; sample < samples && !visible; sample++)
+                {
+                    Ray ray;
+                    ray.origin = cellBox.min + glm::vec3(unit(random), unit(random), unit(random)) * cellSize;
+                    glm::vec3 target = objects[object].min
+                                     + glm::vec3(unit(random), unit(random), unit(random)) * objectSize;
+                    ray.direction = target - ray.origin;
+                    ray.maxDistance = 1.f;
+                    RayHit hit;
+                    visible = !occluders.Raycast(ray, hit, occluderTest);
+                    cellRays[cell]++;
+                }
+                if (visible)
+                {
+                    bits[object / 8] |= static_cast<uint8_t>(1 << (object % 8));
+                    cellPairs[cell]++;
+                }
+            }
+            cells[cell] = compressBits(bits);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; t++)
+        workers.push_back(std::thread(bakeCells));
+    bakeCells();
+    for (std::thread & worker : workers)
+        worker.join();
+
+    bakeStats.cells = cells.size();
+    bakeStats.objects = objects.size();
+    for (int cell = 0; cell < cellCount; cell++)
+    {
+        bakeStats.raysCast += cellRays[cell];
+        bakeStats.visiblePairs += cellPairs[cell];
+        bakeStats.compressedBytes += cells[cell].size();
+    }
+    bakeStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void PotentiallyVisibleSet::Clear()
+{
+    cells.clear();
+    cellsX = cellsY = cellsZ = 0;
+    objectCount = 0;
+    sceneHash = 0;
+    currentCell = -1;
+    currentBits.clear();
+    bakeStats = PvsBakeStats();
+}
+
+
+uint64_t PotentiallyVisibleSet::HashScene(const BoundingBox & bounds, float cellSize,
+                                          const std::vector<BoundingBox> & objects)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashBytes(hash, &bounds.min.x, 3 * sizeof(float));
+    hash = hashBytes(hash, &bounds.max.x, 3 * sizeof(float));
+    hash = hashBytes(hash, &cellSize, sizeof(float));
+    for (const BoundingBox & object : objects)
+    {
+        hash = hashBytes(hash, &object.min.x, 3 * sizeof(float));
+        hash = hashBytes(hash, &object.max.x, 3 * sizeof(float));
+    }
+    return hash;
+}
+
+
+// Binary file: magic, origin, cell size, cell counts, object count, scene hash, then
+// the size and the compressed bytes of each cell.
+bool PotentiallyVisibleSet::Save(const std::string & path) const
+{
+    FILE * file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cout << "Impossible to write the " << path << " visibility set!" << std::endl;
+        return false;
+    }
+
+    int32_t counts[3] = {cellsX, cellsY, cellsZ};
+    bool ok = fwrite(PVS_MAGIC, sizeof(PVS_MAGIC), 1, file) == 1
+           && fwrite(&origin.x, sizeof(float), 3, file) == 3
+           && fwrite(&cellSize, sizeof(float), 1, file) == 1
+           && fwrite(counts, sizeof(int32_t), 3, file) == 3
+           && fwrite(&objectCount, sizeof(uint32_t), 1, file) == 1
+           && fwrite(&sceneHash, sizeof(uint64_t), 1, file) == 1;
+    for (size_t cell = 0; ok && cell < cells.size(); cell++)
+    {
+        uint32_t size = static_cast<uint32_t>(cells[cell].size());
+        ok = fwrite(&size, sizeof(uint32_t), 1, file) == 1
+          && (size == 0 || fwrite(cells[cell].data(), 1, size, file) == size);
+    }
+    return fclose(file) == 0 && ok;
+}
+
+
+bool PotentiallyVisibleSet::Load(const std::string & path)
+{
+    Clear();
+    std::vector<unsigned char> file;
+    if (!readAsset(path, file))
+    {
+        std::cout << "Impossible to open the " << path << " visibility set!" << std::endl;
+        return false;
+    }
+
+    size_t offset = 0;
+    auto read = [&](void * data, size_t bytes)
+    {
+        if (offset + bytes > file.size())
+            return false;
+        memcpy(data, file.data() + offset, bytes);
+        offset += bytes;
+        return true;
+    };
+
+    char magic[4];
+    int32_t counts[3];
+    if (!read(magic, sizeof(magic)) || memcmp(magic, PVS_MAGIC, sizeof(magic)) != 0
+        || !read(&origin.x, 3 * sizeof(float)) || !read(&cellSize, sizeof(float))
+        || !read(counts, sizeof(counts)) || !read(&objectCount, sizeof(uint32_t))
+        || !read(&sceneHash, sizeof(uint64_t)))
+    {
+        std::cout << path << " is not a visibility set." << std::endl;
+        Clear();
+        return false;
+    }
+
+    // Each cell takes at least its 4 byte size: more cells than that cannot be in the file.
+    bool grid = std::isfinite(origin.x) && std::isfinite(origin.y) && std::isfinite(origin.z)
+             && std::isfinite(cellSize) && cellSize > 0.f;
+    for (int axis = 0; axis < 3; axis++)
+        grid = grid && counts[axis] > 0 && counts[axis] <= PVS_MAX_CELLS;
+    size_t cellCount = grid ? static_cast<size_t>(counts[0]) * counts[1] * counts[2] : 0;
+    if (!grid || cellCount > (file.size() - offset) / sizeof(uint32_t))
+    {
+        std::cout << path << " has an invalid cell grid." << std::endl;
+        Clear();
+        return false;
+    }
+
+    cells.resize(cellCount);
+    size_t bitsetBytes = (static_cast<size_t>(objectCount) + 7) / 8;
+    for (std::vector<uint8_t> & cell : cells)
+    {
+        uint32_t size;
+        if (!read(&size, sizeof(uint32_t)) || offset + size > file.size())
+        {
+            std::cout << path << " is truncated." << std::endl;
+            Clear();
+            return false;
+        }
+        cell.assign(file.begin() + offset, file.begin() + offset + size);
+        offset += size;
+        if (!checkBits(cell, bitsetBytes))
+        {
+            std::cout << path << " has a cell that does not hold " << objectCount << " objects." << std::endl;
+            Clear();
+            return false;
+        }
+    }
+    if (offset != file.size())
+    {
+        std::cout << path << " has " << file.size() - offset << " bytes past its last cell." << std::endl;
+        Clear();
+        return false;
+    }
+    cellsX = counts[0];
+    cellsY = counts[1];
+    cellsZ = counts[2];
+    return true;
+}
+
+
+int PotentiallyVisibleSet::GetCell(const glm::vec3 & position) const
+{
+    glm::vec3 cell = (position - origin) / cellSize;
+    if (cell.x < 0.f || cell.y < 0.f || cell.z < 0.f || cell.x >= cellsX || cell.y >= cellsY || cell.z >= cellsZ)
+        return -1;
+    return static_cast<int>(cell.x) + cellsX * (static_cast<int>(cell.y) + cellsY * static_cast<int>(cell.z));
+}
+
+
+void PotentiallyVisibleSet::SelectCell(int cell)
+{
+    if (cell == currentCell)
+        return;
+    currentBits.resize((objectCount + 7) / 8);
+    expandBits(cells[cell], currentBits);
+    currentCell = cell;
+}
+
+
+size_t PotentiallyVisibleSet::Cull(int cell, uint32_t * objects, size_t count)
+{
+    if (cell < 0 || cell >= static_cast<int>(cells.size()))
+        return count;
+    SelectCell(cell);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t object = objects[i];
+        if (object >= objectCount || (currentBits[object / 8] >> (object % 8)) & 1)
+            objects[kept++] = object;
+    }
+    return kept;
+}
+
+
+bool PotentiallyVisibleSet::IsVisible(int cell, uint32_t object)
+{
+    if (cell < 0 || cell >= static_cast<int>(cells.size()) || object >= objectCount)
+        return true;
+    SelectCell(cell);
+    return (currentBits[object / 8] >> (object % 8)) & 1;
+}
@@ -0,0 +1,97 @@
+#ifndef POTENTIALLYVISIBLESET_H
+#define POTENTIALLYVISIBLESET_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BoundingVolumeHierarchy.h"
+
+/**
+ * Counters of the last Bake().
+ */
+struct PvsBakeStats
+{
+    size_t cells;
+    size_t objects;
+    size_t raysCast;
+    size_t visiblePairs;     // (cell, object) pairs found visible
+    size_t compressedBytes;  // Bitsets of all the cells, as saved
+    double seconds;
+};
+
+/**
+ * Precomputed visibility of static objects from the cells of a regular grid, for
+ * levels whose occluders never move.
+ *
+ * Bake() runs offline: for each cell and object, rays go from random points of the
+ * cell to random points of the object's box, and the object is visible from the cell
+ * as soon as one of them reaches it past the occluders. Cells are shared by threads.
+ * Sampling can miss an object seen only through a narrow gap, so more samples make a
+ * more conservative set.
+ *
+ * Each cell keeps a bitset with one bit per object, compressed: runs of all-zero or
+ * all-one bytes are stored as the byte and the length of the run. At run time, the
+ * bitset of the camera's cell is expanded when the camera enters it. Then testing an
+ * object is a bit lookup.
+ */
+class PotentiallyVisibleSet
+{
+public:
+    PotentiallyVisibleSet();
+
+    /**
+     * @param bounds Where the camera can be; split into cells of `cellSize` a side.
+     * @param objects Boxes of the objects, indexed by position.
+     * @param occluders Hierarchy over the occluders, tested exactly with `occluderTest`.
+     * @param samples Rays per cell and object at most.
+     * @param threads Threads baking, 0 for one per hardware thread.
+     */
+    void Bake(const BoundingBox & bounds, float cellSize, const std::vector<BoundingBox> & objects,
+              const BoundingVolumeHierarchy & occluders, const RayObjectTest & occluderTest,
+              unsigned int samples = 16, unsigned int threads = 0);
+    void Clear();
+
+    bool Save(const std::string & path) const;
+    // Rejects files whose grid or cells do not add up; check GetSceneHash() against
+    // HashScene() of the current scene before trusting the result.
+    bool Load(const std::string & path);
+
+    /**
+     * Identifies what Bake() was given: the grid bounds, the cell size and the object boxes.
+     * A set loaded with another hash was baked for another scene.
+     */
+    static uint64_t HashScene(const BoundingBox & bounds, float cellSize, const std::vector<BoundingBox> & objects);
+    uint64_t GetSceneHash() const { return sceneHash; }
+
+    // Cell containing `position`, or -1 outside of the grid.
+    int GetCell(const glm::vec3 & position) const;
+
+    /**
+     * Removes the objects not visible from `cell` from objects[0, count), keeping their
+     * order, and returns the number left. Outside of the grid (cell -1), keeps them all.
+     */
+    size_t Cull(int cell, uint32_t * objects, size_t count);
+
+    bool IsVisible(int cell, uint32_t object);
+
+    bool IsEmpty() const { return cells.empty(); }
+    size_t GetObjectCount() const { return objectCount; }
+    const PvsBakeStats & GetBakeStats() const { return bakeStats; }
+
+private:
+    // Expands the bitset of `cell`, unless it is the current one.
+    void SelectCell(int cell);
+
+    glm::vec3 origin;
+    float cellSize;
+    int cellsX, cellsY, cellsZ;
+    uint32_t objectCount;
+    uint64_t sceneHash;
+    std::vector<std::vector<uint8_t>> cells;  // Compressed bitset of each cell
+    int currentCell;
+    std::vector<uint8_t> currentBits;
+    PvsBakeStats bakeStats;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "RenderQueue.h"
+#include <chrono>
+#include <utility>
+
+#include "GLState.h"
+
+static const unsigned int PROGRAM_BITS = 10;
+static const unsigned int TEXTURE_BITS = 12;
+static const unsigned int VERTEX_ARRAY_BITS = 12;
+static const unsigned int DEPTH_BITS = 28;
+static const unsigned int STATE_BITS = PROGRAM_BITS + TEXTURE_BITS + VERTEX_ARRAY_BITS;
+
+
+static uint64_t field(uint64_t value, unsigned int bits)
+{
+    return value & ((uint64_t(1) << bits) - 1);
+}
+
+
+uint64_t makeSortKey(RENDER_PASS pass, GLuint program, GLuint texture, GLuint vertex_array, float depth)
+{
+    if (!(depth > 0.0f))  // NaN included
+        depth = 0.0f;
+    if (depth > 1.0f)
+        depth = 1.0f;
+    uint64_t quantized = static_cast<uint64_t>(depth * float((1u << DEPTH_BITS) - 1));
+
+    uint64_t state = field(program, PROGRAM_BITS) << (TEXTURE_BITS + VERTEX_ARRAY_BITS)
+                   | field(texture, TEXTURE_BITS) << VERTEX_ARRAY_BITS
+                   | field(vertex_array, VERTEX_ARRAY_BITS);
+    uint64_t key = static_cast<uint64_t>(pass) << (STATE_BITS + DEPTH_BITS);
+
+    if (pass == RENDER_PASS_TRANSPARENT)
+        return key | field(~quantized, DEPTH_BITS) << STATE_BITS | state;
+    return key | state << DEPTH_BITS | quantized;
+}
+
+
+void RenderQueue::Clear()
+{
+    packets.clear();
+    order.clear();
+}
+
+
+void RenderQueue::Submit(const DrawPacket & packet)
+{
+    packets.push_back(packet);
+}
+
+
+void RenderQueue::Sort()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t count = packets.size();
+    order.resize(count);
+    scratch.resize(count);
+
+    // What the same draws would cost in the order they were submitted.
+    stats.unsortedChanges = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        order[i].key = packets[i].key;
+        order[i].packet = static_cast<uint32_t>(i);
+        if (i == 0)
+            continue;
+        const DrawPacket & previous = packets[i - 1];
+        stats.unsortedChanges += (packets[i].program != previous.program)
+                               + (packets[i].texture != previous.texture)
+                               + (packets[i].mesh->GetVertexArray() != previous.mesh->GetVertexArray());
+    }
+
+    if (count > 1)
+    {
+        size_t histograms[8][256] = {};
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t key = order[i].key;
+            for (unsigned int byte = 0; byte < 8; byte++)
+                histograms[byte][(key >> (byte * 8)) & 0xff]++;
+        }
+
+        SortEntry * from = &order[0];
+        SortEntry * to = &scratch[0];
+        for (unsigned int byte = 0; byte < 8; byte++)
+        {
+            size_t * histogram = histograms[byte];
+            unsigned int shift = byte * 8;
+            if (histogram[(from[0].key >> shift) & 0xff] == count)
+                continue;  // Every key has the same byte: this pass would not move anything
+
+            size_t offset = 0;
+            for (unsigned int bucket = 0; bucket < 256; bucket++)
+            {
+                size_t size = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += size;
+            }
+            for (size_t i = 0; i < count; i++)
+                to[histogram[(from[i].key >> shift) & 0xff]++] = from[i];
+            std::swap(from, to);
+        }
+        if (from != &order[0])
+            order.swap(scratch);
+    }
+
+    stats.packets = static_cast<unsigned int>(count);
+    stats.sortMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void applyPassState(RENDER_PASS pass)
+{
+    if (pass == RENDER_PASS_TRANSPARENT)
+    {
+        enableCapability(GL_BLEND);
+        blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        depthMask(GL_FALSE);
+    }
+    else
+    {
+        disableCapability(GL_BLEND);
+        depthMask(GL_TRUE);
+    }
+}
+
+
+void RenderQueue::Execute(const DrawPacketCallback & setObject)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    stats.passChanges = 0;
+    stats.programChanges = 0;
+    stats.textureChanges = 0;
+    stats.vertexArrayChanges = 0;
+
+    const DrawPacket * previous = nullptr;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const DrawPacket & packet = packets[order[i].packet];
+        GLuint vertexArray = packet.mesh->GetVertexArray();
+
+        if (!previous || packet.pass != previous->pass)
+        {
+            applyPassState(packet.pass);
+            stats.passChanges++;
+        }
+        if (!previous || packet.program != previous->program)
+        {
+            useProgram(packet.program);
+            stats.programChanges++;
+        }
+        if (!previous || packet.texture != previous->texture)
+        {
+            bindTexture(0, GL_TEXTURE_2D, packet.texture);
+            stats.textureChanges++;
+        }
+        if (!previous || vertexArray != previous->mesh->GetVertexArray())
+            stats.vertexArrayChanges++;  // Bound by Draw()
+
+        setObject(packet);
+        packet.mesh->Draw();
+        previous = &packet;
+    }
+
+    if (previous && previous->pass != RENDER_PASS_OPAQUE)
+        applyPassState(RENDER_PASS_OPAQUE);
+
+    stats.submitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,103 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <GL/glew.h>
+
+#include "Mesh.h"
+
+enum RENDER_PASS
+{
+    RENDER_PASS_OPAQUE = 0,       // Depth write on, no blending, near to far
+    RENDER_PASS_TRANSPARENT = 1,  // Depth write off, alpha blending, far to near
+};
+
+/**
+ * Builds the 64-bit key a draw is sorted by. From the most significant bit:
+ *   opaque:      pass 2 | program 10 | texture 12 | vertex array 12 | depth 28
+ *   transparent: pass 2 | depth 28 (inverted) | program 10 | texture 12 | vertex array 12
+ * Opaque draws are grouped by state, then drawn front to back inside a group; transparent
+ * draws are only ordered back to front. GL names wider than their field are truncated,
+ * which can split a group but never changes what is drawn.
+ *
+ * @param depth Distance to the camera divided by the far plane, clamped to [0, 1].
+ */
+uint64_t makeSortKey(RENDER_PASS pass, GLuint program, GLuint texture, GLuint vertex_array, float depth);
+
+/**
+ * One draw: the state it needs and the index of its per-object data, kept by the caller.
+ */
+struct DrawPacket
+{
+    uint64_t key;
+    RENDER_PASS pass;
+    GLuint program;
+    GLuint texture;       // Bound to GL_TEXTURE_2D on unit 0
+    const Mesh * mesh;
+    unsigned int object;
+};
+
+/**
+ * Counters of the last Sort() and Execute().
+ */
+struct RenderQueueStats
+{
+    unsigned int packets;
+    unsigned int passChanges;
+    unsigned int programChanges;
+    unsigned int textureChanges;
+    unsigned int vertexArrayChanges;
+    unsigned int unsortedChanges;  // Program, texture and vertex array changes in submission order
+    double sortMilliseconds;
+    double submitMilliseconds;     // Execute(), per-object callbacks and draw calls included
+};
+
+// Called before each draw, with its program bound, to set the per-object data.
+typedef std::function<void(const DrawPacket & packet)> DrawPacketCallback;
+
+
+/**
+ * Draws collected during a frame and issued in key order.
+ *
+ * Systems Submit() their draws in any order. Sort() radix sorts the keys, and Execute()
+ * walks them, changing the pass state, program, texture and vertex array only when they
+ * differ from the previous draw. All state goes through the GL state cache.
+ */
+class RenderQueue
+{
+public:
+    // Forgets the packets of the previous frame, keeping the memory.
+    void Clear();
+
+    void Submit(const DrawPacket & packet);
+
+    /**
+     * LSD radix sort of the keys, 8 bits per pass. The eight histograms are built in a
+     * single read, and passes whose byte is the same in every key are skipped.
+     */
+    void Sort();
+
+    /**
+     * Issues the draws in the order of the last Sort() and leaves the opaque pass state
+     * (depth write on, no blending).
+     */
+    void Execute(const DrawPacketCallback & setObject);
+
+    size_t GetSize() const { return packets.size(); }
+    const RenderQueueStats & GetStats() const { return stats; }
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+    RenderQueueStats stats = {};
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "SamplerCache.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+
+typedef std::tuple<GLenum, GLenum, GLenum, GLenum, GLenum, GLenum, float> SamplerKey;
+
+std::map<SamplerKey, GLuint> Samplers;
+std::vector<GLuint> BoundSamplers;  // Per texture unit
+unsigned int SamplerBinds = 0;
+unsigned int SkippedSamplerBinds = 0;
+
+
+static SamplerKey samplerKey(const SamplerDesc & desc)
+{
+    return std::make_tuple(desc.minFilter, desc.magFilter, desc.wrapS, desc.wrapT,
+                           desc.compareMode, desc.compareFunc, desc.maxAnisotropy);
+}
+
+
+SamplerDesc nearestSampler(GLenum wrap)
+{
+    SamplerDesc desc;
+    desc.minFilter = GL_NEAREST;
+    desc.magFilter = GL_NEAREST;
+    desc.wrapS = wrap;
+    desc.wrapT = wrap;
+    return desc;
+}
+
+
+SamplerDesc linearSampler(GLenum wrap)
+{
+    SamplerDesc desc;
+    desc.minFilter = GL_LINEAR;
+    desc.wrapS = wrap;
+    desc.wrapT = wrap;
+    return desc;
+}
+
+
+SamplerDesc trilinearSampler(float maxAnisotropy, GLenum wrap)
+{
+    SamplerDesc desc;
+    desc.wrapS = wrap;
+    desc.wrapT = wrap;
+    desc.maxAnisotropy = maxAnisotropy;
+    return desc;
+}
+
+
+SamplerDesc shadowSampler()
+{
+    SamplerDesc desc = linearSampler(GL_CLAMP_TO_EDGE);
+    desc.compareMode = GL_COMPARE_REF_TO_TEXTURE;
+    desc.compareFunc = GL_LEQUAL;
+    return desc;
+}
+
+
+GLuint getSampler(const SamplerDesc & desc)
+{
+    SamplerKey key = samplerKey(desc);
+    std::map<SamplerKey, GLuint>::const_iterator it = Samplers.find(key);
+    if (it != Samplers.end())
+        return it->second;
+
+    GLuint samplerID;
+    glGenSamplers(1, &samplerID);
+    glSamplerParameteri(samplerID, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+    glSamplerParameteri(samplerID, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+    glSamplerParameteri(samplerID, GL_TEXTURE_WRAP_S, desc.wrapS);
+    glSamplerParameteri(samplerID, GL_TEXTURE_WRAP_T, desc.wrapT);
+    glSamplerParameteri(samplerID, GL_TEXTURE_COMPARE_MODE, desc.compareMode);
+    glSamplerParameteri(samplerID, GL_TEXTURE_COMPARE_FUNC, desc.compareFunc);
+    if (desc.maxAnisotropy > 1.0f && GLEW_EXT_texture_filter_anisotropic)
+    {
+        GLfloat maxSupported;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxSupported);
+        glSamplerParameterf(samplerID, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(desc.maxAnisotropy, maxSupported));
+    }
+
+    Samplers[key] = samplerID;
+    return samplerID;
+}
+
+
+void bindSampler(GLuint unit, GLuint sampler_id)
+{
+    if (unit >= BoundSamplers.size())
+        BoundSamplers.resize(unit + 1, 0);
+
+    if (BoundSamplers[unit] == sampler_id)
+    {
+        SkippedSamplerBinds++;
+        return;
+    }
+    glBindSampler(unit, sampler_id);
+    BoundSamplers[unit] = sampler_id;
+    SamplerBinds++;
+}
+
+
+void bindSampler(GLuint unit, const SamplerDesc & desc)
+{
+    bindSampler(unit, getSampler(desc));
+}
+
+
+void deleteSamplers()
+{
+    for (size_t unit = 0; unit < BoundSamplers.size(); unit++)
+    {
+        if (BoundSamplers[unit] != 0)
+            glBindSampler(static_cast<GLuint>(unit), 0);
+    }
+    BoundSamplers.clear();
+
+    for (std::map<SamplerKey, GLuint>::const_iterator it = Samplers.begin(); it != Samplers.end(); ++it)
+        glDeleteSamplers(1, &it->second);
+    Samplers.clear();
+}
+
+
+SamplerStats getSamplerStats()
+{
+    SamplerStats stats;
+    stats.samplers = static_cast<unsigned int>(Samplers.size());
+    stats.binds = SamplerBinds;
+    stats.skippedBinds = SkippedSamplerBinds;
+    return stats;
+}
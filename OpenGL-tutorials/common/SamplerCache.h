@@ -0,0 +1,49 @@
+#ifndef SAMPLERCACHE_H
+#define SAMPLERCACHE_H
+#include <GL/glew.h>
+
+/**
+ * Full sampling state of a texture unit. Two equal descriptions share one GL sampler object.
+ */
+struct SamplerDesc
+{
+    GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+    GLenum wrapS = GL_REPEAT;
+    GLenum wrapT = GL_REPEAT;
+    GLenum compareMode = GL_NONE;  // GL_COMPARE_REF_TO_TEXTURE for shadow maps
+    GLenum compareFunc = GL_LEQUAL;
+    float maxAnisotropy = 1.0f;    // Clamped to what the driver supports
+};
+
+/**
+ * Counters of the sampler cache.
+ */
+struct SamplerStats
+{
+    unsigned int samplers;      // Sampler objects created
+    unsigned int binds;         // glBindSampler calls issued
+    unsigned int skippedBinds;  // Binds skipped because the unit already had that sampler
+};
+
+// Common descriptions.
+SamplerDesc nearestSampler(GLenum wrap = GL_REPEAT);
+SamplerDesc linearSampler(GLenum wrap = GL_REPEAT);
+SamplerDesc trilinearSampler(float maxAnisotropy = 1.0f, GLenum wrap = GL_REPEAT);
+SamplerDesc shadowSampler();
+
+// Returns the sampler object for a description, creating it on first use.
+GLuint getSampler(const SamplerDesc & desc);
+
+// Binds a sampler to a texture unit unless it is already bound there.
+// Sampler state overrides the texture's own, so the loaders no longer set any.
+// Every glBindSampler must go through these for the tracking to stay right.
+void bindSampler(GLuint unit, GLuint sampler_id);
+void bindSampler(GLuint unit, const SamplerDesc & desc);
+
+// Deletes every cached sampler and forgets the per-unit bindings.
+void deleteSamplers();
+
+SamplerStats getSamplerStats();
+
+#endif
@@ -1,26 +1,101 @@
 #include "Shader.h"
 #include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <sstream>
 
+#include "Assets.h"
+#include "UniformBuffers.h"
 
-std::string GetShaderCodeFromFile(const char * filepath) {
+// Linked programs are saved in the current working directory as shader_<key>.bin.
+#define PROGRAM_BINARY_MAGIC 0x31434250  // Equivalent to "PBC1" in ASCII
+
+// A program submitted by QueueShaders whose status has not been checked yet.
+struct PendingProgram
+{
+    GLuint vertexShader;    // 0 when restored from the binary cache
+    GLuint fragmentShader;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string cachePath;
+};
+
+ShaderCacheStats ShaderCache = {0, 0, 0.0};
+std::map<GLuint, PendingProgram> PendingPrograms;
+
+
+// Reads a shader file, replacing `#include "file"` lines by that file's code.
+// Included paths are relative to the including file; each is appended to `includes`
+// when it is given.
+static std::string ReadShaderFile(const std::string & filepath, int depth,
+                                  std::vector<std::string> * includes = NULL) {
     std::string ShaderCode = "";
-    std::ifstream ShaderStream(filepath, std::ios::in);
-
-    // Just read all file line-by-line
-    if(ShaderStream.is_open()) {
-        std::string line;
-        while (getline(ShaderStream, line))
-            ShaderCode += "\n" + line;
-        ShaderStream.close();
+    std::vector<unsigned char> Source;
+
+    if(!readAsset(filepath, Source)) {
+        std::cout << "Error: file " << filepath << " not found." << std::endl;
+        return ShaderCode;
     }
-    else {
-        std::cout << "Error: file " << std::string(filepath) << " not found." << std::endl;
+    std::istringstream ShaderStream(std::string(Source.begin(), Source.end()));
+
+    size_t slash = filepath.rfind('/');
+    std::string directory = slash == std::string::npos ? "" : filepath.substr(0, slash + 1);
+
+    // Read the file line-by-line
+    std::string line;
+    while (getline(ShaderStream, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+            size_t open = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+                std::cout << "Error: malformed include in " << filepath << ": " << line << std::endl;
+            else if (depth >= 16)
+                std::cout << "Error: includes nested too deeply in " << filepath << std::endl;
+            else {
+                std::string included = directory + line.substr(open + 1, close - open - 1);
+                if (includes)
+                    includes->push_back(included);
+                ShaderCode += ReadShaderFile(included, depth + 1, includes);
+            }
+            continue;
+        }
+        ShaderCode += "\n" + line;
     }
 
     return ShaderCode;
 }
 
 
+std::string GetShaderCodeFromFile(const char * filepath, const std::vector<std::string> & defines) {
+    std::string ShaderCode = ReadShaderFile(filepath, 0);
+    if (defines.empty())
+        return ShaderCode;
+
+    // Defines go right after #version, which must stay the first directive.
+    std::string DefineLines = "";
+    for (size_t i = 0; i < defines.size(); i++)
+        DefineLines += "\n#define " + defines[i];
+
+    size_t version = ShaderCode.find("#version");
+    size_t insert = version == std::string::npos ? 0 : ShaderCode.find('\n', version);
+    if (insert == std::string::npos)
+        insert = ShaderCode.size();
+    ShaderCode.insert(insert, DefineLines);
+
+    return ShaderCode;
+}
+
+
+std::vector<std::string> GetShaderIncludes(const char * filepath) {
+    std::vector<std::string> includes;
+    ReadShaderFile(filepath, 0, &includes);
+    return includes;
+}
+
+
 void CompileShader(GLuint shader_id, const char * filepath, const std::string &shader_code) {
     char const * SourcePointer = shader_code.c_str();
 
@@ -50,7 +125,7 @@ void AttachVertexAndFragmentShaders(GLuint program_id, GLuint vertex_shader_id,
 
 
 void CheckProgram(GLuint program_id, GLint * result, int * info_log_length) {
-    glGetProgramiv(program_id, GL_COMPILE_STATUS, result);
+    glGetProgramiv(program_id, GL_LINK_STATUS, result);
     glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, info_log_length);
     if ( *info_log_length > 0 ) {
         std::vector<char> ProgramErrorMessage(*info_log_length);
@@ -61,38 +136,219 @@ void CheckProgram(GLuint program_id, GLint * result, int * info_log_length) {
 }
 
 
-GLuint LoadShaders(const char * vertex_filepath, const char * fragment_filepath) {
-    GLuint ProgramID;
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
+// FNV-1a over both sources and the driver identification: a new driver or GPU
+// gets a new key instead of a binary it would reject.
+static std::string ProgramCacheKey(const std::string & vertex_code, const std::string & fragment_code) {
+    const GLubyte * strings[] = {
+        glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION)
+    };
+    std::string key_text = vertex_code + '\0' + fragment_code;
+    for (int i = 0; i < 3; i++)
+        key_text += '\0' + std::string(strings[i] ? reinterpret_cast<const char *>(strings[i]) : "");
 
-    // Create shaders.
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key_text.size(); i++) {
+        hash ^= static_cast<unsigned char>(key_text[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "shader_%016llx.bin", static_cast<unsigned long long>(hash));
+    return name;
+}
+
+
+static bool ProgramBinarySupported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+
+// Returns 0 when there is no cached binary or the driver rejects it.
+static GLuint LoadProgramBinary(const std::string & cache_path) {
+    FILE * file = fopen(cache_path.c_str(), "rb");
+    if (file == NULL)
+        return 0;
+
+    uint32_t header[3];  // Magic, binary format, size
+    std::vector<char> binary;
+    bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == PROGRAM_BINARY_MAGIC;
+    if (ok) {
+        binary.resize(header[2]);
+        ok = !binary.empty() && fread(&binary[0], 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!ok)
+        return 0;
+
+    GLuint program_id = glCreateProgram();
+    glProgramBinary(program_id, header[1], &binary[0], static_cast<GLsizei>(binary.size()));
+
+    GLint result = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+        std::cout << "Cached program " << cache_path << " rejected by the driver, recompiling." << std::endl;
+        glDeleteProgram(program_id);
+        return 0;
+    }
+    return program_id;
+}
+
+
+static void SaveProgramBinary(GLuint program_id, const std::string & cache_path) {
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program_id, length, NULL, &format, &binary[0]);
+
+    FILE * file = fopen(cache_path.c_str(), "wb");
+    if (file == NULL)
+        return;
+    uint32_t header[3] = {PROGRAM_BINARY_MAGIC, format, static_cast<uint32_t>(length)};
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(&binary[0], 1, binary.size(), file);
+    fclose(file);
+}
+
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+GLuint QueueShaders(const char * vertex_filepath, const char * fragment_filepath,
+                    const std::vector<std::string> & defines) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Let the driver use as many compiler threads as it likes.
+    static bool ParallelCompileConfigured = false;
+    if (!ParallelCompileConfigured && GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        ParallelCompileConfigured = true;
+    }
 
     // Load data from file.
-    std::string VertextShaderCode = GetShaderCodeFromFile(vertex_filepath);
-    std::string FragmentShaderCode = GetShaderCodeFromFile(fragment_filepath);
+    std::string VertextShaderCode = GetShaderCodeFromFile(vertex_filepath, defines);
+    std::string FragmentShaderCode = GetShaderCodeFromFile(fragment_filepath, defines);
+
+    PendingProgram Pending;
+    Pending.vertexPath = vertex_filepath;
+    Pending.fragmentPath = fragment_filepath;
+    Pending.vertexShader = 0;
+    Pending.fragmentShader = 0;
+
+    // Reuse the program linked by a previous run if the driver accepts it.
+    bool CacheSupported = ProgramBinarySupported();
+    Pending.cachePath = CacheSupported ? ProgramCacheKey(VertextShaderCode, FragmentShaderCode) : "";
+    GLuint ProgramID = CacheSupported ? LoadProgramBinary(Pending.cachePath) : 0;
+    if (ProgramID != 0) {
+        std::cout << "Load cached program: " << Pending.vertexPath << " + " << Pending.fragmentPath << std::endl;
+        PendingPrograms[ProgramID] = Pending;
+        ShaderCache.seconds += SecondsSince(start);
+        return ProgramID;
+    }
 
-    // Compile and check vertex/fragment shaders.
-    CompileShader(VertexShaderID, vertex_filepath, VertextShaderCode);
-    CheckCompiledShader(VertexShaderID, &Result, &InfoLogLength);
-    CompileShader(FragmentShaderID, fragment_filepath, FragmentShaderCode);
-    CheckCompiledShader(FragmentShaderID, &Result, &InfoLogLength);
+    // Submit the compiles and the link without querying any status, which would wait for them.
+    Pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    Pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    CompileShader(Pending.vertexShader, vertex_filepath, VertextShaderCode);
+    CompileShader(Pending.fragmentShader, fragment_filepath, FragmentShaderCode);
 
-    // Create shader program and link compiled shader with it.
-    std::cout << "Create shader program..." << std::endl;
     ProgramID = glCreateProgram();
-    AttachVertexAndFragmentShaders(ProgramID, VertexShaderID, FragmentShaderID);
+    if (CacheSupported)
+        glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    AttachVertexAndFragmentShaders(ProgramID, Pending.vertexShader, Pending.fragmentShader);
+
+    PendingPrograms[ProgramID] = Pending;
+    ShaderCache.seconds += SecondsSince(start);
+    return ProgramID;
+}
 
-    // Check shader program.
-    CheckProgram(ProgramID, &Result, &InfoLogLength);
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
+bool IsProgramReady(GLuint program_id) {
+    std::map<GLuint, PendingProgram>::const_iterator it = PendingPrograms.find(program_id);
+    if (it == PendingPrograms.end() || it->second.vertexShader == 0)
+        return true;
 
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+    // Without the extension there is no way to ask without waiting.
+    if (!GLEW_KHR_parallel_shader_compile)
+        return true;
+
+    GLint Completed = GL_FALSE;
+    glGetProgramiv(program_id, GL_COMPLETION_STATUS_KHR, &Completed);
+    return Completed == GL_TRUE;
+}
 
+
+void FinishProgram(GLuint program_id) {
+    std::map<GLuint, PendingProgram>::iterator it = PendingPrograms.find(program_id);
+    if (it == PendingPrograms.end())
+        return;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const PendingProgram & Pending = it->second;
+    if (Pending.vertexShader == 0) {
+        bindUniformBlocks(program_id);
+        ShaderCache.hits++;
+    }
+    else {
+        GLint Result = GL_FALSE;
+        int InfoLogLength;
+
+        // Check vertex/fragment shaders, then the program.
+        CheckCompiledShader(Pending.vertexShader, &Result, &InfoLogLength);
+        CheckCompiledShader(Pending.fragmentShader, &Result, &InfoLogLength);
+        std::cout << "Create shader program: " << Pending.vertexPath << " + " << Pending.fragmentPath << std::endl;
+        CheckProgram(program_id, &Result, &InfoLogLength);
+        if (Result == GL_TRUE) {
+            bindUniformBlocks(program_id);
+            if (!Pending.cachePath.empty())
+                SaveProgramBinary(program_id, Pending.cachePath);
+        }
+
+        glDetachShader(program_id, Pending.vertexShader);
+        glDetachShader(program_id, Pending.fragmentShader);
+
+        glDeleteShader(Pending.vertexShader);
+        glDeleteShader(Pending.fragmentShader);
+        ShaderCache.misses++;
+    }
+
+    PendingPrograms.erase(it);
+    ShaderCache.seconds += SecondsSince(start);
+}
+
+
+bool PollProgram(GLuint program_id) {
+    if (!IsProgramReady(program_id))
+        return false;
+    FinishProgram(program_id);
+
+    GLint Linked = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &Linked);
+    return Linked == GL_TRUE;
+}
+
+
+void FinishPendingPrograms() {
+    while (!PendingPrograms.empty())
+        FinishProgram(PendingPrograms.begin()->first);
+}
+
+
+GLuint LoadShaders(const char * vertex_filepath, const char * fragment_filepath,
+                   const std::vector<std::string> & defines) {
+    GLuint ProgramID = QueueShaders(vertex_filepath, fragment_filepath, defines);
+    FinishProgram(ProgramID);
     return ProgramID;
 }
+
+
+ShaderCacheStats GetShaderCacheStats() {
+    return ShaderCache;
+}
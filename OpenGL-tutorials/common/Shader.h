@@ -1,14 +1,48 @@
 #ifndef SHADER_H
 #define SHADER_H
 #include <fstream>
+#include <string>
 #include <vector>
 #include <GL/glew.h>
 
-std::string GetShaderCodeFromFile(const char * filepath);
+/**
+ * Program binary cache counters, for comparing cold (compiled) and warm (cached) startups.
+ */
+struct ShaderCacheStats
+{
+    unsigned int hits;    // Programs restored with glProgramBinary
+    unsigned int misses;  // Programs compiled and linked from source
+    double seconds;       // Time the caller spent blocked in the shader functions
+};
+
+// Reads a shader, expanding `#include "file"` (relative to the including file) and
+// adding `#define <entry>` after #version for each entry of `defines`.
+std::string GetShaderCodeFromFile(const char * filepath,
+                                  const std::vector<std::string> & defines = std::vector<std::string>());
+// Paths of the files `filepath` includes, directly or not, as GetShaderCodeFromFile opens them.
+std::vector<std::string> GetShaderIncludes(const char * filepath);
 void CompileShader(GLuint shader_id, const char * filepath, const std::string &shader_code);
 void CheckCompiledShader(GLuint shader_id, GLint * result, int * info_log_length);
 void AttachVertexAndFragmentShaders(GLuint ProgramID, GLuint VertexShaderID, GLuint FragmentShaderID);
 void CheckProgram(GLuint program_id, GLint * result, int * info_log_length);
-GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path);
+// Compiles and links a program, or restores it from the binary saved by a previous
+// run when the sources, GL vendor, renderer and version are unchanged.
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path,
+                   const std::vector<std::string> & defines = std::vector<std::string>());
+
+// Batch API: QueueShaders submits the compiles and the link and returns the program
+// right away, so the driver (with KHR_parallel_shader_compile, on its own threads) works
+// while the caller loads assets. FinishProgram checks the logs and must be called before
+// the program is first used; IsProgramReady tells whether that would block. PollProgram
+// finishes the program only once it is ready: call it each frame and draw without the
+// program (skip, or use a fallback) while it returns false. Without
+// KHR_parallel_shader_compile programs are always reported ready, so the first poll blocks.
+GLuint QueueShaders(const char * vertex_file_path, const char * fragment_file_path,
+                    const std::vector<std::string> & defines = std::vector<std::string>());
+bool IsProgramReady(GLuint program_id);
+bool PollProgram(GLuint program_id);
+void FinishProgram(GLuint program_id);
+void FinishPendingPrograms();
+ShaderCacheStats GetShaderCacheStats();
 
 #endif
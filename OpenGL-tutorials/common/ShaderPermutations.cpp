@@ -0,0 +1,65 @@
+#include "ShaderPermutations.h"
+#include <iostream>
+
+#include "Shader.h"
+#include "ShaderReload.h"
+
+
+ShaderPermutations::ShaderPermutations(const char * vertexPath, const char * fragmentPath,
+                                       const std::vector<std::string> & features, bool hotReload)
+    : vertexPath(vertexPath),
+      fragmentPath(fragmentPath),
+      features(features),
+      hotReload(hotReload)
+{
+}
+
+
+ShaderPermutations::~ShaderPermutations()
+{
+    Clear();
+}
+
+
+std::vector<std::string> ShaderPermutations::Defines(unsigned int featureBits) const
+{
+    std::vector<std::string> defines;
+    for (size_t i = 0; i < features.size(); i++)
+    {
+        if (featureBits & (1u << i))
+            defines.push_back(features[i] + " 1");
+    }
+    return defines;
+}
+
+
+GLuint ShaderPermutations::Get(unsigned int featureBits)
+{
+    std::map<unsigned int, GLuint>::iterator it = programs.find(featureBits);
+    if (it != programs.end())
+        return it->second;
+
+    std::vector<std::string> defines = Defines(featureBits);
+    std::cout << "Compile variant " << featureBits << " of " << fragmentPath << ":";
+    for (size_t i = 0; i < defines.size(); i++)
+        std::cout << " " << defines[i];
+    std::cout << std::endl;
+
+    GLuint & program = programs[featureBits];
+    program = LoadShaders(vertexPath.c_str(), fragmentPath.c_str(), defines);
+    if (hotReload)
+        WatchProgram(program, vertexPath.c_str(), fragmentPath.c_str(), ShaderReloadCallback(), defines);
+    return program;
+}
+
+
+void ShaderPermutations::Clear()
+{
+    for (std::map<unsigned int, GLuint>::iterator it = programs.begin(); it != programs.end(); ++it)
+    {
+        if (hotReload)
+            UnwatchProgram(it->second);
+        glDeleteProgram(it->second);
+    }
+    programs.clear();
+}
@@ -0,0 +1,51 @@
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ * The variants of one vertex/fragment shader pair, one per combination of feature bits.
+ *
+ * Feature i is enabled by bit i and compiled in as `#define <features[i]> 1`, so the
+ * shader's #if/#ifdef branches are resolved at compile time. Each variant is compiled
+ * the first time it is requested; variants never requested are never compiled.
+ */
+class ShaderPermutations
+{
+public:
+    /**
+     * @param vertexPath Vertex shader file.
+     * @param fragmentPath Fragment shader file.
+     * @param features Macro name of each feature bit.
+     * @param hotReload Recompile the compiled variants when their sources change
+     *                  (ReloadChangedShaders must then be called every frame).
+     */
+    ShaderPermutations(const char * vertexPath, const char * fragmentPath,
+                       const std::vector<std::string> & features, bool hotReload = false);
+    ~ShaderPermutations();
+
+    /**
+     * Returns the program for a feature combination, compiling it on first request.
+     */
+    GLuint Get(unsigned int featureBits);
+
+    size_t GetCompiledCount() const { return programs.size(); }
+
+    /**
+     * Deletes every compiled variant.
+     */
+    void Clear();
+
+private:
+    std::vector<std::string> Defines(unsigned int featureBits) const;
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> features;
+    bool hotReload;
+    std::map<unsigned int, GLuint> programs;  // Node addresses are stable for the watcher
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLState.h"
+
+
+UniformUploadStats UniformUploads = {0, 0};
+
+
+UniformUploadStats getUniformUploadStats()
+{
+    return UniformUploads;
+}
+
+
+void resetUniformUploadStats()
+{
+    UniformUploads.issued = 0;
+    UniformUploads.skipped = 0;
+}
+
+
+// Bytes needed to cache one value of a uniform type.
+static size_t uniformTypeSize(GLenum type)
+{
+    switch (type)
+    {
+        case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_BOOL_VEC2:
+            return 8;
+        case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_BOOL_VEC3:
+            return 12;
+        case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+            return 16;
+        case GL_FLOAT_MAT3:
+            return 36;
+        case GL_FLOAT_MAT4:
+            return 64;
+        default:  // Scalars and samplers
+            return 4;
+    }
+}
+
+
+ShaderProgram::ShaderProgram() : program(0)
+{
+}
+
+
+ShaderProgram::ShaderProgram(GLuint program_id) : program(0)
+{
+    Reflect(program_id);
+}
+
+
+void ShaderProgram::Reflect(GLuint program_id)
+{
+    program = program_id;
+    uniforms.clear();
+    uniformIndices.clear();
+    values.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> name(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, i, static_cast<GLsizei>(name.size()), &length, &size, &type, &name[0]);
+
+        Uniform uniform;
+        uniform.name.assign(&name[0], length);
+        uniform.location = glGetUniformLocation(program, uniform.name.c_str());
+        if (uniform.location < 0)
+            continue;  // Member of a uniform block
+        uniform.type = type;
+        uniform.offset = values.size();
+        uniform.valid = false;
+        values.resize(values.size() + uniformTypeSize(type));
+
+        // Arrays are reported as "name[0]": make them reachable by their bare name too.
+        int index = static_cast<int>(uniforms.size());
+        uniformIndices[uniform.name] = index;
+        size_t bracket = uniform.name.find('[');
+        if (bracket != std::string::npos)
+            uniformIndices[uniform.name.substr(0, bracket)] = index;
+        uniforms.push_back(uniform);
+    }
+}
+
+
+void ShaderProgram::Use() const
+{
+    useProgram(program);
+}
+
+
+int ShaderProgram::GetUniform(const std::string & name) const
+{
+    std::unordered_map<std::string, int>::const_iterator it = uniformIndices.find(name);
+    return it == uniformIndices.end() ? -1 : it->second;
+}
+
+
+GLint ShaderProgram::GetLocation(const std::string & name) const
+{
+    int uniform = GetUniform(name);
+    return uniform < 0 ? -1 : uniforms[uniform].location;
+}
+
+
+bool ShaderProgram::Changed(int uniform, const void * value, size_t bytes)
+{
+    if (uniform < 0 || uniform >= static_cast<int>(uniforms.size()))
+        return false;
+
+    Uniform & cached = uniforms[uniform];
+    unsigned char * previous = &values[cached.offset];
+    bytes = std::min(bytes, uniformTypeSize(cached.type));
+    if (cached.valid && memcmp(previous, value, bytes) == 0)
+    {
+        UniformUploads.skipped++;
+        return false;
+    }
+
+    memcpy(previous, value, bytes);
+    cached.valid = true;
+    UniformUploads.issued++;
+    return true;
+}
+
+
+void ShaderProgram::Set(int uniform, GLint value)
+{
+    if (Changed(uniform, &value, sizeof(value)))
+        glProgramUniform1i(program, uniforms[uniform].location, value);
+}
+
+
+void ShaderProgram::Set(int uniform, GLfloat value)
+{
+    if (Changed(uniform, &value, sizeof(value)))
+        glProgramUniform1f(program, uniforms[uniform].location, value);
+}
+
+
+void ShaderProgram::Set(int uniform, const glm::vec2 & value)
+{
+    if (Changed(uniform, glm::value_ptr(value), sizeof(GLfloat) * 2))
+        glProgramUniform2fv(program, uniforms[uniform].location, 1, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(int uniform, const glm::vec3 & value)
+{
+    if (Changed(uniform, glm::value_ptr(value), sizeof(GLfloat) * 3))
+        glProgramUniform3fv(program, uniforms[uniform].location, 1, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(int uniform, const glm::vec4 & value)
+{
+    if (Changed(uniform, glm::value_ptr(value), sizeof(GLfloat) * 4))
+        glProgramUniform4fv(program, uniforms[uniform].location, 1, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(int uniform, const glm::mat3 & value)
+{
+    if (Changed(uniform, glm::value_ptr(value), sizeof(GLfloat) * 9))
+        glProgramUniformMatrix3fv(program, uniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(int uniform, const glm::mat4 & value)
+{
+    if (Changed(uniform, glm::value_ptr(value), sizeof(GLfloat) * 16))
+        glProgramUniformMatrix4fv(program, uniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value));
+}
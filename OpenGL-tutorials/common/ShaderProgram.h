@@ -0,0 +1,81 @@
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * Uniform upload counters, summed over every ShaderProgram.
+ */
+struct UniformUploadStats
+{
+    unsigned int issued;   // glProgramUniform* calls made
+    unsigned int skipped;  // Calls avoided because the value was already set
+};
+
+// Call once per frame, after reading the stats, to make them per-frame counters.
+UniformUploadStats getUniformUploadStats();
+void resetUniformUploadStats();
+
+
+/**
+ * A linked program with its active uniforms reflected once into a flat table.
+ *
+ * Setters keep a copy of the last value sent for each uniform and skip the upload when
+ * the new value is identical. They use glProgramUniform*, so the program does not need
+ * to be bound. Setting a uniform the program does not have is a no-op, like location -1.
+ */
+class ShaderProgram
+{
+public:
+    ShaderProgram();
+    explicit ShaderProgram(GLuint program_id);
+
+    /**
+     * Reads the active uniforms of a program and forgets every cached value.
+     * Call it again with the new ID after a hot reload.
+     */
+    void Reflect(GLuint program_id);
+
+    GLuint GetID() const { return program; }
+    void Use() const;
+
+    /**
+     * Index of a uniform in the table (-1 if not active), to avoid name lookups in hot loops.
+     */
+    int GetUniform(const std::string & name) const;
+    GLint GetLocation(const std::string & name) const;
+
+    void Set(int uniform, GLint value);
+    void Set(int uniform, GLfloat value);
+    void Set(int uniform, const glm::vec2 & value);
+    void Set(int uniform, const glm::vec3 & value);
+    void Set(int uniform, const glm::vec4 & value);
+    void Set(int uniform, const glm::mat3 & value);
+    void Set(int uniform, const glm::mat4 & value);
+
+    template <typename T>
+    void Set(const std::string & name, const T & value) { Set(GetUniform(name), value); }
+
+private:
+    struct Uniform
+    {
+        std::string name;
+        GLint location;
+        GLenum type;
+        size_t offset;  // Of the cached value in `values`
+        bool valid;     // False until the first upload
+    };
+
+    // Updates the cached value; returns false when the upload can be skipped.
+    bool Changed(int uniform, const void * value, size_t bytes);
+
+    GLuint program;
+    std::vector<Uniform> uniforms;
+    std::unordered_map<std::string, int> uniformIndices;
+    std::vector<unsigned char> values;
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "ShaderReload.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "Assets.h"
+#include "Shader.h"
+
+
+struct WatchedProgram
+{
+    GLuint * program;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> includes;  // Files both sources include, as ReadShaderFile opens them
+    std::vector<std::string> defines;
+    ShaderReloadCallback onReload;
+};
+
+
+std::vector<WatchedProgram> WatchedPrograms;
+std::set<std::string> WatchedShaderFiles;
+std::set<std::string> ChangedShaderFiles;
+std::mutex ShaderWatchMutex;
+std::thread ShaderWatchThread;
+std::atomic<bool> ShaderWatchRunning(false);
+bool AssetsPreferDiskBeforeWatch = false;
+
+#ifdef __linux__
+int ShaderWatchFD = -1;
+// inotify watch descriptor -> directory, under every spelling used for it: the same
+// directory reached from two shaders (e.g. "../common" and "shaders/../common") shares
+// one descriptor.
+std::map<int, std::set<std::string> > ShaderWatchDirectories;
+#endif
+
+
+// Splits at the last '/' so that a file and its directory's events map to the same string.
+static std::string directoryOf(const std::string & path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+
+static std::string joinPath(const std::string & directory, const std::string & name)
+{
+    return directory == "." ? name : directory + "/" + name;
+}
+
+
+static void watchShaderFile(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(ShaderWatchMutex);
+    if (!WatchedShaderFiles.insert(path).second)
+        return;
+#ifdef __linux__
+    // Watch the directory rather than the file: editors often save by renaming a new
+    // file over the old one, which would silently end a watch on the file itself.
+    std::string directory = directoryOf(path);
+    int wd = inotify_add_watch(ShaderWatchFD, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+        std::cout << "Shader watcher: cannot watch " << directory << std::endl;
+    else
+        ShaderWatchDirectories[wd].insert(directory);
+#endif
+}
+
+
+static void shaderWatchLoop()
+{
+#ifdef __linux__
+    std::vector<char> buffer(4096);
+    while (ShaderWatchRunning)
+    {
+        // Wake up regularly to notice StopShaderWatcher.
+        pollfd descriptor = {ShaderWatchFD, POLLIN, 0};
+        if (poll(&descriptor, 1, 100) <= 0)
+            continue;
+
+        ssize_t length = read(ShaderWatchFD, &buffer[0], buffer.size());
+        std::lock_guard<std::mutex> lock(ShaderWatchMutex);
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const inotify_event * event = reinterpret_cast<const inotify_event *>(&buffer[offset]);
+            std::map<int, std::set<std::string> >::const_iterator directories = ShaderWatchDirectories.find(event->wd);
+            if (event->len > 0 && directories != ShaderWatchDirectories.end())
+            {
+                for (std::set<std::string>::const_iterator directory = directories->second.begin();
+                     directory != directories->second.end(); ++directory)
+                {
+                    std::string path = joinPath(*directory, event->name);
+                    if (WatchedShaderFiles.count(path))
+                        ChangedShaderFiles.insert(path);
+                }
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+#else
+    std::map<std::string, time_t> modified;
+    while (ShaderWatchRunning)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        std::lock_guard<std::mutex> lock(ShaderWatchMutex);
+        for (std::set<std::string>::const_iterator it = WatchedShaderFiles.begin(); it != WatchedShaderFiles.end(); ++it)
+        {
+            struct stat status;
+            if (stat(it->c_str(), &status) != 0)
+                continue;
+            std::map<std::string, time_t>::iterator previous = modified.find(*it);
+            if (previous != modified.end() && previous->second != status.st_mtime)
+                ChangedShaderFiles.insert(*it);
+            modified[*it] = status.st_mtime;
+        }
+    }
+#endif
+}
+
+
+static bool startShaderWatcher()
+{
+    if (ShaderWatchRunning)
+        return true;
+
+#ifdef __linux__
+    ShaderWatchFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ShaderWatchFD < 0)
+    {
+        std::cout << "Shader watcher: inotify is not available, hot reload disabled." << std::endl;
+        return false;
+    }
+#endif
+    ShaderWatchRunning = true;
+    ShaderWatchThread = std::thread(shaderWatchLoop);
+
+    // Reloads go through readAsset: without this, builds that embed their shaders would
+    // compile the embedded copy again and silently ignore the edit.
+    AssetsPreferDiskBeforeWatch = getAssetsPreferDisk();
+    setAssetsPreferDisk(true);
+    return true;
+}
+
+
+// Watches the sources of `watched` and every file they include. Called again after
+// each reload, since an edit may add includes.
+static void watchProgramFiles(WatchedProgram & watched)
+{
+    watched.includes = GetShaderIncludes(watched.vertexPath.c_str());
+    std::vector<std::string> fragmentIncludes = GetShaderIncludes(watched.fragmentPath.c_str());
+    watched.includes.insert(watched.includes.end(), fragmentIncludes.begin(), fragmentIncludes.end());
+
+    watchShaderFile(watched.vertexPath);
+    watchShaderFile(watched.fragmentPath);
+    for (size_t i = 0; i < watched.includes.size(); i++)
+        watchShaderFile(watched.includes[i]);
+}
+
+
+static bool sourcesChanged(const WatchedProgram & watched, const std::set<std::string> & changed)
+{
+    if (changed.count(watched.vertexPath) || changed.count(watched.fragmentPath))
+        return true;
+    for (size_t i = 0; i < watched.includes.size(); i++)
+    {
+        if (changed.count(watched.includes[i]))
+            return true;
+    }
+    return false;
+}
+
+
+void WatchProgram(GLuint & program_id, const char * vertex_file_path, const char * fragment_file_path,
+                  ShaderReloadCallback on_reload, const std::vector<std::string> & defines)
+{
+    if (!startShaderWatcher())
+        return;
+
+    WatchedProgram watched;
+    watched.program = &program_id;
+    watched.vertexPath = vertex_file_path;
+    watched.fragmentPath = fragment_file_path;
+    watched.defines = defines;
+    watched.onReload = on_reload;
+    watchProgramFiles(watched);
+    WatchedPrograms.push_back(watched);
+}
+
+
+void UnwatchProgram(GLuint & program_id)
+{
+    for (size_t i = 0; i < WatchedPrograms.size(); )
+    {
+        if (WatchedPrograms[i].program == &program_id)
+            WatchedPrograms.erase(WatchedPrograms.begin() + i);
+        else
+            i++;
+    }
+}
+
+
+int ReloadChangedShaders()
+{
+    std::set<std::string> changed;
+    {
+        std::lock_guard<std::mutex> lock(ShaderWatchMutex);
+        changed.swap(ChangedShaderFiles);
+    }
+    if (changed.empty())
+        return 0;
+
+    int swapped = 0;
+    for (size_t i = 0; i < WatchedPrograms.size(); i++)
+    {
+        WatchedProgram & watched = WatchedPrograms[i];
+        if (!sourcesChanged(watched, changed))
+            continue;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GLuint candidate = LoadShaders(watched.vertexPath.c_str(), watched.fragmentPath.c_str(), watched.defines);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(candidate, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE)
+        {
+            std::cout << "Hot reload failed, keeping the previous program." << std::endl;
+            glDeleteProgram(candidate);
+            continue;
+        }
+
+        // Swap between frames: the next draw uses the new program, never a half-built one.
+        glDeleteProgram(*watched.program);
+        *watched.program = candidate;
+        if (watched.onReload)
+            watched.onReload(candidate);
+        watchProgramFiles(watched);
+        swapped++;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Hot reloaded " << watched.fragmentPath << " in " << elapsed * 1000.0 << " ms" << std::endl;
+    }
+    return swapped;
+}
+
+
+void StopShaderWatcher()
+{
+    if (ShaderWatchRunning)
+    {
+        ShaderWatchRunning = false;
+        ShaderWatchThread.join();
+        setAssetsPreferDisk(AssetsPreferDiskBeforeWatch);
+    }
+#ifdef __linux__
+    if (ShaderWatchFD >= 0)
+        close(ShaderWatchFD);
+    ShaderWatchFD = -1;
+    ShaderWatchDirectories.clear();
+#endif
+    WatchedPrograms.clear();
+    WatchedShaderFiles.clear();
+    ChangedShaderFiles.clear();
+}
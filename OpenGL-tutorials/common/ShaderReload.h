@@ -0,0 +1,32 @@
+#ifndef SHADERRELOAD_H
+#define SHADERRELOAD_H
+#include <functional>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// Called on the GL thread with the new program right after a swap, to re-query
+// uniform locations.
+typedef std::function<void(GLuint program_id)> ShaderReloadCallback;
+
+// Watches the two source files of a program loaded with LoadShaders and the files they
+// `#include` (inotify on Linux, modification times elsewhere). `program_id` must outlive
+// the watch: it is replaced in place by ReloadChangedShaders. The watcher thread starts
+// with the first call.
+// `defines` are the ones the program was built with (see GetShaderCodeFromFile).
+void WatchProgram(GLuint & program_id, const char * vertex_file_path, const char * fragment_file_path,
+                  ShaderReloadCallback on_reload = ShaderReloadCallback(),
+                  const std::vector<std::string> & defines = std::vector<std::string>());
+
+// Stops updating `program_id`, e.g. before the variable goes away.
+void UnwatchProgram(GLuint & program_id);
+
+// Call once per frame: recompiles the programs whose sources changed and swaps them in.
+// A program that fails to compile or link is dropped and the previous one kept.
+// Returns the number of programs swapped.
+int ReloadChangedShaders();
+
+// Stops the watcher thread and forgets every watched program.
+void StopShaderWatcher();
+
+#endif
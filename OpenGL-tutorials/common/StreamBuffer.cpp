@@ -0,0 +1,153 @@
+#include "StreamBuffer.h"
+#include <iostream>
+
+#include "GLState.h"
+
+
+StreamBuffer::StreamBuffer()
+    : target(GL_ARRAY_BUFFER),
+      buffer(0),
+      persistent(nullptr),
+      mapped(false),
+      regionSize(0),
+      regions(0),
+      region(0),
+      head(0),
+      stalls(0)
+{
+}
+
+
+StreamBuffer::~StreamBuffer()
+{
+    Destroy();
+}
+
+
+bool StreamBuffer::Create(GLenum target, size_t regionBytes, unsigned int regions)
+{
+    Destroy();
+
+    this->target = target;
+    this->regions = regions;
+    regionSize = (regionBytes + 255) / 256 * 256;
+    region = 0;
+    head = 0;
+    stalls = 0;
+    fences.assign(regions, 0);
+
+    size_t size = regionSize * regions;
+    glGenBuffers(1, &buffer);
+    bindBuffer(target, buffer);
+
+    if (GLEW_ARB_buffer_storage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, size, NULL, flags);
+        persistent = static_cast<unsigned char*>(glMapBufferRange(target, 0, size, flags));
+        if (!persistent)
+        {
+            std::cout << "StreamBuffer: persistent mapping failed." << std::endl;
+            Destroy();
+            return false;
+        }
+    }
+    else
+    {
+        glBufferData(target, size, NULL, GL_STREAM_DRAW);
+    }
+    return true;
+}
+
+
+void StreamBuffer::Destroy()
+{
+    if (buffer)
+    {
+        Unmap();
+        if (persistent)
+        {
+            bindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            persistent = nullptr;
+        }
+        forgetBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    for (size_t i = 0; i < fences.size(); i++)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    }
+    fences.clear();
+}
+
+
+void StreamBuffer::WaitRegion(unsigned int region)
+{
+    GLsync fence = fences[region];
+    if (!fence)
+        return;
+
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        stalls++;
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+    }
+    glDeleteSync(fence);
+    fences[region] = 0;
+}
+
+
+void StreamBuffer::NextRegion()
+{
+    Unmap();
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    region = (region + 1) % regions;
+    head = 0;
+    WaitRegion(region);
+}
+
+
+void * StreamBuffer::Map(size_t bytes, size_t & offset, size_t alignment)
+{
+    if (bytes > regionSize)
+    {
+        std::cout << "StreamBuffer: " << bytes << " bytes do not fit in a " << regionSize
+                  << " bytes region." << std::endl;
+        return nullptr;
+    }
+
+    Unmap();
+    head = (head + alignment - 1) / alignment * alignment;
+    if (head + bytes > regionSize)
+        NextRegion();
+
+    offset = region * regionSize + head;
+    head += bytes;
+
+    if (persistent)
+        return persistent + offset;
+
+    // Nothing the GPU may still read is in this range: the fences guarantee it.
+    bindBuffer(target, buffer);
+    mapped = true;
+    return glMapBufferRange(target, offset, bytes,
+                            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+
+void StreamBuffer::Unmap()
+{
+    if (!mapped)
+        return;
+    bindBuffer(target, buffer);
+    glUnmapBuffer(target);
+    mapped = false;
+}
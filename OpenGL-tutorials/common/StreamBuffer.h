@@ -0,0 +1,73 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ * A buffer for data rewritten every frame, split into `regions` equal parts used in turn.
+ *
+ * With ARB_buffer_storage the whole buffer is mapped once, persistent and coherent:
+ * Map() returns a pointer straight into GPU-visible memory, so writing the data is the
+ * upload and the driver makes no copy. Without it, each Map() is an unsynchronized
+ * glMapBufferRange of the requested range, closed by Unmap().
+ *
+ * Either way the driver does not track what the GPU still reads: a fence is placed when
+ * a region is left, and the region is only written again once that fence is signaled.
+ * With three regions the CPU may run up to two frames ahead before it waits.
+ */
+class StreamBuffer
+{
+public:
+    StreamBuffer();
+    ~StreamBuffer();
+
+    /**
+     * @param target Binding target used to map the buffer, e.g. GL_ARRAY_BUFFER.
+     * @param regionBytes Bytes written between two calls to NextRegion() at most.
+     * @param regions Number of regions; the GPU may lag regions - 1 of them behind.
+     */
+    bool Create(GLenum target, size_t regionBytes, unsigned int regions = 3);
+    void Destroy();
+
+    /**
+     * Reserves `bytes` in the current region and returns where to write them. `offset`
+     * receives their position in the buffer, for glVertexAttribPointer and the draws.
+     * A request that does not fit in what is left of the region moves to the next one.
+     * Returns nullptr if `bytes` is larger than a region.
+     */
+    void * Map(size_t bytes, size_t & offset, size_t alignment = 16);
+
+    /**
+     * Ends the writes of the last Map(). Only the fallback path has anything to do.
+     */
+    void Unmap();
+
+    /**
+     * Fences the current region and moves to the next one, waiting for the GPU to be
+     * done with it. Call once per frame after the draws reading this frame's data.
+     */
+    void NextRegion();
+
+    GLuint GetBuffer() const { return buffer; }
+    bool IsPersistent() const { return persistent != nullptr; }
+
+    // Number of times NextRegion() or Map() had to wait for the GPU.
+    unsigned int GetStalls() const { return stalls; }
+
+private:
+    void WaitRegion(unsigned int region);
+
+    GLenum target;
+    GLuint buffer;
+    unsigned char * persistent;  // Whole buffer, or nullptr on the glMapBufferRange path
+    bool mapped;
+    size_t regionSize;
+    unsigned int regions;
+    unsigned int region;
+    size_t head;                 // Bytes used in the current region
+    std::vector<GLsync> fences;  // One per region, 0 once waited for
+    unsigned int stalls;
+};
+
+#endif
@@ -1,5 +1,4 @@
 #include "Text2d.h"
-#include <vector>
 #include <cstring>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -7,13 +6,20 @@
 
 #include "Shader.h"
 #include "Texture.h"
+#include "GLState.h"
+#include "StreamBuffer.h"
+
+// Text vertices written per stream region before it is fenced and the next one used.
+#define TEXT2D_STREAM_BYTES (64 * 1024)
 
 
 unsigned int Text2DTextureID;
-unsigned int Text2DVertexBufferID;
-unsigned int Text2DUVBufferID;
+unsigned int Text2DVertexArrayID;
+StreamBuffer Text2DStream;
 unsigned int Text2DShaderID;
 unsigned int Text2DUniformID;
+bool Text2DOwnsTexture = true;
+AtlasRegion Text2DFontRegion = {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 1.0f)};
 
 
 void initText2D(const char * texturePath,
@@ -24,28 +30,56 @@ void initText2D(const char * texturePath,
 {
     // Initialize texture
     Text2DTextureID = loadDDS(texturePath);
+    Text2DOwnsTexture = true;
 
-    // Initialize VBO
-    glGenBuffers(1, &Text2DVertexBufferID);
-    glGenBuffers(1, &Text2DUVBufferID);
+    // Initialize VBO and the VAO reading it
+    Text2DStream.Create(GL_ARRAY_BUFFER, TEXT2D_STREAM_BYTES);
+    glGenVertexArrays(1, &Text2DVertexArrayID);
 
     // Initialize Shader
     Text2DShaderID = LoadShaders(vertex_filepath, fragment_filepath);
 
-    // Initialize uniforms' IDs
+    // Initialize uniforms' IDs. The font is always sampled from Texture Unit 0, so set it once.
     Text2DUniformID = glGetUniformLocation(Text2DShaderID, uniform_id);
+    glProgramUniform1i(Text2DShaderID, Text2DUniformID, 0);
 
 }
 
 
+void initText2D(const TextureAtlas & atlas,
+                const AtlasRegion & fontRegion,
+                const char * vertex_filepath,
+                const char * fragment_filepath,
+                const char * uniform_id
+)
+{
+    // Use the font stored in the atlas
+    Text2DTextureID = atlas.textureID;
+    Text2DOwnsTexture = false;
+    Text2DFontRegion = fontRegion;
+
+    Text2DStream.Create(GL_ARRAY_BUFFER, TEXT2D_STREAM_BYTES);
+    glGenVertexArrays(1, &Text2DVertexArrayID);
+    Text2DShaderID = LoadShaders(vertex_filepath, fragment_filepath);
+    Text2DUniformID = glGetUniformLocation(Text2DShaderID, uniform_id);
+    glProgramUniform1i(Text2DShaderID, Text2DUniformID, 0);
+}
+
+
 void printText2D(const char * text, int x, int y, int size)
 {
 
     unsigned int length = strlen(text);
-
-    // Fill buffers
-    std::vector<glm::vec2> vertices;
-    std::vector<glm::vec2> UVs;
+    if (length == 0)
+        return;
+
+    // Fill buffers: positions then UVs, written straight into the stream buffer
+    size_t vertexCount = length * 6;
+    size_t streamOffset;
+    glm::vec2 * vertices = static_cast<glm::vec2*>(Text2DStream.Map(2 * vertexCount * sizeof(glm::vec2), streamOffset));
+    if (!vertices)
+        return;
+    glm::vec2 * UVs = vertices + vertexCount;
     for (unsigned int i = 0 ; i < length; i++)
     {
         glm::vec2 vertex_up_left = glm::vec2(x + i * size, y + size);
@@ -53,75 +87,72 @@ void printText2D(const char * text, int x, int y, int size)
         glm::vec2 vertex_down_right = glm::vec2(x + i * size + size, y);
         glm::vec2 vertex_down_left = glm::vec2(x + i * size, y);
 
-        vertices.push_back(vertex_up_left);
-        vertices.push_back(vertex_down_left);
-        vertices.push_back(vertex_up_right);
+        *vertices++ = vertex_up_left;
+        *vertices++ = vertex_down_left;
+        *vertices++ = vertex_up_right;
 
-        vertices.push_back(vertex_down_right);
-        vertices.push_back(vertex_up_right);
-        vertices.push_back(vertex_down_left);
+        *vertices++ = vertex_down_right;
+        *vertices++ = vertex_up_right;
+        *vertices++ = vertex_down_left;
 
         char character = text[i];
         float uv_x = (character % 16) / 16.0f;
         float uv_y = (character / 16) / 16.0f;
 
-        glm::vec2 uv_up_left = glm::vec2(uv_x, uv_y);
-        glm::vec2 uv_up_right = glm::vec2(uv_x + 1.0f / 16.0f, uv_y);
-        glm::vec2 uv_down_right = glm::vec2(uv_x + 1.0f / 16.0f, (uv_y + 1.0f / 16.0f));
-        glm::vec2 uv_down_left = glm::vec2(uv_x, (uv_y + 1.0f / 16.0f));
-        UVs.push_back(uv_up_left);
-        UVs.push_back(uv_down_left);
-        UVs.push_back(uv_up_right);
-
-        UVs.push_back(uv_down_right);
-        UVs.push_back(uv_up_right);
-        UVs.push_back(uv_down_left);
+        // Font UVs are remapped into the font's atlas region (the whole texture by default)
+        glm::vec2 uv_up_left = remapAtlasUV(Text2DFontRegion, glm::vec2(uv_x, uv_y));
+        glm::vec2 uv_up_right = remapAtlasUV(Text2DFontRegion, glm::vec2(uv_x + 1.0f / 16.0f, uv_y));
+        glm::vec2 uv_down_right = remapAtlasUV(Text2DFontRegion, glm::vec2(uv_x + 1.0f / 16.0f, (uv_y + 1.0f / 16.0f)));
+        glm::vec2 uv_down_left = remapAtlasUV(Text2DFontRegion, glm::vec2(uv_x, (uv_y + 1.0f / 16.0f)));
+        *UVs++ = uv_up_left;
+        *UVs++ = uv_down_left;
+        *UVs++ = uv_up_right;
+
+        *UVs++ = uv_down_right;
+        *UVs++ = uv_up_right;
+        *UVs++ = uv_down_left;
     }
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-    glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
+    Text2DStream.Unmap();
 
     // Bind shader
-    glUseProgram(Text2DShaderID);
+    useProgram(Text2DShaderID);
+
+    // Bind texture in Texture Unit 0. The state cache skips the bind when the texture is
+    // already there, e.g. when the font shares the atlas bound by the scene.
+    bindTexture(0, GL_TEXTURE_2D, Text2DTextureID);
 
-    // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
-    // Set our "myTextureSampler" sampler to user Texture Unit 0
-    glUniform1i(Text2DUniformID, 0);
+    // The text has its own VAO; only the offsets into the stream change between calls.
+    bindVertexArray(Text2DVertexArrayID);
 
     // 1rst attribute buffer : vertices
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    GLsizei offset = static_cast<GLsizei>(streamOffset);
+    enableVertexAttribArray(0);
+    vertexAttribPointer(0, Text2DStream.GetBuffer(), 2, GL_FLOAT, GL_FALSE, 0, offset);
 
     // 2nd attribute buffer : UVs
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    enableVertexAttribArray(1);
+    vertexAttribPointer(1, Text2DStream.GetBuffer(), 2, GL_FLOAT, GL_FALSE, 0, offset + vertexCount * sizeof(glm::vec2));
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    enableCapability(GL_BLEND);
+    blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Draw call
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-    glDisable(GL_BLEND);
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+    disableCapability(GL_BLEND);
 }
 
 
 void cleanupText2D()
 {
     // Delete buffers
-    glDeleteBuffers(1, &Text2DVertexBufferID);
-    glDeleteBuffers(1, &Text2DUVBufferID);
+    Text2DStream.Destroy();
+    forgetVertexArray(Text2DVertexArrayID);
+    glDeleteVertexArrays(1, &Text2DVertexArrayID);
 
-    // Delete texture
-    glDeleteTextures(1, &Text2DTextureID);
+    // Delete texture, unless it belongs to a shared atlas
+    if (Text2DOwnsTexture)
+        deleteTexture(Text2DTextureID);
 
     // Delete shader
     glDeleteProgram(Text2DShaderID);
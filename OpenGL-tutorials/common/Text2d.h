@@ -1,10 +1,18 @@
 #ifndef TEXT2D_H
 #define TEXT2D_H
+#include "TextureAtlas.h"
 
 void initText2D(const char * texturePath,
                 const char * vertex_filepath,
                 const char * fragment_filepath,
                 const char * uniform_id);
+// Same as above, sampling the font from `fontRegion` of a shared atlas texture.
+// The atlas stays owned by the caller.
+void initText2D(const TextureAtlas & atlas,
+                const AtlasRegion & fontRegion,
+                const char * vertex_filepath,
+                const char * fragment_filepath,
+                const char * uniform_id);
 void printText2D(const char * text, int x, int y, int size);
 void cleanupText2D();
 
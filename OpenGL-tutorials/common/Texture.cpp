@@ -1,29 +1,34 @@
 #include "Texture.h"
+#include "TextureResidency.h"
+#include "GLState.h"
+#include "Assets.h"
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 
-GLuint loadBMP_custom(const char * imagepath)
+// Reads an uncompressed 24-bit BMP file into `data` (BGR, bottom-up rows).
+bool readBMP(const char * imagepath, unsigned int & width, unsigned int & height, std::vector<unsigned char> & data)
 {
     // Data read from the header of the BMP file
-    unsigned char header[54]; // Each BMP file begins by a 54-bytes header
+    unsigned char * header;   // Each BMP file begins by a 54-bytes header
     unsigned int dataPos;     // Position in the file where the actual data begins
-    unsigned int width, height;
     unsigned int imageSize;   // = width*height*3
 
-    // Actual RGB data
-    unsigned char * data;
-
-    FILE * file = fopen(imagepath,"rb");
-    if (!file)
+    std::vector<unsigned char> file;
+    if (!readAsset(imagepath, file))
     {
         std::cout << "Image could not be opened." << std::endl;
-        return 0;
+        return false;
     }
 
-    if ((fread(header, 1, 54, file) != 54) || (header[0] != 'B' || header[1] != 'M'))
+    if (file.size() < 54 || file[0] != 'B' || file[1] != 'M')
     {
         std::cout << "Not a correct BMP file." << std::endl;
-        return 0;
+        return false;
     }
+    header = &file[0];
 
     dataPos   = *(int*)&(header[0x0A]);
     imageSize = *(int*)&(header[0x22]);
@@ -36,14 +41,24 @@ GLuint loadBMP_custom(const char * imagepath)
     // The BMP header is done that way
     if (dataPos == 0)   dataPos = 54;
 
-    // Create a buffer
-    data = new unsigned char [imageSize];
+    if (dataPos > file.size() || imageSize > file.size() - dataPos)
+    {
+        std::cout << "Not a correct BMP file." << std::endl;
+        return false;
+    }
+
+    // Copy the pixels out of the file buffer
+    data.assign(file.begin() + dataPos, file.begin() + dataPos + imageSize);
+    return true;
+}
 
-    // Read the actual data from the file into the buffer
-    fread(data,1,imageSize,file);
 
-    //Everything is in memory now, the file can be closed
-    fclose(file);
+GLuint loadBMP_custom(const char * imagepath)
+{
+    unsigned int width, height;
+    std::vector<unsigned char> data;
+    if (!readBMP(imagepath, width, height, data))
+        return 0;
 
     // Create one OpenGL texture
     GLuint textureID;
@@ -53,68 +68,82 @@ GLuint loadBMP_custom(const char * imagepath)
     glBindTexture(GL_TEXTURE_2D, textureID);
 
     // Give the image to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, &data[0]);
+
+    // Drivers usually pad RGB8 to 4 bytes per texel.
+    registerTexture(textureID, imagepath, TEXTURE_SOURCE::BMP, width, height,
+                    std::vector<size_t>(1, static_cast<size_t>(width) * height * 4));
 
     return textureID;
 }
 
 
-GLuint loadDDS(const char * imagepath) {
+// Reads a DXT1/3/5 DDS file with all its mipmaps into `image`.
+bool readDDS(const char * imagepath, DDSImage & image)
+{
+    std::vector<unsigned char> file;
 
-    unsigned char header[124];
-    FILE *fp;
-
-    // Try to open the file.
-    fp = fopen(imagepath, "rb");
-    if (fp == NULL)
-        return 0;
+    // Try to read the file.
+    if (!readAsset(imagepath, file) || file.size() < 4 + 124)
+        return false;
 
     // Verify the type of file.
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        return 0;
-    }
+    if (strncmp(reinterpret_cast<const char*>(&file[0]), "DDS ", 4) != 0)
+        return false;
 
     // Get the surface desc.
-    fread(&header, 124, 1, fp);
+    const unsigned char * header = &file[4];
 
-    unsigned int height      = *(unsigned int*)&(header[8 ]);
-    unsigned int width       = *(unsigned int*)&(header[12]);
+    image.height             = *(unsigned int*)&(header[8 ]);
+    image.width              = *(unsigned int*)&(header[12]);
     unsigned int linearSize  = *(unsigned int*)&(header[16]);
-    unsigned int mipMapCount = *(unsigned int*)&(header[24]);
+    image.mipMapCount        = *(unsigned int*)&(header[24]);
     unsigned int fourCC      = *(unsigned int*)&(header[80]);
 
-    unsigned char * buffer;
-    unsigned int bufsize;
-    // How big is it going to be including all mipmaps?
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-
-    // Close the file pointer.
-    fclose(fp);
-
-    unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
     switch(fourCC)
     {
         case FOURCC_DXT1:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
             break;
         case FOURCC_DXT3:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
             break;
         case FOURCC_DXT5:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
             break;
         default:
-            free(buffer);
-            return 0;
+            return false;
+    }
+    image.blockSize = (image.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+
+    // How big is it going to be including all mipmaps?
+    size_t bufsize = image.mipMapCount > 1 ? linearSize * 2 : linearSize;
+    size_t available = std::min(bufsize, file.size() - 4 - 124);
+    image.data.assign(file.begin() + 4 + 124, file.begin() + 4 + 124 + available);
+    image.data.resize(bufsize);
+    return true;
+}
+
+
+// Byte offset of a mipmap level inside a DDS image.
+unsigned int getDDSLevelOffset(const DDSImage & image, unsigned int level)
+{
+    unsigned int offset = 0;
+    for (unsigned int l = 0; l < level; l++)
+    {
+        unsigned int width = std::max(image.width >> l, 1u);
+        unsigned int height = std::max(image.height >> l, 1u);
+        offset += ((width + 3) / 4) * ((height + 3) / 4) * image.blockSize;
     }
+    return offset;
+}
+
+
+GLuint loadDDS(const char * imagepath) {
+
+    DDSImage image;
+    if (!readDDS(imagepath, image))
+        return 0;
 
     // Create one OpenGL texture.
     GLuint textureID;
@@ -123,25 +152,332 @@ GLuint loadDDS(const char * imagepath) {
     // "Bind" the newly created texture: all future texture functions will modify this texture.
     glBindTexture(GL_TEXTURE_2D, textureID);
 
-    unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+    unsigned int width = image.width;
+    unsigned int height = image.height;
     unsigned int offset = 0;
+    std::vector<size_t> levelSizes;
 
     // Load the mipmaps.
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+    for (unsigned int level = 0; level < image.mipMapCount && (width || height); ++level)
     {
         if(width < 1)
             width = 1;
         if(height < 1)
             height = 1;
 
-        unsigned int size = ((width+3)/4) * ((height+3) / 4) * blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, size, buffer + offset);
+        unsigned int size = ((width+3)/4) * ((height+3) / 4) * image.blockSize;
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, width, height, 0, size, &image.data[offset]);
+        levelSizes.push_back(size);
 
         offset += size;
         width  /= 2;
         height /= 2;
     }
-    free(buffer);
+
+    registerTexture(textureID, imagepath, TEXTURE_SOURCE::DDS, image.width, image.height, levelSizes);
 
     return textureID;
-}
\ No newline at end of file
+}
+
+
+void deleteTexture(GLuint texture_id)
+{
+    unregisterTexture(texture_id);
+    forgetTexture(texture_id);
+    glDeleteTextures(1, &texture_id);
+}
+
+
+GLuint loadDDSArray(const std::vector<std::string> & imagepaths)
+{
+    std::vector<DDSImage> images(imagepaths.size());
+    unsigned int mipMapCount = 0;
+    for (size_t i = 0; i < imagepaths.size(); i++)
+    {
+        if (!readDDS(imagepaths[i].c_str(), images[i]))
+            return 0;
+        if (images[i].width != images[0].width || images[i].height != images[0].height ||
+            images[i].format != images[0].format)
+        {
+            std::cout << "Texture array layer " << imagepaths[i] << " does not match the first layer." << std::endl;
+            return 0;
+        }
+        mipMapCount = i == 0 ? images[i].mipMapCount : std::min(mipMapCount, images[i].mipMapCount);
+    }
+    if (images.empty())
+        return 0;
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+    GLsizei layers = static_cast<GLsizei>(images.size());
+    std::vector<unsigned char> level_data;
+
+    // Each mipmap level holds the matching level of every layer, one after the other.
+    for (unsigned int level = 0; level < mipMapCount; ++level)
+    {
+        unsigned int width = std::max(images[0].width >> level, 1u);
+        unsigned int height = std::max(images[0].height >> level, 1u);
+        unsigned int size = ((width+3)/4) * ((height+3) / 4) * images[0].blockSize;
+
+        level_data.resize(size * layers);
+        for (size_t i = 0; i < images.size(); i++)
+            memcpy(&level_data[size * i], &images[i].data[getDDSLevelOffset(images[i], level)], size);
+
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, images[0].format, width, height, layers, 0,
+                               size * layers, &level_data[0]);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipMapCount - 1);
+
+    return textureID;
+}
+
+
+GLuint loadBMPArray(const std::vector<std::string> & imagepaths)
+{
+    unsigned int width = 0, height = 0, layer_size = 0;
+    std::vector<unsigned char> layer_data;
+    std::vector<unsigned char> data;
+    for (size_t i = 0; i < imagepaths.size(); i++)
+    {
+        unsigned int layer_width, layer_height;
+        if (!readBMP(imagepaths[i].c_str(), layer_width, layer_height, data))
+            return 0;
+        if (i == 0)
+        {
+            width = layer_width;
+            height = layer_height;
+            // BMP rows are padded to 4 bytes, like GL's default unpack alignment.
+            layer_size = ((width * 3 + 3) / 4) * 4 * height;
+            layer_data.resize(layer_size * imagepaths.size());
+        }
+        else if (layer_width != width || layer_height != height)
+        {
+            std::cout << "Texture array layer " << imagepaths[i] << " does not match the first layer." << std::endl;
+            return 0;
+        }
+        memcpy(&layer_data[layer_size * i], &data[0], std::min<size_t>(layer_size, data.size()));
+    }
+    if (imagepaths.empty())
+        return 0;
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width, height, static_cast<GLsizei>(imagepaths.size()), 0,
+                 GL_BGR, GL_UNSIGNED_BYTE, &layer_data[0]);
+
+    return textureID;
+}
+
+
+// Decodes the 4x4 texels of a DXT color block (the first 8 bytes of a DXT1 block,
+// the last 8 bytes of a DXT3/DXT5 block) into RGB triplets.
+static void decodeDXTColorBlock(const unsigned char * block, unsigned char rgb[16][3])
+{
+    unsigned int c0 = block[0] | (block[1] << 8);
+    unsigned int c1 = block[2] | (block[3] << 8);
+
+    unsigned char palette[4][3];
+    for (int i = 0; i < 2; i++)
+    {
+        unsigned int c = i == 0 ? c0 : c1;
+        palette[i][0] = static_cast<unsigned char>(((c >> 11) & 0x1F) * 255 / 31);
+        palette[i][1] = static_cast<unsigned char>(((c >> 5) & 0x3F) * 255 / 63);
+        palette[i][2] = static_cast<unsigned char>((c & 0x1F) * 255 / 31);
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        if (c0 > c1)
+        {
+            palette[2][k] = static_cast<unsigned char>((2 * palette[0][k] + palette[1][k]) / 3);
+            palette[3][k] = static_cast<unsigned char>((palette[0][k] + 2 * palette[1][k]) / 3);
+        }
+        else
+        {
+            palette[2][k] = static_cast<unsigned char>((palette[0][k] + palette[1][k]) / 2);
+            palette[3][k] = 0;
+        }
+    }
+
+    unsigned int indices = block[4] | (block[5] << 8) | (block[6] << 16) | (block[7] << 24);
+    for (int i = 0; i < 16; i++)
+    {
+        unsigned int index = (indices >> (2 * i)) & 0x3;
+        rgb[i][0] = palette[index][0];
+        rgb[i][1] = palette[index][1];
+        rgb[i][2] = palette[index][2];
+    }
+}
+
+
+// Encodes 16 single-channel texels as one BC4 (RGTC1) block:
+// two endpoints followed by sixteen 3-bit palette indices.
+static void encodeBC4Block(const unsigned char values[16], unsigned char * block)
+{
+    unsigned char lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        if (values[i] < lo) lo = values[i];
+        if (values[i] > hi) hi = values[i];
+    }
+
+    // hi > lo selects the 8-value interpolation mode.
+    unsigned int palette[8];
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int i = 1; i < 7; i++)
+        palette[i + 1] = ((7 - i) * hi + i * lo) / 7;
+
+    unsigned long long bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        unsigned int best = 0;
+        int bestError = 256;
+        for (unsigned int p = 0; p < 8; p++)
+        {
+            int error = abs(static_cast<int>(values[i]) - static_cast<int>(palette[p]));
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        bits |= static_cast<unsigned long long>(best) << (3 * i);
+    }
+
+    block[0] = hi;
+    block[1] = lo;
+    for (int i = 0; i < 6; i++)
+        block[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+}
+
+
+// Uploads a tightly packed RG8 image either as BC5 (RGTC2) or as plain RG8.
+static void uploadNormalRG(const std::vector<unsigned char> & rg, unsigned int width, unsigned int height, bool compress)
+{
+    if (!compress)
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, &rg[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return;
+    }
+
+    unsigned int blocksX = (width + 3) / 4;
+    unsigned int blocksY = (height + 3) / 4;
+    std::vector<unsigned char> blocks(blocksX * blocksY * 16);
+
+    for (unsigned int by = 0; by < blocksY; by++)
+    {
+        for (unsigned int bx = 0; bx < blocksX; bx++)
+        {
+            unsigned char red[16], green[16];
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                // Edge blocks of non multiple-of-4 images repeat the last row/column.
+                unsigned int x = std::min(bx * 4 + i % 4, width - 1);
+                unsigned int y = std::min(by * 4 + i / 4, height - 1);
+                red[i]   = rg[2 * (y * width + x) + 0];
+                green[i] = rg[2 * (y * width + x) + 1];
+            }
+            unsigned char * block = &blocks[16 * (by * blocksX + bx)];
+            encodeBC4Block(red, block);
+            encodeBC4Block(green, block + 8);
+        }
+    }
+
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RG_RGTC2, width, height, 0,
+                           static_cast<GLsizei>(blocks.size()), &blocks[0]);
+}
+
+
+GLuint loadBMP_normalRG(const char * imagepath, bool compress)
+{
+    unsigned int width, height;
+    std::vector<unsigned char> data;
+    if (!readBMP(imagepath, width, height, data))
+        return 0;
+
+    // Keep only X and Y: Z is rebuilt in the shader as sqrt(1 - x^2 - y^2).
+    std::vector<unsigned char> rg(width * height * 2);
+    for (unsigned int i = 0; i < width * height; i++)
+    {
+        rg[2 * i + 0] = data[3 * i + 2];  // BMP is stored as BGR
+        rg[2 * i + 1] = data[3 * i + 1];
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    uploadNormalRG(rg, width, height, compress);
+
+    std::cout << "Normal map " << imagepath << ": "
+              << (compress ? width * height : width * height * 2) / 1024 << " KiB as "
+              << (compress ? "BC5" : "RG8") << " instead of "
+              << width * height * 3 / 1024 << " KiB as RGB8." << std::endl;
+
+    return textureID;
+}
+
+
+GLuint loadBMP_normalRG_specular(const char * normalpath, const char * specularpath)
+{
+    unsigned int width, height;
+    std::vector<unsigned char> data;
+    if (!readBMP(normalpath, width, height, data))
+        return 0;
+
+    DDSImage specular;
+    if (!readDDS(specularpath, specular))
+        return 0;
+
+    if (specular.width != width || specular.height != height)
+    {
+        std::cout << "Specular map " << specularpath << " does not match the normal map size." << std::endl;
+        return 0;
+    }
+
+    // Normal X/Y in R/G, specular intensity of the top mip in B.
+    std::vector<unsigned char> rgb(width * height * 3);
+    for (unsigned int i = 0; i < width * height; i++)
+    {
+        rgb[3 * i + 0] = data[3 * i + 2];
+        rgb[3 * i + 1] = data[3 * i + 1];
+    }
+
+    // The color part of a DXT3/DXT5 block follows its 8 bytes of alpha.
+    unsigned int colorOffset = specular.blockSize == 16 ? 8 : 0;
+    unsigned int blocksX = (width + 3) / 4;
+    for (unsigned int by = 0; by < (height + 3) / 4; by++)
+    {
+        for (unsigned int bx = 0; bx < blocksX; bx++)
+        {
+            unsigned char texels[16][3];
+            decodeDXTColorBlock(&specular.data[(by * blocksX + bx) * specular.blockSize + colorOffset], texels);
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                // DDS rows are stored top-down, BMP rows bottom-up.
+                unsigned int x = bx * 4 + i % 4;
+                unsigned int y = by * 4 + i / 4;
+                if (x >= width || y >= height)
+                    continue;
+                unsigned int texel = (height - 1 - y) * width + x;
+                rgb[3 * texel + 2] = static_cast<unsigned char>((texels[i][0] + texels[i][1] + texels[i][2]) / 3);
+            }
+        }
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, &rgb[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    return textureID;
+}
@@ -1,6 +1,8 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 #include <iostream>
+#include <string>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
@@ -8,7 +10,40 @@
 #define FOURCC_DXT3 0x33545844  // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844  // Equivalent to "DXT5" in ASCII
 
+/**
+ * A DXT-compressed DDS image as read from disk, all mipmaps included.
+ */
+struct DDSImage
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int mipMapCount;
+    unsigned int format;     // GL_COMPRESSED_RGBA_S3TC_DXTn_EXT
+    unsigned int blockSize;  // Bytes per 4x4 block: 8 for DXT1, 16 for DXT3/DXT5
+    std::vector<unsigned char> data;
+};
+
+// The loaders only set texture state (images, mipmap range): filtering and wrapping
+// come from the sampler bound to the unit, see SamplerCache.h.
+bool readBMP(const char * imagepath, unsigned int & width, unsigned int & height, std::vector<unsigned char> & data);
+bool readDDS(const char * imagepath, DDSImage & image);
+unsigned int getDDSLevelOffset(const DDSImage & image, unsigned int level);
 GLuint loadBMP_custom(const char * imagepath);
 GLuint loadDDS(const char * imagepath);
 
+// Deletes a texture from the loaders above: forgets its residency registration and its
+// bindings in the GL state cache first, since GL may hand the name out again.
+void deleteTexture(GLuint texture_id);
+
+// Build a GL_TEXTURE_2D_ARRAY with one layer per image, in the given order.
+// All images must have the same size (and, for DDS, the same DXT format).
+GLuint loadDDSArray(const std::vector<std::string> & imagepaths);
+GLuint loadBMPArray(const std::vector<std::string> & imagepaths);
+
+// Loads a tangent-space normal map keeping only X and Y (Z is rebuilt in the shader),
+// as BC5 (1 byte per texel) or, when `compress` is false, as RG8 (2 bytes per texel).
+GLuint loadBMP_normalRG(const char * imagepath, bool compress = true);
+// Same as above as RGB8, with the specular intensity of a same-sized DDS packed in B.
+GLuint loadBMP_normalRG_specular(const char * normalpath, const char * specularpath);
+
 #endif
@@ -0,0 +1,253 @@
+#include "TextureAtlas.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Texture.h"
+
+
+// A horizontal segment of the skyline, in grid cells.
+struct SkylineNode
+{
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+};
+
+
+// Returns the lowest y at which a `width` cells wide rectangle fits when its
+// left edge is at skyline[index].x, or false if it overflows the atlas width.
+static bool skylineFit(const std::vector<SkylineNode> & skyline, size_t index,
+                       unsigned int width, unsigned int atlasWidth, unsigned int & y)
+{
+    if (skyline[index].x + width > atlasWidth)
+        return false;
+
+    int remaining = width;
+    y = 0;
+    for (size_t i = index; remaining > 0 && i < skyline.size(); i++)
+    {
+        y = std::max(y, skyline[i].y);
+        remaining -= skyline[i].width;
+    }
+    return true;
+}
+
+
+static void skylineInsert(std::vector<SkylineNode> & skyline, size_t index,
+                          unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    SkylineNode node = {x, y + height, width};
+    skyline.insert(skyline.begin() + index, node);
+
+    // Shrink or drop the nodes now covered by the new one.
+    for (size_t i = index + 1; i < skyline.size(); )
+    {
+        unsigned int end = skyline[i - 1].x + skyline[i - 1].width;
+        if (skyline[i].x >= end)
+            break;
+
+        unsigned int overlap = end - skyline[i].x;
+        if (overlap >= skyline[i].width)
+        {
+            skyline.erase(skyline.begin() + i);
+            continue;
+        }
+        skyline[i].x += overlap;
+        skyline[i].width -= overlap;
+        break;
+    }
+
+    // Merge neighbours at the same height.
+    for (size_t i = 0; i + 1 < skyline.size(); )
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+
+// Bottom-left skyline packing of `sizes` (in cells) into a strip `atlasWidth` cells wide.
+// Returns the used height.
+static unsigned int skylinePack(const std::vector<glm::ivec2> & sizes, const std::vector<size_t> & order,
+                                unsigned int atlasWidth, std::vector<glm::ivec2> & positions)
+{
+    std::vector<SkylineNode> skyline;
+    SkylineNode first = {0, 0, atlasWidth};
+    skyline.push_back(first);
+
+    unsigned int usedHeight = 0;
+    positions.resize(sizes.size());
+    for (size_t n = 0; n < order.size(); n++)
+    {
+        const glm::ivec2 & size = sizes[order[n]];
+
+        size_t bestIndex = skyline.size();
+        unsigned int bestY = 0;
+        for (size_t i = 0; i < skyline.size(); i++)
+        {
+            unsigned int y;
+            if (skylineFit(skyline, i, size.x, atlasWidth, y) && (bestIndex == skyline.size() || y < bestY))
+            {
+                bestIndex = i;
+                bestY = y;
+            }
+        }
+        if (bestIndex == skyline.size())
+            return 0;
+
+        positions[order[n]] = glm::ivec2(skyline[bestIndex].x, bestY);
+        skylineInsert(skyline, bestIndex, skyline[bestIndex].x, bestY, size.x, size.y);
+        usedHeight = std::max(usedHeight, bestY + size.y);
+    }
+    return usedHeight;
+}
+
+
+bool buildDDSAtlas(const std::vector<std::string> & imagepaths,
+                   TextureAtlas & atlas,
+                   unsigned int padding,
+                   unsigned int mipLevels)
+{
+    // Grid cell size keeping every placement block-aligned down to the last kept mip.
+    unsigned int align = 4u << (mipLevels - 1);
+    padding = (padding + align - 1) / align * align;
+
+    std::vector<DDSImage> images(imagepaths.size());
+    std::vector<glm::ivec2> cells(imagepaths.size());
+    unsigned int area = 0, widest = 0;
+    for (size_t i = 0; i < imagepaths.size(); i++)
+    {
+        if (!readDDS(imagepaths[i].c_str(), images[i]))
+        {
+            std::cout << "Atlas: " << imagepaths[i] << " is not a DXT DDS file." << std::endl;
+            return false;
+        }
+        const DDSImage & image = images[i];
+        if (image.format != images[0].format || image.mipMapCount < mipLevels ||
+            image.width % align != 0 || image.height % align != 0)
+        {
+            std::cout << "Atlas: " << imagepaths[i] << " must share the atlas format, have "
+                      << mipLevels << " mipmaps and a size multiple of " << align << "." << std::endl;
+            return false;
+        }
+        cells[i] = glm::ivec2((image.width + 2 * padding) / align, (image.height + 2 * padding) / align);
+        area += cells[i].x * cells[i].y;
+        widest = std::max(widest, static_cast<unsigned int>(cells[i].x));
+    }
+
+    // Tallest first gives the skyline packer its best results.
+    std::vector<size_t> order(images.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cells[a].y > cells[b].y; });
+
+    // Grow the strip width until the packing is no taller than wide.
+    std::vector<glm::ivec2> positions;
+    unsigned int widthCells = std::max(widest, static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(area)))));
+    unsigned int heightCells = skylinePack(cells, order, widthCells, positions);
+    while (heightCells > widthCells)
+    {
+        widthCells = std::max(widthCells + 1, widthCells * 5 / 4);
+        heightCells = skylinePack(cells, order, widthCells, positions);
+    }
+
+    atlas.width = widthCells * align;
+    atlas.height = heightCells * align;
+    atlas.mipLevels = mipLevels;
+    atlas.regions.clear();
+
+    GLenum format = images[0].format;
+    unsigned int blockSize = images[0].blockSize;
+
+    glGenTextures(1, &atlas.textureID);
+    glBindTexture(GL_TEXTURE_2D, atlas.textureID);
+
+    for (unsigned int level = 0; level < mipLevels; level++)
+    {
+        unsigned int levelWidth = atlas.width >> level;
+        unsigned int levelHeight = atlas.height >> level;
+        unsigned int atlasBlocksX = levelWidth / 4;
+        std::vector<unsigned char> blocks(atlasBlocksX * (levelHeight / 4) * blockSize, 0);
+
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            const DDSImage & image = images[i];
+            const unsigned char * source = &image.data[getDDSLevelOffset(image, level)];
+            int imageBlocksX = (image.width >> level) / 4;
+            int imageBlocksY = (image.height >> level) / 4;
+            int padBlocks = (padding >> level) / 4;
+
+            // The padded rectangle, in blocks of this level.
+            int rectX = ((positions[i].x * align) >> level) / 4;
+            int rectY = ((positions[i].y * align) >> level) / 4;
+            int rectW = ((cells[i].x * align) >> level) / 4;
+            int rectH = ((cells[i].y * align) >> level) / 4;
+
+            for (int by = 0; by < rectH; by++)
+            {
+                // Gutter blocks repeat the closest edge block of the image.
+                int sy = std::min(std::max(by - padBlocks, 0), imageBlocksY - 1);
+                for (int bx = 0; bx < rectW; bx++)
+                {
+                    int sx = std::min(std::max(bx - padBlocks, 0), imageBlocksX - 1);
+                    memcpy(&blocks[((rectY + by) * atlasBlocksX + rectX + bx) * blockSize],
+                           &source[(sy * imageBlocksX + sx) * blockSize],
+                           blockSize);
+                }
+            }
+        }
+
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, levelWidth, levelHeight, 0,
+                               static_cast<GLsizei>(blocks.size()), &blocks[0]);
+    }
+    // Only the block-aligned mipmaps were uploaded.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        AtlasRegion region;
+        region.uvMin = glm::vec2(
+            static_cast<float>(positions[i].x * align + padding) / atlas.width,
+            static_cast<float>(positions[i].y * align + padding) / atlas.height
+        );
+        region.uvSize = glm::vec2(
+            static_cast<float>(images[i].width) / atlas.width,
+            static_cast<float>(images[i].height) / atlas.height
+        );
+        atlas.regions[imagepaths[i]] = region;
+    }
+
+    std::cout << "Atlas: " << images.size() << " images packed into " << atlas.width << "x" << atlas.height
+              << ", " << images.size() << " texture binds -> 1." << std::endl;
+
+    return true;
+}
+
+
+glm::vec2 remapAtlasUV(const AtlasRegion & region, const glm::vec2 & uv)
+{
+    return glm::vec2(region.uvMin.x + uv.x * region.uvSize.x, region.uvMin.y + uv.y * region.uvSize.y);
+}
+
+
+glm::vec4 atlasRect(const AtlasRegion & region)
+{
+    return glm::vec4(region.uvMin.x, region.uvMin.y, region.uvSize.x, region.uvSize.y);
+}
+
+
+void deleteAtlas(TextureAtlas & atlas)
+{
+    glDeleteTextures(1, &atlas.textureID);
+    atlas.textureID = 0;
+    atlas.regions.clear();
+}
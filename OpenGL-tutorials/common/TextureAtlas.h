@@ -0,0 +1,47 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * Placement of one source image inside an atlas, in atlas UV space.
+ */
+struct AtlasRegion
+{
+    glm::vec2 uvMin;
+    glm::vec2 uvSize;
+};
+
+/**
+ * Several DDS images packed into a single compressed texture.
+ */
+struct TextureAtlas
+{
+    GLuint textureID;
+    unsigned int width;
+    unsigned int height;
+    unsigned int mipLevels;
+    std::map<std::string, AtlasRegion> regions;  // Keyed by source image path
+};
+
+// Packs DXT images of the same format into one texture with a skyline packer.
+// Every image is surrounded by `padding` texels of replicated edge blocks and placed
+// on a grid coarse enough that its first `mipLevels` mipmaps stay block-aligned,
+// so lower mips neither bleed into neighbours nor need re-compression.
+bool buildDDSAtlas(const std::vector<std::string> & imagepaths,
+                   TextureAtlas & atlas,
+                   unsigned int padding = 32,
+                   unsigned int mipLevels = 4);
+
+// Maps a UV in [0, 1] of a source image to the matching atlas UV.
+glm::vec2 remapAtlasUV(const AtlasRegion & region, const glm::vec2 & uv);
+
+// Returns (uvMin, uvSize) packed as the "AtlasRect" shader uniform expects it.
+glm::vec4 atlasRect(const AtlasRegion & region);
+
+void deleteAtlas(TextureAtlas & atlas);
+
+#endif
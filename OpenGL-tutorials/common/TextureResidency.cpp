@@ -0,0 +1,374 @@
+#include "TextureResidency.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "Texture.h"
+#include "GLState.h"
+
+
+struct ResidentTexture
+{
+    std::string path;
+    TEXTURE_SOURCE source;
+    unsigned int width;
+    unsigned int height;
+    std::vector<size_t> levelSizes;  // Bytes of each mipmap level at full resolution
+    unsigned int droppedLevels;      // Number of finest levels currently evicted
+    int requestedLevels;             // droppedLevels of the read in flight, -1 when none
+    unsigned long long lastUsedFrame;
+    unsigned int registration;       // Tells apart textures registered under a reused name
+};
+
+
+/**
+ * A texture re-specification: the loader thread reads the file and prepares the levels
+ * from `firstLevel` on, enforceTextureBudget() uploads them on the GL thread.
+ */
+struct TextureLoad
+{
+    GLuint texture;
+    unsigned int registration;
+    std::string path;
+    TEXTURE_SOURCE source;
+    unsigned int firstLevel;
+    bool ok;
+    unsigned int width;               // BMP, after downsampling
+    unsigned int height;
+    std::vector<unsigned char> data;  // BMP texels
+    DDSImage image;                   // DDS, every level
+};
+
+
+std::unordered_map<GLuint, ResidentTexture> ResidentTextures;
+size_t TextureBudgetBytes = 0;
+unsigned long long TextureFrame = 0;
+unsigned int TextureEvictions = 0;
+unsigned int TextureReuploads = 0;
+unsigned int TextureRegistrations = 0;
+
+std::thread TextureLoaderThread;
+std::mutex TextureLoaderMutex;
+std::condition_variable TextureLoaderCondition;
+std::deque<TextureLoad> TextureLoadRequests;
+std::vector<TextureLoad> TextureLoadsDone;
+std::atomic<bool> TextureLoaderRunning(false);
+
+
+static size_t residentBytes(const ResidentTexture & texture, unsigned int dropped_levels)
+{
+    // A BMP has a single level, downsampled once per dropped level.
+    if (texture.source == TEXTURE_SOURCE::BMP)
+        return texture.levelSizes[0] >> (2 * dropped_levels);
+
+    size_t bytes = 0;
+    for (size_t level = dropped_levels; level < texture.levelSizes.size(); level++)
+        bytes += texture.levelSizes[level];
+    return bytes;
+}
+
+
+// Levels dropped once the read in flight, if any, is uploaded.
+static unsigned int targetLevels(const ResidentTexture & texture)
+{
+    return texture.requestedLevels >= 0 ? static_cast<unsigned int>(texture.requestedLevels) : texture.droppedLevels;
+}
+
+
+static bool canDropLevel(const ResidentTexture & texture, unsigned int dropped_levels)
+{
+    if (texture.source == TEXTURE_SOURCE::BMP)
+        return (texture.width >> (dropped_levels + 1)) > 0 && (texture.height >> (dropped_levels + 1)) > 0;
+    return dropped_levels + 1 < texture.levelSizes.size();
+}
+
+
+// Halves a BGR image with a 2x2 box filter. Rows are padded to 4 bytes as in BMP files.
+static void downsampleBGR(std::vector<unsigned char> & data, unsigned int & width, unsigned int & height)
+{
+    unsigned int rowSize = (width * 3 + 3) / 4 * 4;
+    unsigned int halfWidth = std::max(width / 2, 1u);
+    unsigned int halfHeight = std::max(height / 2, 1u);
+    unsigned int halfRowSize = (halfWidth * 3 + 3) / 4 * 4;
+
+    std::vector<unsigned char> half(halfRowSize * halfHeight, 0);
+    for (unsigned int y = 0; y < halfHeight; y++)
+    {
+        unsigned int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (unsigned int x = 0; x < halfWidth; x++)
+        {
+            unsigned int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                half[y * halfRowSize + 3 * x + k] = static_cast<unsigned char>((
+                    data[y0 * rowSize + 3 * x0 + k] + data[y0 * rowSize + 3 * x1 + k] +
+                    data[y1 * rowSize + 3 * x0 + k] + data[y1 * rowSize + 3 * x1 + k] + 2) / 4);
+            }
+        }
+    }
+    data.swap(half);
+    width = halfWidth;
+    height = halfHeight;
+}
+
+
+// Loader thread: reads the source files, so neither binds nor the budget wait on disk.
+static void textureLoaderLoop()
+{
+    while (true)
+    {
+        TextureLoad load;
+        {
+            std::unique_lock<std::mutex> lock(TextureLoaderMutex);
+            TextureLoaderCondition.wait(lock, [] { return !TextureLoaderRunning || !TextureLoadRequests.empty(); });
+            if (!TextureLoaderRunning)
+                return;
+            load = std::move(TextureLoadRequests.front());
+            TextureLoadRequests.pop_front();
+        }
+
+        if (load.source == TEXTURE_SOURCE::BMP)
+        {
+            load.ok = readBMP(load.path.c_str(), load.width, load.height, load.data);
+            for (unsigned int level = 0; load.ok && level < load.firstLevel; level++)
+                downsampleBGR(load.data, load.width, load.height);
+        }
+        else
+        {
+            load.ok = readDDS(load.path.c_str(), load.image);
+        }
+
+        std::lock_guard<std::mutex> lock(TextureLoaderMutex);
+        TextureLoadsDone.push_back(std::move(load));
+    }
+}
+
+
+// Asks the loader thread for the texture starting from `first_level` of its source file.
+static void requestLevels(GLuint texture_id, ResidentTexture & texture, unsigned int first_level)
+{
+    if (!TextureLoaderRunning)
+    {
+        TextureLoaderRunning = true;
+        TextureLoaderThread = std::thread(textureLoaderLoop);
+    }
+
+    texture.requestedLevels = static_cast<int>(first_level);
+    {
+        // A read of the same texture not started yet is retargeted rather than repeated.
+        std::lock_guard<std::mutex> lock(TextureLoaderMutex);
+        for (size_t i = 0; i < TextureLoadRequests.size(); i++)
+        {
+            if (TextureLoadRequests[i].texture == texture_id)
+            {
+                TextureLoadRequests[i].firstLevel = first_level;
+                return;
+            }
+        }
+
+        TextureLoad load;
+        load.texture = texture_id;
+        load.registration = texture.registration;
+        load.path = texture.path;
+        load.source = texture.source;
+        load.firstLevel = first_level;
+        load.ok = false;
+        TextureLoadRequests.push_back(std::move(load));
+    }
+    TextureLoaderCondition.notify_one();
+}
+
+
+// Re-specifies the texture from the levels read by the loader thread, `firstLevel`
+// becoming level 0. Texture IDs, and thus every caller, stay the same. The bind goes
+// through the GL state cache, which keeps track of what unit 0 holds afterwards.
+static void uploadLevels(const TextureLoad & load, const ResidentTexture & texture)
+{
+    bindTexture(0, GL_TEXTURE_2D, load.texture);
+
+    if (load.source == TEXTURE_SOURCE::BMP)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, load.width, load.height, 0, GL_BGR, GL_UNSIGNED_BYTE, &load.data[0]);
+        return;
+    }
+
+    const DDSImage & image = load.image;
+    unsigned int levels = static_cast<unsigned int>(texture.levelSizes.size());
+    for (unsigned int level = load.firstLevel; level < levels; level++)
+    {
+        unsigned int width = std::max(image.width >> level, 1u);
+        unsigned int height = std::max(image.height >> level, 1u);
+        unsigned int size = ((width+3)/4) * ((height+3) / 4) * image.blockSize;
+        glCompressedTexImage2D(GL_TEXTURE_2D, level - load.firstLevel, image.format, width, height, 0,
+                               size, &image.data[getDDSLevelOffset(image, level)]);
+    }
+    // Release the now unused coarsest levels.
+    for (unsigned int level = levels - load.firstLevel; level < levels; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - load.firstLevel - 1);
+}
+
+
+void registerTexture(GLuint texture_id, const char * imagepath, TEXTURE_SOURCE source,
+                     unsigned int width, unsigned int height, const std::vector<size_t> & level_sizes)
+{
+    ResidentTexture texture;
+    texture.path = imagepath;
+    texture.source = source;
+    texture.width = width;
+    texture.height = height;
+    texture.levelSizes = level_sizes;
+    texture.droppedLevels = 0;
+    texture.requestedLevels = -1;
+    texture.lastUsedFrame = TextureFrame;
+    texture.registration = ++TextureRegistrations;
+    ResidentTextures[texture_id] = texture;
+}
+
+
+void unregisterTexture(GLuint texture_id)
+{
+    ResidentTextures.erase(texture_id);
+
+    // Reads already started are skipped on completion, even if the name is registered again.
+    std::lock_guard<std::mutex> lock(TextureLoaderMutex);
+    for (std::deque<TextureLoad>::iterator it = TextureLoadRequests.begin(); it != TextureLoadRequests.end(); )
+    {
+        if (it->texture == texture_id)
+            it = TextureLoadRequests.erase(it);
+        else
+            ++it;
+    }
+}
+
+
+void setTextureBudget(size_t bytes)
+{
+    TextureBudgetBytes = bytes;
+}
+
+
+void touchTexture(GLuint texture_id)
+{
+    std::unordered_map<GLuint, ResidentTexture>::iterator it = ResidentTextures.find(texture_id);
+    if (it == ResidentTextures.end())
+        return;
+
+    // The restore is only requested here: until it is uploaded the texture is drawn
+    // with the levels it has, which a mipmapped sampler handles like a coarser LOD.
+    ResidentTexture & texture = it->second;
+    texture.lastUsedFrame = TextureFrame;
+    if (targetLevels(texture) > 0)
+        requestLevels(texture_id, texture, 0);
+}
+
+
+void bindTexture2D(GLuint unit, GLuint texture_id)
+{
+    touchTexture(texture_id);
+    bindTexture(unit, GL_TEXTURE_2D, texture_id);
+}
+
+
+void enforceTextureBudget()
+{
+    std::vector<TextureLoad> done;
+    {
+        std::lock_guard<std::mutex> lock(TextureLoaderMutex);
+        done.swap(TextureLoadsDone);
+    }
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        // Skip the reads superseded by a later request, or whose texture was deleted.
+        std::unordered_map<GLuint, ResidentTexture>::iterator it = ResidentTextures.find(done[i].texture);
+        if (it == ResidentTextures.end() || it->second.registration != done[i].registration ||
+            it->second.requestedLevels != static_cast<int>(done[i].firstLevel))
+            continue;
+
+        ResidentTexture & texture = it->second;
+        texture.requestedLevels = -1;
+        if (!done[i].ok || done[i].firstLevel == texture.droppedLevels)
+            continue;
+        uploadLevels(done[i], texture);
+        if (done[i].firstLevel > texture.droppedLevels)
+            TextureEvictions += done[i].firstLevel - texture.droppedLevels;
+        else if (done[i].firstLevel == 0)
+            TextureReuploads++;
+        texture.droppedLevels = done[i].firstLevel;
+    }
+
+    if (TextureBudgetBytes > 0)
+    {
+        // Counted as if the reads in flight were already uploaded, so that the same
+        // level is not requested twice.
+        size_t resident = 0;
+        for (std::unordered_map<GLuint, ResidentTexture>::const_iterator it = ResidentTextures.begin();
+             it != ResidentTextures.end(); ++it)
+        {
+            resident += residentBytes(it->second, targetLevels(it->second));
+        }
+        while (resident > TextureBudgetBytes)
+        {
+            // Least recently used texture that still has a level to give, not used this frame.
+            std::unordered_map<GLuint, ResidentTexture>::iterator victim = ResidentTextures.end();
+            for (std::unordered_map<GLuint, ResidentTexture>::iterator it = ResidentTextures.begin();
+                 it != ResidentTextures.end(); ++it)
+            {
+                if (it->second.lastUsedFrame < TextureFrame && canDropLevel(it->second, targetLevels(it->second)) &&
+                    (victim == ResidentTextures.end() || it->second.lastUsedFrame < victim->second.lastUsedFrame))
+                {
+                    victim = it;
+                }
+            }
+            if (victim == ResidentTextures.end())
+                break;
+
+            unsigned int levels = targetLevels(victim->second);
+            requestLevels(victim->first, victim->second, levels + 1);
+            resident -= residentBytes(victim->second, levels) - residentBytes(victim->second, levels + 1);
+        }
+    }
+    TextureFrame++;
+}
+
+
+void shutdownTextureResidency()
+{
+    if (TextureLoaderRunning)
+    {
+        {
+            std::lock_guard<std::mutex> lock(TextureLoaderMutex);
+            TextureLoaderRunning = false;
+        }
+        TextureLoaderCondition.notify_all();
+        TextureLoaderThread.join();
+    }
+    TextureLoadRequests.clear();
+    TextureLoadsDone.clear();
+    ResidentTextures.clear();
+}
+
+
+TextureResidencyStats getTextureResidencyStats()
+{
+    TextureResidencyStats stats;
+    stats.residentBytes = 0;
+    stats.loading = 0;
+    for (std::unordered_map<GLuint, ResidentTexture>::const_iterator it = ResidentTextures.begin();
+         it != ResidentTextures.end(); ++it)
+    {
+        stats.residentBytes += residentBytes(it->second, it->second.droppedLevels);
+        if (it->second.requestedLevels >= 0)
+            stats.loading++;
+    }
+    stats.budgetBytes = TextureBudgetBytes;
+    stats.textures = static_cast<unsigned int>(ResidentTextures.size());
+    stats.evictions = TextureEvictions;
+    stats.reuploads = TextureReuploads;
+    return stats;
+}
@@ -0,0 +1,55 @@
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ * File format a registered texture can be reloaded from.
+ */
+enum class TEXTURE_SOURCE
+{
+    BMP,
+    DDS,
+};
+
+/**
+ * Counters of the texture residency manager.
+ */
+struct TextureResidencyStats
+{
+    size_t residentBytes;    // Bytes of all registered textures at their current resolution
+    size_t budgetBytes;      // 0 when no budget is set
+    unsigned int textures;
+    unsigned int evictions;  // Mipmap levels dropped since startup
+    unsigned int reuploads;  // Textures restored to full resolution since startup
+    unsigned int loading;    // Textures with a read in flight
+};
+
+// Called by the loaders: records a texture, its source file and the size of each mipmap level.
+void registerTexture(GLuint texture_id, const char * imagepath, TEXTURE_SOURCE source,
+                     unsigned int width, unsigned int height, const std::vector<size_t> & level_sizes);
+// Called by deleteTexture(): every texture registered here must be deleted through it.
+void unregisterTexture(GLuint texture_id);
+
+// Sets the GPU memory budget for registered textures, in bytes (0 disables it).
+void setTextureBudget(size_t bytes);
+
+// Marks a texture as used this frame. If it lost mipmaps, a loader thread reads them
+// back and the next enforceTextureBudget() uploads them: nothing here waits on disk.
+void touchTexture(GLuint texture_id);
+
+// Binds a texture to a texture unit, through the GL state cache, and marks it as used.
+void bindTexture2D(GLuint unit, GLuint texture_id);
+
+// Call once per frame, after the draws: uploads what the loader thread has read, then,
+// while over budget, has the finest mipmap of the least recently used texture not used
+// in this frame dropped. Uploads bind texture unit 0 through the GL state cache.
+void enforceTextureBudget();
+
+// Stops the loader thread and forgets every registered texture.
+void shutdownTextureResidency();
+
+TextureResidencyStats getTextureResidencyStats();
+
+#endif
@@ -0,0 +1,20 @@
+// Uniform blocks shared by every program, matching FrameUniforms and ObjectUniforms
+// in UniformBuffers.h. Include it after #version.
+
+// Written once per frame.
+layout(std140) uniform FrameUniforms
+{
+	mat4 View;
+	mat4 Projection;
+	vec4 CameraPosition_worldspace;
+	vec4 Light_worldspace;  // Position, or direction towards the light when w = 0
+	vec4 LightColor;        // RGB, power in w
+};
+
+// Written once per draw.
+layout(std140) uniform ObjectUniforms
+{
+	mat4 Model;
+	mat4 ModelViewProjection;
+	mat4 ShadowMatrix;  // Model to shadow map texture space
+};
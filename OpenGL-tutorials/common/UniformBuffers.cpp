@@ -0,0 +1,122 @@
+#include "UniformBuffers.h"
+#include <iostream>
+
+#include "GLState.h"
+
+
+void bindUniformBlocks(GLuint program_id)
+{
+    GLuint frameBlock = glGetUniformBlockIndex(program_id, "FrameUniforms");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program_id, frameBlock, FRAME_UNIFORM_BINDING);
+
+    GLuint objectBlock = glGetUniformBlockIndex(program_id, "ObjectUniforms");
+    if (objectBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program_id, objectBlock, OBJECT_UNIFORM_BINDING);
+}
+
+
+UniformRing::UniformRing()
+    : buffer(0),
+      segmentSize(0),
+      alignment(256),
+      head(0),
+      frames(0),
+      frame(0),
+      stalls(0)
+{
+}
+
+
+UniformRing::~UniformRing()
+{
+    Destroy();
+}
+
+
+bool UniformRing::Create(size_t frameBytes, unsigned int frames)
+{
+    Destroy();
+
+    GLint offsetAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    alignment = static_cast<size_t>(offsetAlignment);
+
+    this->frames = frames;
+    segmentSize = (frameBytes + alignment - 1) / alignment * alignment;
+    head = 0;
+    frame = 0;
+    fences.assign(frames, 0);
+    stalls = 0;
+
+    glGenBuffers(1, &buffer);
+    bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, segmentSize * frames, NULL, GL_DYNAMIC_DRAW);
+    return true;
+}
+
+
+void UniformRing::Destroy()
+{
+    if (buffer)
+    {
+        forgetBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    for (size_t i = 0; i < fences.size(); i++)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    }
+    fences.clear();
+}
+
+
+void UniformRing::WaitSegment(unsigned int segment)
+{
+    GLsync fence = fences[segment];
+    if (!fence)
+        return;
+
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        stalls++;
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+    }
+    glDeleteSync(fence);
+    fences[segment] = 0;
+}
+
+
+void UniformRing::BeginFrame()
+{
+    if (fences[frame])
+        glDeleteSync(fences[frame]);
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    frame = (frame + 1) % frames;
+    head = 0;
+    WaitSegment(frame);
+}
+
+
+bool UniformRing::Push(GLuint binding, const void * data, size_t size)
+{
+    if (head + size > segmentSize)
+    {
+        std::cout << "UniformRing: frame segment of " << segmentSize << " bytes is full." << std::endl;
+        return false;
+    }
+
+    GLintptr offset = static_cast<GLintptr>(frame * segmentSize + head);
+    bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+
+    head += (size + alignment - 1) / alignment * alignment;
+    return true;
+}
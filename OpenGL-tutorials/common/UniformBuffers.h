@@ -0,0 +1,90 @@
+#ifndef UNIFORMBUFFERS_H
+#define UNIFORMBUFFERS_H
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Binding points of the blocks declared in UniformBlocks.glsl.
+#define FRAME_UNIFORM_BINDING 0
+#define OBJECT_UNIFORM_BINDING 1
+
+/**
+ * The "FrameUniforms" block, std140: written once per frame, read by every program.
+ */
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 cameraPosition;  // World space, w unused
+    glm::vec4 light;           // World space position, or direction towards the light when w = 0
+    glm::vec4 lightColor;      // RGB, power in w
+};
+
+/**
+ * The "ObjectUniforms" block, std140: written once per draw.
+ */
+struct ObjectUniforms
+{
+    glm::mat4 model;
+    glm::mat4 modelViewProjection;
+    glm::mat4 shadowMatrix;  // Model to shadow map texture space
+};
+
+// Connects the FrameUniforms and ObjectUniforms blocks of a program, when it has them,
+// to their binding points. LoadShaders does it for every program it links.
+void bindUniformBlocks(GLuint program_id);
+
+
+/**
+ * A uniform buffer split into one segment per frame in flight. Push() copies a block
+ * into the current segment and binds that range with glBindBufferRange, so a block
+ * shared by several programs is uploaded once.
+ *
+ * As in StreamBuffer, a fence is placed when a segment is left, and the segment is only
+ * written again once that fence is signaled: the GPU never reads a block being rewritten,
+ * and the driver has no reason to stall or copy in glBufferSubData.
+ *
+ * Only lessons 10 and 16 use these blocks, where many draws or several programs share
+ * the camera and light; the other lessons keep their plain uniforms.
+ */
+class UniformRing
+{
+public:
+    UniformRing();
+    ~UniformRing();
+
+    /**
+     * @param frameBytes Bytes pushed per frame at most, alignment included.
+     * @param frames Number of frames the GPU may lag behind.
+     */
+    bool Create(size_t frameBytes, unsigned int frames = 3);
+    void Destroy();
+
+    /**
+     * Fences the current segment and moves to the next one, waiting for the GPU to be
+     * done with it. Call once per frame before the first Push.
+     */
+    void BeginFrame();
+
+    bool Push(GLuint binding, const void * data, size_t size);
+
+    template <typename T>
+    bool Push(GLuint binding, const T & block) { return Push(binding, &block, sizeof(T)); }
+
+    // Number of times BeginFrame() had to wait for the GPU.
+    unsigned int GetStalls() const { return stalls; }
+
+private:
+    void WaitSegment(unsigned int segment);
+
+    GLuint buffer;
+    size_t segmentSize;
+    size_t alignment;  // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    size_t head;       // Next free byte in the current segment
+    unsigned int frames;
+    unsigned int frame;
+    std::vector<GLsync> fences;  // One per segment, 0 once waited for
+    unsigned int stalls;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "VBOIndexer.h"
+#include <cmath>
+#include <cstring>
 #include <map>
 #include <string>
 
@@ -169,3 +171,58 @@ void indexVBO_TBN(
         }
     }
 }
+
+
+void indexVBO(
+    std::vector<glm::vec3>& in_vertices,
+    std::vector<glm::vec2>& in_uvs,
+    std::vector<glm::vec3>& in_normals,
+    std::vector<unsigned short>& out_indices,
+    std::vector<InterleavedVertex>& out_vertices
+)
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    indexVBO(in_vertices, in_uvs, in_normals, out_indices, vertices, uvs, normals);
+
+    out_vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        out_vertices[i].position = vertices[i];
+        out_vertices[i].uv = uvs[i];
+        out_vertices[i].normal = normals[i];
+    }
+}
+
+
+void indexVBO_TBN(
+    std::vector<glm::vec3>& in_vertices,
+    std::vector<glm::vec2>& in_uvs,
+    std::vector<glm::vec3>& in_normals,
+    std::vector<glm::vec3>& in_tangents,
+    std::vector<glm::vec3>& in_bitangents,
+    std::vector<unsigned short>& out_indices,
+    std::vector<InterleavedVertexTBN>& out_vertices
+)
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> tangents;
+    std::vector<glm::vec3> bitangents;
+    indexVBO_TBN(in_vertices, in_uvs, in_normals, in_tangents, in_bitangents,
+                 out_indices, vertices, uvs, normals, tangents, bitangents);
+
+    out_vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        out_vertices[i].position = vertices[i];
+        out_vertices[i].uv = uvs[i];
+        out_vertices[i].normal = normals[i];
+        out_vertices[i].tangent = tangents[i];
+        out_vertices[i].bitangent = bitangents[i];
+        out_vertices[i].padding[0] = 0.0f;
+        out_vertices[i].padding[1] = 0.0f;
+    }
+}
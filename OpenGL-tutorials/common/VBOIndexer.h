@@ -3,6 +3,33 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+/**
+ * One vertex of an interleaved buffer: position, UV and normal fetched together.
+ * 32 bytes, so vertices never straddle a 16-byte boundary.
+ */
+struct alignas(16) InterleavedVertex
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+};
+
+/**
+ * Interleaved vertex with a tangent basis, padded from 56 to 64 bytes.
+ */
+struct alignas(16) InterleavedVertexTBN
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    float padding[2];
+};
+
+static_assert(sizeof(InterleavedVertex) == 32, "InterleavedVertex must stay 32 bytes");
+static_assert(sizeof(InterleavedVertexTBN) == 64, "InterleavedVertexTBN must stay 64 bytes");
+
 void indexVBO(
     std::vector<glm::vec3>& in_vertices,
     std::vector<glm::vec2>& in_uvs,
@@ -26,4 +53,23 @@ void indexVBO_TBN(
     std::vector<glm::vec3>& out_tangents,
     std::vector<glm::vec3>& out_bitangents
 );
-#endif
\ No newline at end of file
+
+// Same as above, writing a single interleaved vertex array instead of one array per attribute.
+void indexVBO(
+    std::vector<glm::vec3>& in_vertices,
+    std::vector<glm::vec2>& in_uvs,
+    std::vector<glm::vec3>& in_normals,
+    std::vector<unsigned short>& out_indices,
+    std::vector<InterleavedVertex>& out_vertices
+);
+
+void indexVBO_TBN(
+    std::vector<glm::vec3>& in_vertices,
+    std::vector<glm::vec2>& in_uvs,
+    std::vector<glm::vec3>& in_normals,
+    std::vector<glm::vec3>& in_tangents,
+    std::vector<glm::vec3>& in_bitangents,
+    std::vector<unsigned short>& out_indices,
+    std::vector<InterleavedVertexTBN>& out_vertices
+);
+#endif
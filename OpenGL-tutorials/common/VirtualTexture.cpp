@@ -0,0 +1,603 @@
+#include "VirtualTexture.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+
+// Maximum number of tiles uploaded to the physical cache per frame.
+static const unsigned int MAX_UPLOADS_PER_FRAME = 8;
+
+
+// Byte offset of the first tile of a level, for a file with the given header.
+static long levelOffset(const VirtualTextureHeader & header, unsigned int level)
+{
+    long offset = sizeof(VirtualTextureHeader);
+    long tileBytes = static_cast<long>(header.tileSize) * header.tileSize * 4;
+    unsigned int tiles = 1u << (header.levels - 1);
+    for (unsigned int l = 0; l < level; l++)
+    {
+        offset += static_cast<long>(tiles) * tiles * tileBytes;
+        tiles = std::max(tiles / 2, 1u);
+    }
+    return offset;
+}
+
+
+bool splitVirtualTexture(const char * bmppath, const char * vtpath, unsigned int tileSize)
+{
+    FILE * source = fopen(bmppath, "rb");
+    if (!source)
+    {
+        std::cout << "Image could not be opened." << std::endl;
+        return false;
+    }
+
+    unsigned char bmpHeader[54];
+    if ((fread(bmpHeader, 1, 54, source) != 54) || (bmpHeader[0] != 'B' || bmpHeader[1] != 'M'))
+    {
+        std::cout << "Not a correct BMP file." << std::endl;
+        fclose(source);
+        return false;
+    }
+    unsigned int dataPos = *(int*)&(bmpHeader[0x0A]);
+    unsigned int width   = *(int*)&(bmpHeader[0x12]);
+    unsigned int height  = *(int*)&(bmpHeader[0x16]);
+    if (dataPos == 0) dataPos = 54;
+    unsigned int rowSize = (width * 3 + 3) / 4 * 4;
+
+    // Pad the image to a square power-of-two number of tiles.
+    VirtualTextureHeader header;
+    header.magic = VIRTUAL_TEXTURE_MAGIC;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.levels = 1;
+    while ((tileSize << (header.levels - 1)) < std::max(width, height))
+        header.levels++;
+
+    FILE * output = fopen(vtpath, "w+b");
+    if (!output)
+    {
+        std::cout << "Virtual texture " << vtpath << " could not be created." << std::endl;
+        fclose(source);
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, output);
+
+    unsigned int tiles = 1u << (header.levels - 1);
+    size_t tileBytes = static_cast<size_t>(tileSize) * tileSize * 4;
+    std::vector<unsigned char> row(rowSize);
+    std::vector<unsigned char> strip(static_cast<size_t>(tiles) * tileBytes);
+
+    // Level 0: one row of tiles at a time, straight from the BMP rows (bottom-up, like GL).
+    for (unsigned int ty = 0; ty < tiles; ty++)
+    {
+        std::fill(strip.begin(), strip.end(), 0);
+        for (unsigned int y = 0; y < tileSize; y++)
+        {
+            unsigned int sourceRow = ty * tileSize + y;
+            if (sourceRow >= height)
+                break;
+            fseek(source, dataPos + static_cast<long>(sourceRow) * rowSize, SEEK_SET);
+            fread(&row[0], 1, rowSize, source);
+            for (unsigned int x = 0; x < width; x++)
+            {
+                unsigned char * texel = &strip[(x / tileSize) * tileBytes + (y * tileSize + x % tileSize) * 4];
+                texel[0] = row[3 * x + 2];  // BMP is stored as BGR
+                texel[1] = row[3 * x + 1];
+                texel[2] = row[3 * x + 0];
+                texel[3] = 255;
+            }
+        }
+        fwrite(&strip[0], 1, strip.size(), output);
+    }
+    fclose(source);
+
+    // Coarser levels: box-filter the 2x2 child tiles read back from the output.
+    std::vector<unsigned char> child(tileBytes);
+    std::vector<unsigned char> parent(tileBytes);
+    for (unsigned int level = 1; level < header.levels; level++)
+    {
+        unsigned int levelTiles = tiles >> level;
+        unsigned int childTiles = levelTiles * 2;
+        for (unsigned int ty = 0; ty < levelTiles; ty++)
+        {
+            for (unsigned int tx = 0; tx < levelTiles; tx++)
+            {
+                for (unsigned int c = 0; c < 4; c++)
+                {
+                    unsigned int cx = tx * 2 + c % 2;
+                    unsigned int cy = ty * 2 + c / 2;
+                    fseek(output, levelOffset(header, level - 1) + (static_cast<long>(cy) * childTiles + cx) * tileBytes, SEEK_SET);
+                    fread(&child[0], 1, tileBytes, output);
+
+                    unsigned int half = tileSize / 2;
+                    for (unsigned int y = 0; y < half; y++)
+                    {
+                        for (unsigned int x = 0; x < half; x++)
+                        {
+                            unsigned char * out = &parent[(((c / 2) * half + y) * tileSize + (c % 2) * half + x) * 4];
+                            for (unsigned int k = 0; k < 4; k++)
+                            {
+                                out[k] = static_cast<unsigned char>((
+                                    child[((2 * y) * tileSize + 2 * x) * 4 + k] +
+                                    child[((2 * y) * tileSize + 2 * x + 1) * 4 + k] +
+                                    child[((2 * y + 1) * tileSize + 2 * x) * 4 + k] +
+                                    child[((2 * y + 1) * tileSize + 2 * x + 1) * 4 + k] + 2) / 4);
+                            }
+                        }
+                    }
+                }
+                fseek(output, levelOffset(header, level) + (static_cast<long>(ty) * levelTiles + tx) * tileBytes, SEEK_SET);
+                fwrite(&parent[0], 1, tileBytes, output);
+            }
+        }
+    }
+
+    fclose(output);
+    std::cout << "Split " << bmppath << " into " << header.levels << " levels of "
+              << tileSize << "x" << tileSize << " tiles." << std::endl;
+    return true;
+}
+
+
+VirtualTextureUniforms getVirtualTextureUniforms(GLuint program_id)
+{
+    VirtualTextureUniforms uniforms;
+    uniforms.pageTable = glGetUniformLocation(program_id, "PageTable");
+    uniforms.physicalCache = glGetUniformLocation(program_id, "PhysicalCache");
+    uniforms.virtualScale = glGetUniformLocation(program_id, "VirtualScale");
+    uniforms.pageTableSize = glGetUniformLocation(program_id, "PageTableSize");
+    uniforms.tileSize = glGetUniformLocation(program_id, "TileSize");
+    uniforms.cacheTiles = glGetUniformLocation(program_id, "CacheTiles");
+    uniforms.maxLevel = glGetUniformLocation(program_id, "MaxLevel");
+    uniforms.feedbackBias = glGetUniformLocation(program_id, "FeedbackBias");
+    return uniforms;
+}
+
+
+VirtualTexture::VirtualTexture()
+    : file(NULL), pageTableSize(0), cacheTiles(0), frame(0),
+      physicalCacheTexture(0), pageTableTexture(0),
+      feedbackFramebuffer(0), feedbackColor(0), feedbackDepth(0), feedbackPixelBuffer(0),
+      feedbackWidth(0), feedbackHeight(0), feedbackBias(0.f), feedbackPending(false),
+      running(false)
+{
+}
+
+
+VirtualTexture::~VirtualTexture()
+{
+    Close();
+}
+
+
+uint64_t VirtualTexture::TileKey(unsigned int level, unsigned int x, unsigned int y) const
+{
+    return (static_cast<uint64_t>(level) << 48) | (static_cast<uint64_t>(y) << 24) | x;
+}
+
+
+long VirtualTexture::TileOffset(unsigned int level, unsigned int x, unsigned int y) const
+{
+    long tileBytes = static_cast<long>(header.tileSize) * header.tileSize * 4;
+    unsigned int tiles = pageTableSize >> level;
+    return levelOffset(header, level) + (static_cast<long>(y) * tiles + x) * tileBytes;
+}
+
+
+bool VirtualTexture::ReadTile(uint64_t key, std::vector<unsigned char> & texels)
+{
+    unsigned int level = static_cast<unsigned int>(key >> 48);
+    unsigned int y = static_cast<unsigned int>((key >> 24) & 0xFFFFFF);
+    unsigned int x = static_cast<unsigned int>(key & 0xFFFFFF);
+
+    texels.resize(static_cast<size_t>(header.tileSize) * header.tileSize * 4);
+    fseek(file, TileOffset(level, x, y), SEEK_SET);
+    return fread(&texels[0], 1, texels.size(), file) == texels.size();
+}
+
+
+bool VirtualTexture::Open(const char * vtpath, unsigned int cache_tiles,
+                          int feedback_width, int feedback_height, int feedback_scale)
+{
+    file = fopen(vtpath, "rb");
+    if (!file)
+    {
+        std::cout << "Virtual texture " << vtpath << " could not be opened." << std::endl;
+        return false;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != VIRTUAL_TEXTURE_MAGIC)
+    {
+        std::cout << "Not a correct virtual texture file." << std::endl;
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    pageTableSize = 1u << (header.levels - 1);
+    cacheTiles = cache_tiles;
+
+    // Physical cache: the only storage for texels, whatever the virtual size.
+    glGenTextures(1, &physicalCacheTexture);
+    glBindTexture(GL_TEXTURE_2D, physicalCacheTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheTiles * header.tileSize, cacheTiles * header.tileSize,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Page table: one texel per tile, one mipmap per level.
+    pageTable.resize(header.levels);
+    pageTableDirty.assign(header.levels, PageTableRegion());
+    glGenTextures(1, &pageTableTexture);
+    glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+    for (unsigned int level = 0; level < header.levels; level++)
+    {
+        unsigned int tiles = pageTableSize >> level;
+        pageTable[level].assign(static_cast<size_t>(tiles) * tiles * 4, 0);
+        pageTableDirty[level].x0 = pageTableDirty[level].y0 = tiles;
+        pageTableDirty[level].x1 = pageTableDirty[level].y1 = 0;
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, tiles, tiles, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+
+    // Every slot starts free, at the back of the LRU list.
+    unsigned int slots = cacheTiles * cacheTiles;
+    slotPosition.resize(slots);
+    slotKey.assign(slots, UINT64_MAX);
+    slotFrame.assign(slots, 0);
+    for (unsigned int slot = 0; slot < slots; slot++)
+        slotPosition[slot] = lru.insert(lru.end(), slot);
+
+    // The coarsest tile is loaded right away and never evicted, so every lookup has a fallback.
+    // Its page table update covers every level.
+    TileData root;
+    root.key = TileKey(header.levels - 1, 0, 0);
+    if (!ReadTile(root.key, root.texels))
+    {
+        std::cout << "Virtual texture " << vtpath << " is truncated." << std::endl;
+        Close();
+        return false;
+    }
+    UploadTile(root);
+    lru.erase(slotPosition[tileSlots[root.key]]);
+    UploadPageTable();
+
+    // Feedback target: integer (tile x, tile y, level, written) per pixel.
+    feedbackWidth = feedback_width;
+    feedbackHeight = feedback_height;
+    feedbackBias = -std::log2(static_cast<float>(feedback_scale));
+
+    glGenFramebuffers(1, &feedbackFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glGenRenderbuffers(1, &feedbackColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, feedbackWidth, feedbackHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+    glGenRenderbuffers(1, &feedbackDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Virtual texture feedback framebuffer is incomplete." << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &feedbackPixelBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPixelBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, feedbackWidth * feedbackHeight * 4 * sizeof(GLushort), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    running = true;
+    loader = std::thread(&VirtualTexture::LoaderThread, this);
+
+    std::cout << "Virtual texture " << header.width << "x" << header.height << ": "
+              << GetGPUBytes() / 1024 << " KiB of GPU memory." << std::endl;
+    return true;
+}
+
+
+void VirtualTexture::Close()
+{
+    if (running)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_all();
+        loader.join();
+    }
+    if (file)
+    {
+        fclose(file);
+        file = NULL;
+    }
+    if (physicalCacheTexture)
+    {
+        glDeleteTextures(1, &physicalCacheTexture);
+        glDeleteTextures(1, &pageTableTexture);
+        glDeleteFramebuffers(1, &feedbackFramebuffer);
+        glDeleteRenderbuffers(1, &feedbackColor);
+        glDeleteRenderbuffers(1, &feedbackDepth);
+        glDeleteBuffers(1, &feedbackPixelBuffer);
+        physicalCacheTexture = 0;
+    }
+}
+
+
+size_t VirtualTexture::GetGPUBytes() const
+{
+    size_t bytes = static_cast<size_t>(cacheTiles) * header.tileSize * cacheTiles * header.tileSize * 4;
+    for (size_t level = 0; level < pageTable.size(); level++)
+        bytes += pageTable[level].size();
+    return bytes + static_cast<size_t>(feedbackWidth) * feedbackHeight * (8 + 4 + 8);
+}
+
+
+void VirtualTexture::LoaderThread()
+{
+    while (true)
+    {
+        uint64_t key;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return !running || !requests.empty(); });
+            if (!running)
+                return;
+            key = requests.front();
+            requests.pop_front();
+        }
+
+        TileData tile;
+        tile.key = key;
+        bool ok = ReadTile(key, tile.texels);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok)
+            completed.push_back(std::move(tile));
+        else
+            pending.erase(key);
+    }
+}
+
+
+void VirtualTexture::BeginFeedback()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+
+    static const GLuint clearColor[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, clearColor);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+
+void VirtualTexture::EndFeedback(int viewportWidth, int viewportHeight)
+{
+    // Copy into the pixel buffer without waiting; Update() maps it on the next frame.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPixelBuffer);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedbackPending = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+
+void VirtualTexture::ReadFeedback()
+{
+    if (!feedbackPending)
+        return;
+    feedbackPending = false;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPixelBuffer);
+    const GLushort * pixels = static_cast<const GLushort *>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+    if (pixels)
+    {
+        std::unordered_set<uint64_t> visible;
+        for (int i = 0; i < feedbackWidth * feedbackHeight; i++)
+        {
+            const GLushort * texel = &pixels[4 * i];
+            if (texel[3] == 0)
+                continue;
+            visible.insert(TileKey(texel[2], texel[0], texel[1]));
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+        std::vector<uint64_t> missing;
+        for (std::unordered_set<uint64_t>::const_iterator it = visible.begin(); it != visible.end(); ++it)
+        {
+            std::unordered_map<uint64_t, int>::iterator resident = tileSlots.find(*it);
+            if (resident != tileSlots.end())
+            {
+                // Visible again: move to the front of the LRU list (the pinned root is not in it).
+                int slot = resident->second;
+                slotFrame[slot] = frame;
+                if (*it != TileKey(header.levels - 1, 0, 0))
+                    lru.splice(lru.begin(), lru, slotPosition[slot]);
+            }
+            else
+            {
+                missing.push_back(*it);
+            }
+        }
+
+        if (!missing.empty())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < missing.size(); i++)
+            {
+                if (pending.insert(missing[i]).second)
+                {
+                    // Coarse tiles first: they cover more of the screen.
+                    if ((missing[i] >> 48) > 0)
+                        requests.push_front(missing[i]);
+                    else
+                        requests.push_back(missing[i]);
+                }
+            }
+        }
+        condition.notify_one();
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+void VirtualTexture::UploadTile(const TileData & tile)
+{
+    // Take the least recently used slot, evicting its tile.
+    int slot = lru.back();
+    uint64_t evicted = slotKey[slot];
+    if (evicted != UINT64_MAX)
+        tileSlots.erase(evicted);
+    lru.splice(lru.begin(), lru, slotPosition[slot]);
+    slotKey[slot] = tile.key;
+    slotFrame[slot] = frame;
+    tileSlots[tile.key] = slot;
+
+    glBindTexture(GL_TEXTURE_2D, physicalCacheTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0,
+                    (slot % cacheTiles) * header.tileSize, (slot / cacheTiles) * header.tileSize,
+                    header.tileSize, header.tileSize, GL_RGBA, GL_UNSIGNED_BYTE, &tile.texels[0]);
+
+    // Both updates run after the slot changed hands, so either order is right even when
+    // one tile lies below the other.
+    if (evicted != UINT64_MAX)
+        UpdatePageTable(evicted);
+    UpdatePageTable(tile.key);
+}
+
+
+void VirtualTexture::UpdatePageTable(uint64_t key)
+{
+    unsigned int top = static_cast<unsigned int>(key >> 48);
+    unsigned int tileY = static_cast<unsigned int>((key >> 24) & 0xFFFFFF);
+    unsigned int tileX = static_cast<unsigned int>(key & 0xFFFFFF);
+
+    // Top-down over the tiles this one covers: a tile points to its own slot when
+    // resident, to its parent's entry otherwise. Entries outside are unaffected.
+    for (int level = static_cast<int>(top); level >= 0; level--)
+    {
+        unsigned int shift = top - level;
+        unsigned int x0 = tileX << shift, x1 = (tileX + 1) << shift;
+        unsigned int y0 = tileY << shift, y1 = (tileY + 1) << shift;
+        unsigned int tiles = pageTableSize >> level;
+        std::vector<unsigned char> & entries = pageTable[level];
+        for (unsigned int y = y0; y < y1; y++)
+        {
+            for (unsigned int x = x0; x < x1; x++)
+            {
+                unsigned char * entry = &entries[(y * tiles + x) * 4];
+                std::unordered_map<uint64_t, int>::const_iterator resident = tileSlots.find(TileKey(level, x, y));
+                if (resident != tileSlots.end())
+                {
+                    entry[0] = static_cast<unsigned char>(resident->second % cacheTiles);
+                    entry[1] = static_cast<unsigned char>(resident->second / cacheTiles);
+                    entry[2] = static_cast<unsigned char>(level);
+                    entry[3] = 255;
+                }
+                else
+                {
+                    const unsigned char * parent = &pageTable[level + 1][((y / 2) * (tiles / 2) + x / 2) * 4];
+                    memcpy(entry, parent, 4);
+                }
+            }
+        }
+
+        PageTableRegion & dirty = pageTableDirty[level];
+        dirty.x0 = std::min(dirty.x0, x0);
+        dirty.y0 = std::min(dirty.y0, y0);
+        dirty.x1 = std::max(dirty.x1, x1);
+        dirty.y1 = std::max(dirty.y1, y1);
+    }
+}
+
+
+void VirtualTexture::UploadPageTable()
+{
+    glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+    for (unsigned int level = 0; level < header.levels; level++)
+    {
+        PageTableRegion & dirty = pageTableDirty[level];
+        if (dirty.x0 >= dirty.x1)
+            continue;
+
+        // Upload the changed rectangle straight out of the level's array.
+        unsigned int tiles = pageTableSize >> level;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, tiles);
+        glTexSubImage2D(GL_TEXTURE_2D, level, dirty.x0, dirty.y0, dirty.x1 - dirty.x0, dirty.y1 - dirty.y0,
+                        GL_RGBA, GL_UNSIGNED_BYTE, &pageTable[level][(dirty.y0 * tiles + dirty.x0) * 4]);
+
+        dirty.x0 = dirty.y0 = tiles;
+        dirty.x1 = dirty.y1 = 0;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+
+void VirtualTexture::Update()
+{
+    frame++;
+    ReadFeedback();
+
+    std::vector<TileData> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = std::min<size_t>(completed.size(), MAX_UPLOADS_PER_FRAME);
+        for (size_t i = 0; i < count; i++)
+            ready.push_back(std::move(completed[i]));
+        completed.erase(completed.begin(), completed.begin() + count);
+    }
+
+    size_t uploaded = 0;
+    for (; uploaded < ready.size(); uploaded++)
+    {
+        // Never evict a tile seen in the current feedback: the cache is full for this view.
+        if (slotKey[lru.back()] != UINT64_MAX && slotFrame[lru.back()] == frame)
+            break;
+        UploadTile(ready[uploaded]);
+    }
+
+    {
+        // Tiles left over stay pending and go back first in line, already read.
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < uploaded; i++)
+            pending.erase(ready[i].key);
+        completed.insert(completed.begin(), std::make_move_iterator(ready.begin() + uploaded),
+                         std::make_move_iterator(ready.end()));
+    }
+
+    UploadPageTable();
+}
+
+
+void VirtualTexture::Bind(const VirtualTextureUniforms & uniforms, GLuint pageTableUnit, GLuint cacheUnit) const
+{
+    glActiveTexture(GL_TEXTURE0 + pageTableUnit);
+    glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+    glUniform1i(uniforms.pageTable, pageTableUnit);
+
+    glActiveTexture(GL_TEXTURE0 + cacheUnit);
+    glBindTexture(GL_TEXTURE_2D, physicalCacheTexture);
+    glUniform1i(uniforms.physicalCache, cacheUnit);
+
+    glUniform1f(uniforms.cacheTiles, static_cast<float>(cacheTiles));
+    BindFeedback(uniforms);
+}
+
+
+void VirtualTexture::BindFeedback(const VirtualTextureUniforms & uniforms) const
+{
+    float paddedSize = static_cast<float>(pageTableSize * header.tileSize);
+    glUniform2f(uniforms.virtualScale, header.width / paddedSize, header.height / paddedSize);
+    glUniform1i(uniforms.pageTableSize, pageTableSize);
+    glUniform1f(uniforms.tileSize, static_cast<float>(header.tileSize));
+    glUniform1i(uniforms.maxLevel, header.levels - 1);
+    glUniform1f(uniforms.feedbackBias, feedbackBias);
+}
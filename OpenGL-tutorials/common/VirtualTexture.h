@@ -0,0 +1,172 @@
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+#include <cstdio>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <GL/glew.h>
+
+#define VIRTUAL_TEXTURE_MAGIC 0x31545656  // Equivalent to "VVT1" in ASCII
+
+/**
+ * Header of a tiled virtual texture file. It is followed by the RGBA8 tiles of every
+ * mipmap level, finest level first, each level stored row by row.
+ * The source image is padded to a square of tileSize * 2^(levels - 1) texels.
+ */
+struct VirtualTextureHeader
+{
+    uint32_t magic;
+    uint32_t width;     // Size of the source image, in texels
+    uint32_t height;
+    uint32_t tileSize;  // Tile side, in texels
+    uint32_t levels;    // Number of mipmap levels; the last one is a single tile
+};
+
+// Offline step: splits a 24-bit BMP of any size into a virtual texture file with
+// a full box-filtered mip chain. Reads the source one tile row at a time.
+bool splitVirtualTexture(const char * bmppath, const char * vtpath, unsigned int tileSize = 128);
+
+/**
+ * Uniform locations used by the virtual texture sampling and feedback shaders.
+ */
+struct VirtualTextureUniforms
+{
+    GLint pageTable;
+    GLint physicalCache;
+    GLint virtualScale;
+    GLint pageTableSize;
+    GLint tileSize;
+    GLint cacheTiles;
+    GLint maxLevel;
+    GLint feedbackBias;
+};
+
+VirtualTextureUniforms getVirtualTextureUniforms(GLuint program_id);
+
+
+/**
+ * Streams the tiles of a virtual texture file into a fixed-size physical cache texture.
+ *
+ * Each frame the scene is drawn once into a small feedback framebuffer, writing the
+ * (tile x, tile y, mip) it would sample. update() reads that back one frame later,
+ * requests the missing tiles from a background loader thread, uploads the tiles it
+ * has finished reading (evicting the least recently used ones) and refreshes the page
+ * table, whose entries point to a tile's cache slot or to its closest resident parent.
+ * Only the entries below the tiles loaded or evicted are recomputed, and they are
+ * uploaded once per frame.
+ * GPU memory is bounded by the cache size whatever the size of the source.
+ */
+class VirtualTexture
+{
+public:
+    VirtualTexture();
+    ~VirtualTexture();
+
+    /**
+     * Opens a file written by splitVirtualTexture and starts the loader thread.
+     * @param vtpath Virtual texture file.
+     * @param cacheTiles Side of the physical cache, in tiles.
+     * @param feedbackWidth Width of the feedback framebuffer.
+     * @param feedbackHeight Height of the feedback framebuffer.
+     * @param feedbackScale Ratio between the screen and the feedback framebuffer.
+     */
+    bool Open(const char * vtpath, unsigned int cacheTiles,
+              int feedbackWidth, int feedbackHeight, int feedbackScale);
+    void Close();
+
+    /**
+     * Binds the feedback framebuffer; draw the scene with the feedback program after this.
+     */
+    void BeginFeedback();
+
+    /**
+     * Starts the asynchronous read-back of the feedback and restores the default framebuffer.
+     */
+    void EndFeedback(int viewportWidth, int viewportHeight);
+
+    /**
+     * Consumes the previous feedback, streams tiles in and refreshes the page table.
+     */
+    void Update();
+
+    /**
+     * Binds the page table and the physical cache and sets the sampling uniforms.
+     */
+    void Bind(const VirtualTextureUniforms & uniforms, GLuint pageTableUnit, GLuint cacheUnit) const;
+
+    /**
+     * Sets the uniforms of the feedback program.
+     */
+    void BindFeedback(const VirtualTextureUniforms & uniforms) const;
+
+    size_t GetResidentTiles() const { return tileSlots.size(); }
+    size_t GetGPUBytes() const;
+
+private:
+    struct TileData
+    {
+        uint64_t key;
+        std::vector<unsigned char> texels;
+    };
+
+    // Page table texels changed since the last upload, [x0, x1) x [y0, y1) of one level.
+    struct PageTableRegion
+    {
+        unsigned int x0, y0, x1, y1;
+    };
+
+    uint64_t TileKey(unsigned int level, unsigned int x, unsigned int y) const;
+    long TileOffset(unsigned int level, unsigned int x, unsigned int y) const;
+    bool ReadTile(uint64_t key, std::vector<unsigned char> & texels);
+    void LoaderThread();
+    void ReadFeedback();
+    void UploadTile(const TileData & tile);
+    void UpdatePageTable(uint64_t key);
+    void UploadPageTable();
+
+    FILE * file;
+    VirtualTextureHeader header;
+    unsigned int pageTableSize;  // Tiles per side at level 0
+    unsigned int cacheTiles;
+    unsigned long long frame;
+
+    GLuint physicalCacheTexture;
+    GLuint pageTableTexture;
+    std::vector<std::vector<unsigned char> > pageTable;  // RGBA8 per level: slot x, slot y, level, 255
+    std::vector<PageTableRegion> pageTableDirty;         // Per level, empty when x0 >= x1
+
+    // Cache slots, most recently used first.
+    std::list<int> lru;
+    std::vector<std::list<int>::iterator> slotPosition;
+    std::vector<uint64_t> slotKey;
+    std::vector<unsigned long long> slotFrame;
+    std::unordered_map<uint64_t, int> tileSlots;
+
+    // Feedback.
+    GLuint feedbackFramebuffer;
+    GLuint feedbackColor;
+    GLuint feedbackDepth;
+    GLuint feedbackPixelBuffer;
+    int feedbackWidth;
+    int feedbackHeight;
+    float feedbackBias;
+    bool feedbackPending;
+
+    // Loader thread.
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<uint64_t> requests;
+    std::vector<TileData> completed;
+    std::unordered_set<uint64_t> pending;
+    std::atomic<bool> running;
+};
+
+#endif
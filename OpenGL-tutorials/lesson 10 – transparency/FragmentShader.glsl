@@ -12,14 +12,14 @@ out vec4 color;
 
 // Values that stay constant for the whole mesh.
 uniform sampler2D myTextureSampler;
-uniform mat4 MV;
-uniform vec3 LightPosition_worldspace;
+
+#include "../common/UniformBlocks.glsl"
 
 void main()
 {
 	// Light emission properties
-	vec3 LightColor = vec3(1, 1, 1);
-	float LightPower = 50.0f;
+	vec3 Color = LightColor.rgb;
+	float LightPower = LightColor.w;
 
 	// Material properties
 	vec3 MaterialDiffuseColor = texture(myTextureSampler, vec2(UV.x, 1.0 - UV.y)).rgb;
@@ -27,7 +27,7 @@ void main()
 	vec3 MaterialSpecularColor = vec3(0.3, 0.3, 0.3);
 
 	// Distance to the light
-	float distance = length(LightPosition_worldspace - Position_worldspace);
+	float distance = length(Light_worldspace.xyz - Position_worldspace);
 
 	// Normal of the computed fragment, in camera space
 	vec3 n = normalize(Normal_cameraspace);
@@ -55,9 +55,14 @@ void main()
 		// Ambient : simulates indirect lighting
 		MaterialAmbientColor +
 		// Diffuse : "color" of the object
-		MaterialDiffuseColor * LightColor * LightPower * cosTheta / (distance * distance) +
+		MaterialDiffuseColor * Color * LightPower * cosTheta / (distance * distance) +
 		// Specular : reflective highlight, like a mirror
-		MaterialSpecularColor * LightColor * LightPower * pow(cosAlpha, 5) / (distance * distance);
+		MaterialSpecularColor * Color * LightPower * pow(cosAlpha, 5) / (distance * distance);
 
+	// Compiled twice: the opaque variant lets the render queue draw it front to back.
+#ifdef TRANSPARENT
 	color.a = 0.3;
+#else
+	color.a = 1.0;
+#endif
 }
@@ -12,30 +12,27 @@ out vec3 Normal_cameraspace;
 out vec3 EyeDirection_cameraspace;
 out vec3 LightDirection_cameraspace;
 
-// Values that stay constant for the whole mesh.
-uniform mat4 MVP;
-uniform mat4 V;
-uniform mat4 M;
-uniform vec3 LightPosition_worldspace;
+// View, light and per-object matrices, shared with the render queue's other draws.
+#include "../common/UniformBlocks.glsl"
 
 void main()
 {
-	gl_Position = MVP * vec4(vertexPosition_modelspace, 1);
+	gl_Position = ModelViewProjection * vec4(vertexPosition_modelspace, 1);
 
 	// Position of the vertex, in worldspace : M * position
-	Position_worldspace = (M * vec4(vertexPosition_modelspace, 1)).xyz;
+	Position_worldspace = (Model * vec4(vertexPosition_modelspace, 1)).xyz;
 
 	// Vector that goes from the vertex to the camera, in camera space.
 	// In camera space, the camera is at the origin (0,0,0 Output position of the vertex, in clip space : MVP * position).
-	vec3 vertexPosition_cameraspace = (V * M * vec4(vertexPosition_modelspace, 1)).xyz;
+	vec3 vertexPosition_cameraspace = (View * Model * vec4(vertexPosition_modelspace, 1)).xyz;
 	EyeDirection_cameraspace = vec3(0, 0, 0) - vertexPosition_cameraspace;
 
 	// Vector that goes from the vertex to the light, in camera space. M is ommited because it's identity.
-	vec3 LightPosition_cameraspace = (V * vec4(LightPosition_worldspace, 1)).xyz;
+	vec3 LightPosition_cameraspace = (View * vec4(Light_worldspace.xyz, 1)).xyz;
 	LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
 
 	// Normal of the the vertex, in camera space
-	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz;
+	Normal_cameraspace = (View * Model * vec4(vertexNormal_modelspace, 0)).xyz;
 
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
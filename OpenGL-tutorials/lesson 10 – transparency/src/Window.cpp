@@ -1,4 +1,5 @@
 #include "Window.h"
+#include <chrono>
 #include <iostream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -7,8 +8,19 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "Controls.h"
+#include "FrustumCuller.h"
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
+#include "GLState.h"
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "ShaderPermutations.h"
+#include "ShaderProgram.h"
+#include "UniformBuffers.h"
+
+// The generated scene: a square grid of objects below the camera.
+static const unsigned int SCENE_SIZE = 100;  // Objects per side, 10k in total
+static const float SCENE_SPACING = 2.5f;
 
 
 Window::Window(int width, int height, const std::string name)
@@ -60,76 +72,99 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
-    // Load shaders from the GLSL sources.
-    GLuint programID = LoadShaders(
+    // Load shaders from the GLSL sources: an opaque and a transparent variant.
+    ShaderPermutations variants(
             "../lesson 10 – transparency/VertexShader.glsl",
-            "../lesson 10 – transparency/FragmentShader.glsl"
+            "../lesson 10 – transparency/FragmentShader.glsl",
+            {"TRANSPARENT"}
     );
+    GLuint programs[2] = {variants.Get(0), variants.Get(1)};  // Indexed by RENDER_PASS
+
+    // Set our "myTextureSampler" sampler to user Texture Unit 0, once per program.
+    for (GLuint program : programs)
+        ShaderProgram(program).Set("myTextureSampler", 0);
+
+    // Load the textures...
+    GLuint textures[3] = {
+            loadDDS("../resources/suzanne_uvmap.dds"),
+            loadDDS("../resources/cube_uvmap.dds"),
+            loadDDS("../resources/uvtemplate.dds")
+    };
+
+    // Read our .obj files and load them into meshes
+    const char * meshPaths[2] = {"../resources/suzanne.obj", "../resources/cube.obj"};
+    Mesh meshes[2];
+    BoundingBox meshBounds[2];
+    for (int i = 0; i < 2; i++)
+    {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        loadOBJ(meshPaths[i], vertices, uvs, normals);
+        meshBounds[i] = computeBoundingBox(vertices);
+
+        std::vector<unsigned short> indices;
+        std::vector<InterleavedVertex> indexed_vertices;
+        indexVBO(vertices, uvs, normals, indices, indexed_vertices);
+        meshes[i].AddInterleaved(indexed_vertices);
+        meshes[i].SetIndices(indices);
+    }
+
+    // Generate the scene. Neighbours get unrelated mesh, texture and pass, the worst case
+    // for drawing in submission order.
+    struct SceneObject
+    {
+        glm::mat4 model;
+        glm::vec3 position;
+        RENDER_PASS pass;
+        GLuint texture;
+        const Mesh * mesh;
+    };
+    std::vector<SceneObject> objects(SCENE_SIZE * SCENE_SIZE);
+    FrustumCuller culler;
+    culler.Reserve(objects.size());
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        unsigned int hash = i * 2654435761u;
+        SceneObject & object = objects[i];
+        object.position = glm::vec3(
+                (float(i % SCENE_SIZE) - SCENE_SIZE / 2.f) * SCENE_SPACING,
+                -2.f,
+                (float(i / SCENE_SIZE) - SCENE_SIZE / 2.f) * SCENE_SPACING
+        );
+        object.model = glm::translate(glm::mat4(1.0), object.position);
+        object.pass = (hash >> 28) % 4 == 0 ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+        object.texture = textures[(hash >> 24) % 3];
+        const BoundingBox & bounds = meshBounds[(hash >> 20) % 2];
+        object.mesh = &meshes[(hash >> 20) % 2];
+
+        // The objects are only translated: so are their bounds. The culler's index is i.
+        BoundingBox box;
+        box.min = bounds.min + object.position;
+        box.max = bounds.max + object.position;
+        culler.Add(box);
+    }
+    std::vector<uint32_t> visible;
+    size_t visibleCount = 0;
+    double cullMilliseconds = 0.0;
 
-    // Get a handle for our "MVP" uniform
-    GLint MatrixID = glGetUniformLocation(programID, "MVP");
-    GLint ViewMatrixID = glGetUniformLocation(programID, "V");
-    GLint ModelMatrixID = glGetUniformLocation(programID, "M");
-
-    // Load a texture...
-    GLuint texture = loadDDS("../resources/suzanne_uvmap.dds");
-
-    // Get a handle for our "myTextureSampler" uniform
-    GLint textureID  = glGetUniformLocation(programID, "myTextureSampler");
-
-    // Get a handle for our "LightPosition" uniform
-    GLint lightID = glGetUniformLocation(programID, "LightPosition_worldspace");
-
-    // Read our .obj file
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-    bool res = loadOBJ("../resources/suzanne.obj", vertices, uvs, normals);
-
-    std::vector<unsigned short> indices;
-    std::vector<glm::vec3> indexed_vertices;
-    std::vector<glm::vec2> indexed_uvs;
-    std::vector<glm::vec3> indexed_normals;
-    indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
-
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
+    // Per-frame and per-object uniform blocks: one object block per draw.
+    UniformRing uniformRing;
+    uniformRing.Create(objects.size() * 256 + 1024);
+
+    RenderQueue queue;
+    GLStateStats frameState = {0, 0};
 
     // Enable depth test.
-    glEnable(GL_DEPTH_TEST);
+    enableCapability(GL_DEPTH_TEST);
 
     // Accept fragment if it closer to the camera than the former one.
-    glDepthFunc(GL_LESS);
+    depthFunc(GL_LESS);
 
     // Cull triangles which normal is not towards the camera.
-    // glEnable(GL_CULL_FACE);
+    // enableCapability(GL_CULL_FACE);
 
-    // Enable blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Blending is enabled by the render queue for the transparent pass only.
 
     // For speed computation
     double lastTime = glfwGetTime();
@@ -142,7 +177,13 @@ void Window::Run()
         nbFrames++;
         if (currentTime - lastTime >= 1.0)
         {
-            std::cout << 1000.0/double(nbFrames) << " ms/frame" << std::endl;
+            const RenderQueueStats & stats = queue.GetStats();
+            std::cout << 1000.0/double(nbFrames) << " ms/frame, " << visibleCount << " of " << objects.size()
+                      << " objects visible (cull " << cullMilliseconds << " ms), " << stats.packets << " draws: sort "
+                      << stats.sortMilliseconds << " ms, submit " << stats.submitMilliseconds << " ms, "
+                      << stats.programChanges << " program / " << stats.textureChanges << " texture / "
+                      << stats.vertexArrayChanges << " VAO changes (" << stats.unsortedChanges
+                      << " in submission order), " << frameState.issued << " GL state calls" << std::endl;
             nbFrames = 0;
             lastTime += 1.0;
         }
@@ -150,54 +191,56 @@ void Window::Run()
         // Clear the screen.
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Use our shader.
-        glUseProgram(programID);
-
         computeMatricesFromInputs(window);
         glm::mat4 ProjectionMatrix = getProjectionMatrix();
         glm::mat4 ViewMatrix = getViewMatrix();
-        glm::mat4 ModelMatrix = glm::mat4(1.0);
-        glm::mat4 mvpView = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-        // Send our transformation to the currently bound shader, in the "MVP" uniform
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &mvpView[0][0]);
-        glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-        glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-
-        glm::vec3 lightPos = glm::vec3(4, 4, 4);
-        glUniform3f(lightID, lightPos.x, lightPos.y, lightPos.z);
-
-        // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-
-        // Set our "myTextureSampler" sampler to user Texture Unit 0
-        glUniform1i(textureID, 0);
-
-        // 1st attribute buffer: vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer: colors
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        glm::mat4 viewProjection = ProjectionMatrix * ViewMatrix;
+
+        uniformRing.BeginFrame();
+        FrameUniforms frame;
+        frame.view = ViewMatrix;
+        frame.projection = ProjectionMatrix;
+        frame.cameraPosition = glm::vec4(getCameraPosition(), 1);
+        frame.light = glm::vec4(4, 4, 4, 1);
+        frame.lightColor = glm::vec4(1, 1, 1, 50);
+        uniformRing.Push(FRAME_UNIFORM_BINDING, frame);
+
+        // Keep the objects in the frustum only.
+        std::chrono::steady_clock::time_point cullStart = std::chrono::steady_clock::now();
+        visibleCount = culler.Cull(extractFrustum(viewProjection), visible);
+        cullMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+
+        // Submit them with their key; the depth is the view space distance along -Z.
+        queue.Clear();
+        for (size_t v = 0; v < visibleCount; v++)
+        {
+            uint32_t i = visible[v];
+            const SceneObject & object = objects[i];
+            float depth = -(ViewMatrix * glm::vec4(object.position, 1)).z / Z_FAR;
+            GLuint program = programs[object.pass];
+
+            DrawPacket packet;
+            packet.key = makeSortKey(object.pass, program, object.texture, object.mesh->GetVertexArray(), depth);
+            packet.pass = object.pass;
+            packet.program = program;
+            packet.texture = object.texture;
+            packet.mesh = object.mesh;
+            packet.object = i;
+            queue.Submit(packet);
+        }
+        queue.Sort();
 
-        // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
+        // Draw the triangles, opaque front to back then transparent back to front.
+        queue.Execute([&](const DrawPacket & packet) {
+            ObjectUniforms object;
+            object.model = objects[packet.object].model;
+            object.modelViewProjection = viewProjection * object.model;
+            object.shadowMatrix = glm::mat4(1.0);
+            uniformRing.Push(OBJECT_UNIFORM_BINDING, object);
+        });
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        frameState = getGLStateStats();
+        resetGLStateStats();
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -206,12 +249,12 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    meshes[0].Destroy();
+    meshes[1].Destroy();
+    uniformRing.Destroy();
+    variants.Clear();
+    for (GLuint texture : textures)
+        deleteTexture(texture);
 
     glfwTerminate();
 }
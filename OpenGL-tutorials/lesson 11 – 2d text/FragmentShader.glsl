@@ -22,7 +22,7 @@ void main()
 	float LightPower = 50.0f;
 
 	// Material properties
-	vec3 MaterialDiffuseColor = texture(myTextureSampler, vec2(UV.x, 1.0 - UV.y)).rgb;
+	vec3 MaterialDiffuseColor = texture(myTextureSampler, UV).rgb;
 	vec3 MaterialAmbientColor = vec3(0.1, 0.1, 0.1) * MaterialDiffuseColor;
 	vec3 MaterialSpecularColor = vec3(0.3, 0.3, 0.3);
 
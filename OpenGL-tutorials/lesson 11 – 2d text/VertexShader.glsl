@@ -17,6 +17,7 @@ uniform mat4 MVP;
 uniform mat4 V;
 uniform mat4 M;
 uniform vec3 LightPosition_worldspace;
+uniform vec4 AtlasRect = vec4(0, 0, 1, 1); // Region of the texture atlas: xy = origin, zw = size
 
 void main()
 {
@@ -37,6 +38,6 @@ void main()
 	// Normal of the the vertex, in camera space
 	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz;
 
-	// UV of the vertex. No special space for this one.
-	UV = vertexUV;
+	// UV of the vertex, flipped for DDS (top-left origin) then remapped into its atlas region.
+	UV = AtlasRect.xy + vec2(vertexUV.x, 1.0 - vertexUV.y) * AtlasRect.zw;
 }
@@ -10,6 +10,9 @@
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
 #include "Text2d.h"
+#include "TextureAtlas.h"
+#include "GLState.h"
+#include "Mesh.h"
 
 
 Window::Window(int width, int height, const std::string name)
@@ -61,11 +64,6 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
     // Load shaders from the GLSL sources.
     GLuint programID = LoadShaders(
             "../lesson 11 – 2d text/VertexShader.glsl",
@@ -77,11 +75,22 @@ void Window::Run()
     GLint ViewMatrixID = glGetUniformLocation(programID, "V");
     GLint ModelMatrixID = glGetUniformLocation(programID, "M");
 
-    // Load a texture...
-    GLuint texture = loadDDS("../resources/suzanne_uvmap.dds");
+    // Pack Suzanne's texture and the font into one atlas: one texture bind per frame instead of two.
+    const std::string suzannePath = "../resources/suzanne_uvmap.dds";
+    const std::string fontPath = "../lesson 11 – 2d text/TextTexture.dds";
+    TextureAtlas atlas;
+    if (!buildDDSAtlas({suzannePath, fontPath}, atlas))
+    {
+        std::cerr << "Can't build the texture atlas." << std::endl;
+        glDeleteProgram(programID);
+        glfwTerminate();
+        return;
+    }
 
-    // Get a handle for our "myTextureSampler" uniform
+    // Get a handle for our "myTextureSampler" and "AtlasRect" uniforms
     GLint textureID  = glGetUniformLocation(programID, "myTextureSampler");
+    GLint atlasRectID = glGetUniformLocation(programID, "AtlasRect");
+    glm::vec4 suzanneRect = atlasRect(atlas.regions[suzannePath]);
 
     // Get a handle for our "LightPosition" uniform
     GLint lightID = glGetUniformLocation(programID, "LightPosition_worldspace");
@@ -93,48 +102,31 @@ void Window::Run()
     bool res = loadOBJ("../resources/suzanne.obj", vertices, uvs, normals);
 
     std::vector<unsigned short> indices;
-    std::vector<glm::vec3> indexed_vertices;
-    std::vector<glm::vec2> indexed_uvs;
-    std::vector<glm::vec3> indexed_normals;
-    indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
-
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
+    std::vector<InterleavedVertex> indexed_vertices;
+    indexVBO(vertices, uvs, normals, indices, indexed_vertices);
+
+    // Load it into a mesh. The text below goes through the GL state cache, so Suzanne does too.
+    Mesh suzanne;
+    suzanne.AddInterleaved(indexed_vertices);
+    suzanne.SetIndices(indices);
 
     // Initialize our little text library with the Holstein font
     initText2D(
-            "../lesson 11 – 2d text/TextTexture.dds",
+            atlas,
+            atlas.regions[fontPath],
             "../lesson 11 – 2d text/TextVertexShader.glsl",
             "../lesson 11 – 2d text/TextFragmentShader.glsl",
             "myTextureSampler"
     );
 
     // Enable depth test.
-    glEnable(GL_DEPTH_TEST);
+    enableCapability(GL_DEPTH_TEST);
 
     // Accept fragment if it closer to the camera than the former one.
-    glDepthFunc(GL_LESS);
+    depthFunc(GL_LESS);
 
     // Cull triangles which normal is not towards the camera.
-    glEnable(GL_CULL_FACE);
+    enableCapability(GL_CULL_FACE);
 
     // For speed computation
     double lastTime = glfwGetTime();
@@ -156,7 +148,7 @@ void Window::Run()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Use our shader.
-        glUseProgram(programID);
+        useProgram(programID);
 
         computeMatricesFromInputs(window);
         glm::mat4 ProjectionMatrix = getProjectionMatrix();
@@ -172,37 +164,15 @@ void Window::Run()
         glm::vec3 lightPos = glm::vec3(4, 4, 4);
         glUniform3f(lightID, lightPos.x, lightPos.y, lightPos.z);
 
-        // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        // Bind our atlas in Texture Unit 0, the text below samples it too
+        bindTexture(0, GL_TEXTURE_2D, atlas.textureID);
 
         // Set our "myTextureSampler" sampler to user Texture Unit 0
         glUniform1i(textureID, 0);
-
-        // 1st attribute buffer: vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer: colors
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        glUniform4f(atlasRectID, suzanneRect.x, suzanneRect.y, suzanneRect.z, suzanneRect.w);
 
         // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        suzanne.Draw();
 
         char text[256];
         sprintf(text,"%.2f sec", glfwGetTime());
@@ -215,12 +185,9 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
+    suzanne.Destroy();
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteAtlas(atlas);
 
     // Delete the text's VBO, the shader and the texture
     cleanupText2D();
@@ -6,6 +6,7 @@ in vec3 Position_worldspace;
 in vec3 Normal_cameraspace;
 in vec3 EyeDirection_cameraspace;
 in vec3 LightDirection_cameraspace;
+flat in vec3 Tint;
 
 // Ouput data
 out vec3 color;
@@ -22,7 +23,7 @@ void main()
 	float LightPower = 50.0f;
 
 	// Material properties
-	vec3 MaterialDiffuseColor = texture(myTextureSampler, vec2(UV.x, 1.0 - UV.y)).rgb;
+	vec3 MaterialDiffuseColor = texture(myTextureSampler, vec2(UV.x, 1.0 - UV.y)).rgb * Tint;
 	vec3 MaterialAmbientColor = vec3(0.1, 0.1, 0.1) * MaterialDiffuseColor;
 	vec3 MaterialSpecularColor = vec3(0.3, 0.3, 0.3);
 
@@ -0,0 +1,70 @@
+#version 410 core
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shader_draw_parameters : enable
+
+// Input vertex data, different for all executions of this shader.
+layout(location = 0) in vec3 vertexPosition_modelspace;
+layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec3 vertexNormal_modelspace;
+
+// Index of the draw in the multi-draw call, from the command's baseInstance. Only
+// read when gl_DrawIDARB is not available.
+layout(location = 3) in float drawIndex;
+
+// Output data ; will be interpolated for each fragment.
+out vec2 UV;
+out vec3 Position_worldspace;
+out vec3 Normal_cameraspace;
+out vec3 EyeDirection_cameraspace;
+out vec3 LightDirection_cameraspace;
+flat out vec3 Tint;
+
+// Per-draw data, one element per draw of the call. Matches DrawData in Window.cpp.
+struct DrawData
+{
+	mat4 model;
+	vec4 color;
+};
+
+// Connected to DRAW_DATA_BINDING by Window.cpp: GLSL 4.10 has no binding qualifier.
+layout(std430) readonly buffer DrawBlock
+{
+	DrawData draws[];
+};
+
+// Values that stay constant for the whole call.
+uniform mat4 VP;
+uniform mat4 V;
+uniform vec3 LightPosition_worldspace;
+
+void main()
+{
+#ifdef GL_ARB_shader_draw_parameters
+	DrawData draw = draws[gl_DrawIDARB];
+#else
+	DrawData draw = draws[int(drawIndex)];
+#endif
+	mat4 M = draw.model;
+
+	// Position of the vertex, in worldspace : M * position
+	Position_worldspace = (M * vec4(vertexPosition_modelspace, 1)).xyz;
+
+	gl_Position = VP * vec4(Position_worldspace, 1);
+
+	// Vector that goes from the vertex to the camera, in camera space.
+	vec3 vertexPosition_cameraspace = (V * vec4(Position_worldspace, 1)).xyz;
+	EyeDirection_cameraspace = vec3(0, 0, 0) - vertexPosition_cameraspace;
+
+	// Vector that goes from the vertex to the light, in camera space.
+	vec3 LightPosition_cameraspace = (V * vec4(LightPosition_worldspace, 1)).xyz;
+	LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
+
+	// Normal of the the vertex, in camera space
+	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz;
+
+	// UV of the vertex. No special space for this one.
+	UV = vertexUV;
+
+	// Color of the object, multiplied with its texture.
+	Tint = draw.color.rgb;
+}
@@ -11,12 +11,14 @@ out vec3 Position_worldspace;
 out vec3 Normal_cameraspace;
 out vec3 EyeDirection_cameraspace;
 out vec3 LightDirection_cameraspace;
+flat out vec3 Tint;
 
 // Values that stay constant for the whole mesh.
 uniform mat4 MVP;
 uniform mat4 V;
 uniform mat4 M;
 uniform vec3 LightPosition_worldspace;
+uniform vec3 Color;
 
 void main()
 {
@@ -39,4 +41,7 @@ void main()
 
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
+
+	// Color of the object, multiplied with its texture.
+	Tint = Color;
 }
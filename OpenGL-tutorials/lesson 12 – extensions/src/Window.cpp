@@ -9,6 +9,25 @@
 #include "Controls.h"
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
+#include "GLState.h"
+#include "MeshPool.h"
+#include "MultiDrawBatch.h"
+#include <chrono>
+
+// The generated scene: a square grid of objects below the camera, each with its own
+// mesh, transform and color.
+static const unsigned int SCENE_SIZE = 64;  // Objects per side, 4096 in total
+static const float SCENE_SPACING = 3.f;
+
+// Binding point of the per-draw storage buffer, as in MultiDrawVertexShader.glsl.
+static const GLuint DRAW_DATA_BINDING = 0;
+
+// Per-draw data of the multi-draw path: the DrawData struct of the shader, std430.
+struct DrawData
+{
+    glm::mat4 model;
+    glm::vec4 color;
+};
 
 
 // The ARB_debug_output extension, which is used in this tutorial as an example,
@@ -124,21 +143,58 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
-    // Load shaders from the GLSL sources.
-    GLuint programID = LoadShaders(
-            "../lesson 12 – extensions/VertexShader.glsl",
-            "../lesson 12 – extensions/FragmentShader.glsl"
-    );
+    // The whole scene in one call needs GL 4.3 level extensions; without them every
+    // object is drawn with its own call and its own uniforms.
+    bool multiDraw = MultiDrawBatch::IsSupported();
+    if (multiDraw)
+        printf("ARB_multi_draw_indirect available: the scene is drawn with a single call.\n");
+    else
+        printf("ARB_multi_draw_indirect unavailable: one draw call per object.\n");
+    if (multiDraw && !GLEW_ARB_shader_draw_parameters)
+        printf("ARB_shader_draw_parameters unavailable: the draw index comes from baseInstance.\n");
+
+    // The batch is created first: the shader depends on whether it exists.
+    MeshPool pool;
+    pool.Create(64 * 1024, 128 * 1024);
+    MultiDrawBatch batch;
+    if (multiDraw)
+        multiDraw = batch.Create(pool, SCENE_SIZE * SCENE_SIZE, sizeof(DrawData));
+
+    // Load shaders from the GLSL sources. The multi-draw shader is GLSL 4.10 with the
+    // storage buffer extension: if the driver still rejects it, draw object by object.
+    GLuint programID = 0;
+    if (multiDraw)
+    {
+        programID = LoadShaders(
+                "../lesson 12 – extensions/MultiDrawVertexShader.glsl",
+                "../lesson 12 – extensions/FragmentShader.glsl"
+        );
+        GLint linked = GL_FALSE;
+        glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+        GLuint drawBlock = glGetProgramResourceIndex(programID, GL_SHADER_STORAGE_BLOCK, "DrawBlock");
+        if (linked == GL_TRUE && drawBlock != GL_INVALID_INDEX)
+            glShaderStorageBlockBinding(programID, drawBlock, DRAW_DATA_BINDING);
+        else
+        {
+            printf("The multi-draw shader did not link: one draw call per object.\n");
+            glDeleteProgram(programID);
+            multiDraw = false;
+        }
+    }
+    if (!multiDraw)
+    {
+        programID = LoadShaders(
+                "../lesson 12 – extensions/VertexShader.glsl",
+                "../lesson 12 – extensions/FragmentShader.glsl"
+        );
+    }
 
-    // Get a handle for our "MVP" uniform
+    // Get a handle for our uniforms. Only the per-object path has "MVP", "M" and "Color".
+    GLint ViewProjectionID = glGetUniformLocation(programID, "VP");
     GLint MatrixID = glGetUniformLocation(programID, "MVP");
     GLint ViewMatrixID = glGetUniformLocation(programID, "V");
     GLint ModelMatrixID = glGetUniformLocation(programID, "M");
+    GLint colorID = glGetUniformLocation(programID, "Color");
 
     // Load a texture...
     GLuint texture = loadDDS("../resources/suzanne_uvmap.dds");
@@ -149,51 +205,57 @@ void Window::Run()
     // Get a handle for our "LightPosition" uniform
     GLint lightID = glGetUniformLocation(programID, "LightPosition_worldspace");
 
-    // Read our .obj file
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-    bool res = loadOBJ("../resources/suzanne.obj", vertices, uvs, normals);
-
-    std::vector<unsigned short> indices;
-    std::vector<glm::vec3> indexed_vertices;
-    std::vector<glm::vec2> indexed_uvs;
-    std::vector<glm::vec3> indexed_normals;
-    indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
-
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
+    // Read our .obj files and pack them into one vertex and one index buffer
+    const char * meshPaths[2] = {"../resources/suzanne.obj", "../resources/cube.obj"};
+    MeshRange meshes[2];
+    for (int i = 0; i < 2; i++)
+    {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        loadOBJ(meshPaths[i], vertices, uvs, normals);
+
+        std::vector<unsigned short> indices;
+        std::vector<InterleavedVertex> indexed_vertices;
+        indexVBO(vertices, uvs, normals, indices, indexed_vertices);
+        pool.Add(indexed_vertices, indices, meshes[i]);
+    }
+
+    // Generate the scene
+    std::vector<DrawData> objects(SCENE_SIZE * SCENE_SIZE);
+    std::vector<const MeshRange*> objectMeshes(objects.size());
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        unsigned int hash = i * 2654435761u;
+        glm::vec3 position(
+                (float(i % SCENE_SIZE) - SCENE_SIZE / 2.f) * SCENE_SPACING,
+                -2.f,
+                (float(i / SCENE_SIZE) - SCENE_SIZE / 2.f) * SCENE_SPACING
+        );
+        float angle = float(hash >> 16) / 65536.f * 6.2831853f;
+        objects[i].model = glm::rotate(glm::translate(glm::mat4(1.0), position), angle, glm::vec3(0, 1, 0));
+        objects[i].color = glm::vec4(
+                0.5f + float((hash >> 8) & 0xff) / 510.f,
+                0.5f + float((hash >> 16) & 0xff) / 510.f,
+                0.5f + float((hash >> 24) & 0xff) / 510.f,
+                1.f
+        );
+        objectMeshes[i] = &meshes[(hash >> 20) % 2];
+    }
 
     // Enable depth test.
-    glEnable(GL_DEPTH_TEST);
+    enableCapability(GL_DEPTH_TEST);
 
     // Accept fragment if it closer to the camera than the former one.
-    glDepthFunc(GL_LESS);
+    depthFunc(GL_LESS);
 
     // Cull triangles which normal is not towards the camera.
-    glEnable(GL_CULL_FACE);
+    enableCapability(GL_CULL_FACE);
 
     // For speed computation
     double lastTime = glfwGetTime();
     int nbFrames = 0;
+    double submitMilliseconds = 0.0;
 
     do
     {
@@ -202,8 +264,11 @@ void Window::Run()
         nbFrames++;
         if (currentTime - lastTime >= 1.0)
         {
-            std::cout << 1000.0/double(nbFrames) << " ms/frame" << std::endl;
+            std::cout << 1000.0/double(nbFrames) << " ms/frame, " << objects.size() << " objects in "
+                      << (multiDraw ? 1 : objects.size()) << " draw calls, submitted in "
+                      << submitMilliseconds / nbFrames << " ms" << std::endl;
             nbFrames = 0;
+            submitMilliseconds = 0.0;
             lastTime += 1.0;
         }
 
@@ -211,53 +276,49 @@ void Window::Run()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Use our shader.
-        glUseProgram(programID);
+        useProgram(programID);
 
         computeMatricesFromInputs(window);
         glm::mat4 ProjectionMatrix = getProjectionMatrix();
         glm::mat4 ViewMatrix = getViewMatrix();
-        glm::mat4 ModelMatrix = glm::mat4(1.0);
-        glm::mat4 mvpView = ProjectionMatrix * ViewMatrix * ModelMatrix;
+        glm::mat4 ViewProjection = ProjectionMatrix * ViewMatrix;
 
-        // Send our transformation to the currently bound shader, in the "MVP" uniform
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &mvpView[0][0]);
-        glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
+        // Send our transformation to the currently bound shader
+        glUniformMatrix4fv(ViewProjectionID, 1, GL_FALSE, &ViewProjection[0][0]);
         glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
 
         glm::vec3 lightPos = glm::vec3(4, 4, 4);
         glUniform3f(lightID, lightPos.x, lightPos.y, lightPos.z);
 
         // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        bindTexture(0, GL_TEXTURE_2D, texture);
 
         // Set our "myTextureSampler" sampler to user Texture Unit 0
         glUniform1i(textureID, 0);
 
-        // 1st attribute buffer: vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer: colors
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-
         // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (multiDraw)
+        {
+            // Every object, whatever its mesh, in one glMultiDrawElementsIndirect.
+            batch.Clear();
+            for (unsigned int i = 0; i < objects.size(); i++)
+                batch.Add(*objectMeshes[i], objects[i]);
+            batch.Draw(DRAW_DATA_BINDING);
+            batch.EndFrame();
+        }
+        else
+        {
+            for (unsigned int i = 0; i < objects.size(); i++)
+            {
+                glm::mat4 MVP = ViewProjection * objects[i].model;
+                glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+                glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &objects[i].model[0][0]);
+                glUniform3f(colorID, objects[i].color.x, objects[i].color.y, objects[i].color.z);
+                pool.Draw(*objectMeshes[i]);
+            }
+        }
+        submitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -266,12 +327,10 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
+    batch.Destroy();
+    pool.Destroy();
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteTexture(texture);
 
     glfwTerminate();
 }
@@ -13,13 +13,16 @@ in vec3 EyeDirection_tangentspace;
 out vec3 color;
 
 // Values that stay constant for the whole mesh.
-uniform sampler2D DiffuseTextureSampler;
+uniform sampler2DArray MaterialTextureSampler;
+uniform int DiffuseLayer;   // Layers of MaterialTextureSampler used by this draw
+uniform int SpecularLayer;
 uniform sampler2D NormalTextureSampler;
-uniform sampler2D SpecularTextureSampler;
 uniform mat4 V;
 uniform mat4 M;
 uniform mat3 MV3x3;
 uniform vec3 LightPosition_worldspace;
+// True when the specular intensity is packed in the B channel of the normal map.
+uniform bool SpecularInNormalMap;
 
 void main()
 {
@@ -29,12 +32,16 @@ void main()
 	float LightPower = 40.0;
 
 	// Material properties
-	vec3 MaterialDiffuseColor = texture( DiffuseTextureSampler, UV ).rgb;
+	vec3 MaterialDiffuseColor = texture(MaterialTextureSampler, vec3(UV, DiffuseLayer)).rgb;
 	vec3 MaterialAmbientColor = vec3(0.1,0.1,0.1) * MaterialDiffuseColor;
-	vec3 MaterialSpecularColor = texture(SpecularTextureSampler, UV).rgb * 0.3;
 
 	// Local normal, in tangent space. V tex coordinate is inverted because normal map is in TGA (not in DDS) for better quality
-	vec3 TextureNormal_tangentspace = normalize(texture(NormalTextureSampler, vec2(UV.x, -UV.y)).rgb * 2.0 - 1.0);
+	// Only X and Y are stored (BC5/RG8), Z is rebuilt from the unit length of the normal.
+	vec3 NormalTexel = texture(NormalTextureSampler, vec2(UV.x, -UV.y)).rgb;
+	vec2 NormalXY = NormalTexel.rg * 2.0 - 1.0;
+	vec3 TextureNormal_tangentspace = vec3(NormalXY, sqrt(max(1.0 - dot(NormalXY, NormalXY), 0.0)));
+
+	vec3 MaterialSpecularColor = (SpecularInNormalMap ? vec3(NormalTexel.b) : texture(MaterialTextureSampler, vec3(UV, SpecularLayer)).rgb) * 0.3;
 
 	// Distance to the light
 	float distance = length(LightPosition_worldspace - Position_worldspace);
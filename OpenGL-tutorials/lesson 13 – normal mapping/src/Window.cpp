@@ -6,11 +6,17 @@
 #include "Input.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "SamplerCache.h"
 #include "Controls.h"
 #include "ObjLoader.h"
+#include "Mesh.h"
 #include "VBOIndexer.h"
 #include "TangentSpace.h"
 
+// Pack the specular map into the B channel of the normal map (RGB8) instead of
+// using a BC5 normal map plus a separate specular texture: one sampler bind less.
+static const bool PACK_SPECULAR_IN_NORMAL_MAP = false;
+
 
 Window::Window(int width, int height, const std::string name)
 {
@@ -64,11 +70,6 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
     // Load shaders from the GLSL sources.
     GLuint programID = LoadShaders(
             "../lesson 13 – normal mapping/VertexShader.glsl",
@@ -81,15 +82,34 @@ void Window::Run()
     GLint ModelMatrixID = glGetUniformLocation(programID, "M");
     GLint ModelView3x3MatrixID = glGetUniformLocation(programID, "MV3x3");
 
-    // Load the texture
-    GLuint DiffuseTexture = loadDDS("../lesson 13 – normal mapping/diffuse.DDS");
-    GLuint NormalTexture = loadBMP_custom("../lesson 13 – normal mapping/normal.bmp");
-    GLuint SpecularTexture = loadDDS("../lesson 13 – normal mapping/specular.DDS");
-
-    // Get a handle for our "myTextureSampler" uniform
-    GLint DiffuseTextureID = glGetUniformLocation(programID, "DiffuseTextureSampler");
+    // Load the textures. Diffuse and specular maps share one texture array:
+    // layer 0 is the diffuse map, layer 1 the specular map (unless it is packed in the normal map).
+    // More materials would simply append their layers and select them per draw.
+    std::vector<std::string> materialLayers;
+    materialLayers.push_back("../lesson 13 – normal mapping/diffuse.DDS");
+    GLuint NormalTexture;
+    if (PACK_SPECULAR_IN_NORMAL_MAP)
+    {
+        NormalTexture = loadBMP_normalRG_specular(
+            "../lesson 13 – normal mapping/normal.bmp",
+            "../lesson 13 – normal mapping/specular.DDS"
+        );
+    }
+    else
+    {
+        NormalTexture = loadBMP_normalRG("../lesson 13 – normal mapping/normal.bmp");
+        materialLayers.push_back("../lesson 13 – normal mapping/specular.DDS");
+    }
+    GLuint MaterialTexture = loadDDSArray(materialLayers);
+    const int DiffuseLayer = 0;
+    const int SpecularLayer = 1;
+
+    // Get a handle for our sampler and layer uniforms
+    GLint MaterialTextureID = glGetUniformLocation(programID, "MaterialTextureSampler");
+    GLint DiffuseLayerID = glGetUniformLocation(programID, "DiffuseLayer");
+    GLint SpecularLayerID = glGetUniformLocation(programID, "SpecularLayer");
     GLint NormalTextureID = glGetUniformLocation(programID, "NormalTextureSampler");
-    GLint SpecularTextureID = glGetUniformLocation(programID, "SpecularTextureSampler");
+    GLint SpecularInNormalMapID = glGetUniformLocation(programID, "SpecularInNormalMap");
 
     // Read our .obj file
     std::vector<glm::vec3> vertices;
@@ -105,47 +125,17 @@ void Window::Run()
     );
 
     std::vector<unsigned short> indices;
-    std::vector<glm::vec3> indexed_vertices;
-    std::vector<glm::vec2> indexed_uvs;
-    std::vector<glm::vec3> indexed_normals;
-    std::vector<glm::vec3> indexed_tangents;
-    std::vector<glm::vec3> indexed_bitangents;
+    std::vector<InterleavedVertexTBN> indexed_vertices;
     indexVBO_TBN(
         vertices, uvs, normals, tangents, bitangents,
-        indices, indexed_vertices, indexed_uvs, indexed_normals, indexed_tangents, indexed_bitangents
+        indices, indexed_vertices
     );
 
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-    GLuint tangentBuffer;
-    glGenBuffers(1, &tangentBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_tangents.size() * sizeof(glm::vec3), &indexed_tangents[0], GL_STATIC_DRAW);
-
-    GLuint bitangentBuffer;
-    glGenBuffers(1, &bitangentBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, bitangentBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_bitangents.size() * sizeof(glm::vec3), &indexed_bitangents[0], GL_STATIC_DRAW);
-
-    // Generate a buffer for the indices as well
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+    // Load it into one interleaved VBO, recording the strided layout in the mesh's VAO once:
+    // vertices, UVs, normals, tangents and bitangents, then the indices.
+    Mesh cylinder;
+    cylinder.AddInterleaved(indexed_vertices);
+    cylinder.SetIndices(indices);
 
     // Get a handle for our "LightPosition" uniform
     glUseProgram(programID);
@@ -202,61 +192,25 @@ void Window::Run()
         glm::vec3 lightPos = glm::vec3(0,0,4);
         glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
 
-        // Bind our diffuse texture in Texture Unit 0
+        // Bind our material texture array in Texture Unit 0
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, DiffuseTexture);
-        // Set our "DiffuseTextureSampler" sampler to user Texture Unit 0
-        glUniform1i(DiffuseTextureID, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, MaterialTexture);
+        bindSampler(0, trilinearSampler(4.0f));
+        // Set our "MaterialTextureSampler" sampler to user Texture Unit 0
+        glUniform1i(MaterialTextureID, 0);
+        glUniform1i(DiffuseLayerID, DiffuseLayer);
+        glUniform1i(SpecularLayerID, SpecularLayer);
+        glUniform1i(SpecularInNormalMapID, PACK_SPECULAR_IN_NORMAL_MAP);
 
         // Bind our normal texture in Texture Unit 1
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, NormalTexture);
-        // Set our "Normal	TextureSampler" sampler to user Texture Unit 1
+        bindSampler(1, linearSampler());
+        // Set our "NormalTextureSampler" sampler to user Texture Unit 1
         glUniform1i(NormalTextureID, 1);
 
-        // Bind our normal texture in Texture Unit 2
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, SpecularTexture);
-        // Set our "Normal	TextureSampler" sampler to user Texture Unit 2
-        glUniform1i(SpecularTextureID, 2);
-
-
-        // 1rst attribute buffer : vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer : UVs
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 4th attribute buffer : tangents
-        glEnableVertexAttribArray(3);
-        glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 5th attribute buffer : bitangents
-        glEnableVertexAttribArray(4);
-        glBindBuffer(GL_ARRAY_BUFFER, bitangentBuffer);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer.
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-
-        // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
-        glDisableVertexAttribArray(3);
-        glDisableVertexAttribArray(4);
+        // Draw the triangles: one VAO bind replaces the five attribute setups.
+        cylinder.Draw();
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -265,17 +219,11 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteBuffers(1, &tangentBuffer);
-    glDeleteBuffers(1, &bitangentBuffer);
-    glDeleteBuffers(1, &elementBuffer);
+    cylinder.Destroy();
     glDeleteProgram(programID);
-    glDeleteTextures(1, &DiffuseTexture);
+    glDeleteTextures(1, &MaterialTexture);
     glDeleteTextures(1, &NormalTexture);
-    glDeleteTextures(1, &SpecularTexture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteSamplers();
 
     glfwTerminate();
 }
@@ -6,6 +6,8 @@
 #include "Input.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "SamplerCache.h"
+#include "ShaderReload.h"
 #include "Controls.h"
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
@@ -145,11 +147,9 @@ void Window::Run()
 
     glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
 
-    // Poor filtering. Needed!
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Poor filtering. Needed! The texture has no mipmaps, so the sampler must not use them.
+    GLuint renderedSampler = getSampler(nearestSampler(GL_CLAMP_TO_EDGE));
+    GLuint sceneSampler = getSampler(trilinearSampler(4.0f));
 
     // The depth buffer
     GLuint depthRenderBuffer;
@@ -196,6 +196,16 @@ void Window::Run()
     GLint texID = glGetUniformLocation(quad_programID, "renderedTexture");
     GLint timeID = glGetUniformLocation(quad_programID, "time");
 
+    // Edit the post-processing shader (e.g. switch to WobblyTexture.glsl's effect) while running.
+    WatchProgram(quad_programID,
+            "../lesson 14 – render to texture/Passthrough.glsl",
+            "../lesson 14 – render to texture/SimpleTexture.glsl",
+            [&](GLuint program) {
+                texID = glGetUniformLocation(program, "renderedTexture");
+                timeID = glGetUniformLocation(program, "time");
+            }
+    );
+
     // -------------------
     // Enable depth test.
     glEnable(GL_DEPTH_TEST);
@@ -208,6 +218,8 @@ void Window::Run()
 
     do
     {
+        ReloadChangedShaders();
+
         // Render to our framebuffer.
         glBindFramebuffer(GL_FRAMEBUFFER, FramebufferName);
         // Render on the whole framebuffer, complete from the lower left corner to the upper right.
@@ -238,6 +250,7 @@ void Window::Run()
         // Bind our texture in Texture Unit 0.
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
+        bindSampler(0, sceneSampler);
         // Set our "myTextureSampler" sampler to user Texture Unit 0.
         glUniform1i(textureID, 0);
 
@@ -280,6 +293,7 @@ void Window::Run()
         // Bind our texture in Texture Unit 0.
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, renderedTexture);
+        bindSampler(0, renderedSampler);
 
         // Set our "renderedTexture" sampler to user Texture Unit 0.
         glUniform1i(texID, 0);
@@ -307,10 +321,12 @@ void Window::Run()
     glDeleteBuffers(1, &normalBuffer);
     glDeleteBuffers(1, &elementBuffer);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
+    deleteTexture(texture);
 
     glDeleteFramebuffers(1, &FramebufferName);
     glDeleteTextures(1, &renderedTexture);
+    deleteSamplers();
+    StopShaderWatcher();
     glDeleteRenderbuffers(1, &depthRenderBuffer);
     glDeleteBuffers(1, &quad_vertexbuffer);
     glDeleteVertexArrays(1, &vertexArrayID);
@@ -7,10 +7,47 @@ in vec2 UV;
 out vec3 color;
 
 // Values that stay constant for the whole mesh.
-uniform sampler2D myTextureSampler;
+#ifdef VIRTUAL_TEXTURE
+uniform sampler2D PageTable;      // Per tile and mip: cache slot x, y and level of the resident data
+uniform sampler2D PhysicalCache;  // Resident tiles
+uniform vec2 VirtualScale;        // Source image size / padded virtual texture size
+uniform int PageTableSize;        // Tiles per side at level 0
+uniform float TileSize;           // Tile side, in texels
+uniform float CacheTiles;         // Physical cache side, in tiles
+uniform int MaxLevel;
+#else
+uniform sampler2D myTextureSampler;  // Whole lightmap, when it cannot be streamed
+#endif
+
+// Same bias as the former texture(myTextureSampler, UV, -2.0) lookup.
+const float LodBias = -2.0;
 
 void main()
 {
+#ifdef VIRTUAL_TEXTURE
+	vec2 virtualUV = clamp(UV, 0.0, 1.0) * VirtualScale;
+
+	// Mipmap level the hardware would have picked for the whole virtual texture.
+	vec2 texel = virtualUV * float(PageTableSize) * TileSize;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + LodBias;
+	int level = clamp(int(floor(lod)), 0, MaxLevel);
+
+	// The page table points to this tile, or to its closest resident parent.
+	int tiles = PageTableSize >> level;
+	ivec2 page = min(ivec2(virtualUV * float(tiles)), ivec2(tiles - 1));
+	vec3 entry = texelFetch(PageTable, page, level).rgb * 255.0 + 0.5;
+	int residentLevel = int(entry.z);
+
+	// Position inside the resident tile, kept half a texel away from the neighbouring slots.
+	vec2 inTile = fract(virtualUV * float(PageTableSize >> residentLevel));
+	inTile = clamp(inTile, 0.5 / TileSize, 1.0 - 0.5 / TileSize);
+	vec2 cacheUV = (floor(entry.xy) + inTile) / CacheTiles;
+
 	// Output color = color of the texture at the specified UV
-	color = texture(myTextureSampler, UV, -2.0).rgb;
+	color = textureLod(PhysicalCache, cacheUV, 0.0).rgb;
+#else
+	color = texture(myTextureSampler, UV, LodBias).rgb;
+#endif
 }
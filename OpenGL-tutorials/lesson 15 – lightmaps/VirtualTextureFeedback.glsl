@@ -0,0 +1,33 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
+// Ouput data : tile x, tile y and mipmap level needed by this pixel, alpha marks it as written.
+layout(location = 0) out uvec4 feedback;
+
+// Values that stay constant for the whole mesh.
+uniform vec2 VirtualScale;        // Source image size / padded virtual texture size
+uniform int PageTableSize;        // Tiles per side at level 0
+uniform float TileSize;           // Tile side, in texels
+uniform int MaxLevel;
+uniform float FeedbackBias;       // -log2(screen size / feedback size)
+
+// Must match the bias of FragmentShader.glsl.
+const float LodBias = -2.0;
+
+void main()
+{
+	vec2 virtualUV = clamp(UV, 0.0, 1.0) * VirtualScale;
+
+	// The feedback buffer is smaller than the screen, so its derivatives are larger.
+	vec2 texel = virtualUV * float(PageTableSize) * TileSize;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + LodBias + FeedbackBias;
+	int level = clamp(int(floor(lod)), 0, MaxLevel);
+
+	int tiles = PageTableSize >> level;
+	ivec2 page = min(ivec2(virtualUV * float(tiles)), ivec2(tiles - 1));
+	feedback = uvec4(uvec2(page), uint(level), 1u);
+}
@@ -29,10 +29,20 @@ public:
      * Run the main loop for an application.
      */
     void Run();
+
+    /**
+     * Times building and querying bounding volume hierarchies before the first frame of Run().
+     */
+    void EnableHierarchyBenchmark() { hierarchyBenchmark = true; }
 private:
     /**
      * GLFW window instance.
      */
    GLFWwindow* window;
+
+    /**
+     * Whether Run() starts with the hierarchy benchmark.
+     */
+    bool hierarchyBenchmark = false;
 };
 #endif
@@ -1,13 +1,94 @@
 #include "Window.h"
+#include <cfloat>
+#include <chrono>
 #include <iostream>
+#include <random>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Input.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "SamplerCache.h"
 #include "Controls.h"
 #include "ObjLoader.h"
+#include "BoundingVolumeHierarchy.h"
+#include "VirtualTexture.h"
+
+// Side of the physical tile cache, in tiles: bounds the GPU memory of the lightmap.
+static const unsigned int CACHE_TILES = 8;
+// The feedback pass is rendered at 1/FEEDBACK_SCALE of the window resolution.
+static const int FEEDBACK_SCALE = 8;
+
+// Sizes of the bounding volume hierarchy benchmark (--bvh-benchmark).
+static const unsigned int BVH_BENCHMARK_OBJECTS = 1000000;
+static const unsigned int BVH_BENCHMARK_RAYS = 100000;
+
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/**
+ * Builds a hierarchy over a million random boxes with one thread and with all of them,
+ * culls it against a view frustum and casts random rays at the triangles of the room.
+ */
+static void benchmarkBoundingVolumeHierarchy(const BoundingVolumeHierarchy & room, const RayObjectTest & roomTest)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+    std::vector<BoundingBox> boxes(BVH_BENCHMARK_OBJECTS);
+    for (BoundingBox & box : boxes)
+    {
+        glm::vec3 center(uniform(random) * 500.f, uniform(random) * 50.f, uniform(random) * 500.f);
+        box.min = center - glm::vec3(1.f);
+        box.max = center + glm::vec3(1.f);
+    }
+
+    BoundingVolumeHierarchy scene;
+    for (unsigned int threads : {1u, 0u})
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        scene.Build(boxes, threads);
+        double milliseconds = millisecondsSince(start);
+        std::cout << "BVH build, " << (threads ? "1 thread" : "all threads") << ": " << milliseconds << " ms, "
+                  << boxes.size() / milliseconds / 1000.0 << " M objects/s, " << scene.GetNodes().size()
+                  << " nodes" << std::endl;
+    }
+
+    glm::mat4 viewProjection = glm::perspective(glm::radians(FOV), ASPECT_RATIO, Z_NEAR, 1000.f)
+                             * glm::lookAt(glm::vec3(0, 10, 0), glm::vec3(0, 10, -1), glm::vec3(0, 1, 0));
+    Frustum frustum = extractFrustum(viewProjection);
+    std::vector<uint32_t> visible;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scene.QueryFrustum(frustum, visible);
+    std::cout << "BVH frustum query: " << visible.size() << " of " << boxes.size() << " objects in "
+              << millisecondsSince(start) << " ms" << std::endl;
+
+    // Rays from inside the room, in every direction.
+    const std::vector<BvhNode> & nodes = room.GetNodes();
+    glm::vec3 center = (nodes[0].min + nodes[0].max) * 0.5f;
+    glm::vec3 extent = (nodes[0].max - nodes[0].min) * 0.4f;
+    std::vector<Ray> rays(BVH_BENCHMARK_RAYS);
+    for (Ray & ray : rays)
+    {
+        ray.origin = center + extent * glm::vec3(uniform(random), uniform(random), uniform(random));
+        ray.direction = glm::normalize(glm::vec3(uniform(random), uniform(random), uniform(random)));
+        ray.maxDistance = FLT_MAX;
+    }
+    size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (const Ray & ray : rays)
+    {
+        RayHit hit;
+        hits += room.Raycast(ray, hit, roomTest);
+    }
+    double milliseconds = millisecondsSince(start);
+    std::cout << "BVH ray casts against " << room.GetSize() << " triangles: " << hits << " of " << rays.size()
+              << " hit, " << rays.size() / milliseconds / 1000.0 << " M rays/s" << std::endl;
+}
 
 
 Window::Window(int width, int height, const std::string name)
@@ -62,25 +143,58 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
+    // Get the actual framebuffer size (it differs from the window size on retina screens).
+    int windowWidth, windowHeight;
+    glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+
     // Create Vertex Array Object (VAO).
     GLuint vertexArrayID;
     glGenVertexArrays(1, &vertexArrayID);
     glBindVertexArray(vertexArrayID);
 
+    // Split the lightmap into tiles once, then stream it as a virtual texture.
+    const char * lightmapPath = "../lesson 15 – lightmaps/lightmap.vt";
+    FILE * tiles = fopen(lightmapPath, "rb");
+    if (tiles)
+        fclose(tiles);
+    else
+        splitVirtualTexture("../lesson 15 – lightmaps/lightmap.bmp", lightmapPath);
+
+    VirtualTexture lightmap;
+    bool streamed = lightmap.Open(lightmapPath, CACHE_TILES,
+                                  windowWidth / FEEDBACK_SCALE, windowHeight / FEEDBACK_SCALE, FEEDBACK_SCALE);
+
+    // Without the tile file, load the whole lightmap as a regular texture.
+    GLuint Texture = 0;
+    if (!streamed)
+    {
+        std::cout << "Falling back to a regular lightmap texture." << std::endl;
+        Texture = loadBMP_custom("../lesson 15 – lightmaps/lightmap.bmp");
+    }
+
     // Load shaders from the GLSL sources.
+    std::vector<std::string> lightmapDefines;
+    if (streamed)
+        lightmapDefines.push_back("VIRTUAL_TEXTURE");
     GLuint programID = LoadShaders(
             "../lesson 15 – lightmaps/VertexShader.glsl",
-            "../lesson 15 – lightmaps/FragmentShader.glsl"
+            "../lesson 15 – lightmaps/FragmentShader.glsl",
+            lightmapDefines
+    );
+
+    GLuint feedbackProgramID = LoadShaders(
+            "../lesson 15 – lightmaps/VertexShader.glsl",
+            "../lesson 15 – lightmaps/VirtualTextureFeedback.glsl"
     );
 
     // Get a handle for our "MVP" uniform
     GLint MatrixID = glGetUniformLocation(programID, "MVP");
+    GLint FeedbackMatrixID = glGetUniformLocation(feedbackProgramID, "MVP");
 
-    // Load the texture
-    GLuint Texture = loadBMP_custom("../lesson 15 – lightmaps/lightmap.bmp");
-
-    // Get a handle for our "myTextureSampler" uniform
-    GLint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
+    // Get a handle for our "myTextureSampler" uniform and the virtual texture uniforms
+    GLint TextureID = glGetUniformLocation(programID, "myTextureSampler");
+    VirtualTextureUniforms lightmapUniforms = getVirtualTextureUniforms(programID);
+    VirtualTextureUniforms feedbackUniforms = getVirtualTextureUniforms(feedbackProgramID);
 
     // Read our .obj file
     std::vector<glm::vec3> vertices;
@@ -88,6 +202,17 @@ void Window::Run()
     std::vector<glm::vec3> normals; // Won't be used at the moment.
     bool res = loadOBJ("../lesson 15 – lightmaps/room.obj", vertices, uvs, normals);
 
+    // Index the triangles of the room for ray casts.
+    BoundingVolumeHierarchy roomHierarchy;
+    roomHierarchy.Build(computeTriangleBoxes(vertices));
+    RayObjectTest roomTest = [&vertices](uint32_t triangle, const Ray & ray, float & distance) {
+        return intersectRayTriangle(ray, vertices[3 * triangle], vertices[3 * triangle + 1],
+                                    vertices[3 * triangle + 2], distance);
+    };
+    if (hierarchyBenchmark)
+        benchmarkBoundingVolumeHierarchy(roomHierarchy, roomTest);
+    uint32_t lookedAtTriangle = UINT32_MAX;
+
     // Load it into a VBO
     GLuint vertexbuffer;
     glGenBuffers(1, &vertexbuffer);
@@ -110,11 +235,9 @@ void Window::Run()
 
     do
     {
-        // Clear the screen.
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Use our shader.
-        glUseProgram(programID);
+        // Stream in the tiles requested by the previous frame's feedback.
+        if (streamed)
+            lightmap.Update();
 
         // Compute the MVP matrix from keyboard and mouse input.
         computeMatricesFromInputs(window);
@@ -123,14 +246,21 @@ void Window::Run()
         glm::mat4 ModelMatrix = glm::mat4(1.0);
         glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
-        // Send our transformation to the currently bound shader, in the "MVP" uniform.
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        // Bind our texture in Texture Unit 0.
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, Texture);
-        // Set our "myTextureSampler" sampler to user Texture Unit 0.
-        glUniform1i(TextureID, 0);
+        // With the BVH diagnostics, cast a ray along the view direction (the third row of
+        // the view matrix negated) and report the triangle it hits when that changes.
+        if (hierarchyBenchmark)
+        {
+            Ray ray;
+            ray.origin = getCameraPosition();
+            ray.direction = -glm::vec3(ViewMatrix[0][2], ViewMatrix[1][2], ViewMatrix[2][2]);
+            ray.maxDistance = Z_FAR;
+            RayHit hit;
+            if (roomHierarchy.Raycast(ray, hit, roomTest) && hit.object != lookedAtTriangle)
+            {
+                std::cout << "Looking at triangle " << hit.object << ", " << hit.distance << " units away" << std::endl;
+                lookedAtTriangle = hit.object;
+            }
+        }
 
         // 1rst attribute buffer : vertices.
         glEnableVertexAttribArray(0);
@@ -142,6 +272,42 @@ void Window::Run()
         glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
+        // Feedback pass: record which tiles and mipmaps are visible.
+        if (streamed)
+        {
+            lightmap.BeginFeedback();
+            glUseProgram(feedbackProgramID);
+            glUniformMatrix4fv(FeedbackMatrixID, 1, GL_FALSE, &MVP[0][0]);
+            lightmap.BindFeedback(feedbackUniforms);
+            glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+            lightmap.EndFeedback(windowWidth, windowHeight);
+        }
+
+        // Clear the screen.
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Use our shader.
+        glUseProgram(programID);
+
+        // Send our transformation to the currently bound shader, in the "MVP" uniform.
+        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+
+        if (streamed)
+        {
+            // Bind the page table in Texture Unit 0 and the tile cache in Texture Unit 1.
+            lightmap.Bind(lightmapUniforms, 0, 1);
+        }
+        else
+        {
+            // Bind our texture in Texture Unit 0.
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, Texture);
+            // The BMP has a single level: sample it without mipmaps.
+            bindSampler(0, linearSampler());
+            // Set our "myTextureSampler" sampler to user Texture Unit 0.
+            glUniform1i(TextureID, 0);
+        }
+
         // Draw the triangles.
         glDrawArrays(GL_TRIANGLES, 0, vertices.size());
 
@@ -158,7 +324,10 @@ void Window::Run()
     glDeleteBuffers(1, &vertexbuffer);
     glDeleteBuffers(1, &uvbuffer);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &Texture);
+    glDeleteProgram(feedbackProgramID);
+    deleteTexture(Texture);
+    lightmap.Close();
+    deleteSamplers();
     glDeleteVertexArrays(1, &vertexArrayID);
 
     glfwTerminate();
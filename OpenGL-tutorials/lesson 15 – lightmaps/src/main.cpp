@@ -1,9 +1,18 @@
+#include <cstring>
+
 #include "Window.h"
 
 
-int main()
+// --bvh-benchmark times building and querying bounding volume hierarchies first, then
+// reports the room triangle under the view direction whenever it changes.
+int main(int argc, char * argv[])
 {
     Window window;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bvh-benchmark") == 0)
+            window.EnableHierarchyBenchmark();
+    }
     window.Initialize();
     window.Run();
     return 0;
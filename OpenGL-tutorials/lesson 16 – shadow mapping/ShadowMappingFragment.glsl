@@ -17,33 +17,11 @@ uniform mat4 MV;
 uniform vec3 LightPosition_worldspace;
 uniform sampler2DShadow shadowMap;
 
-vec2 poissonDisk[16] = vec2[]
-(
-   vec2(-0.94201624,  -0.39906216),
-   vec2( 0.94558609,  -0.76890725),
-   vec2(-0.094184101, -0.92938870),
-   vec2( 0.34495938,   0.29387760),
-   vec2(-0.91588581,   0.45771432),
-   vec2(-0.81544232,  -0.87912464),
-   vec2(-0.38277543,   0.27676845),
-   vec2( 0.97484398,   0.75648379),
-   vec2( 0.44323325,  -0.97511554),
-   vec2( 0.53742981,  -0.47373420),
-   vec2(-0.26496911,  -0.41893023),
-   vec2( 0.79197514,   0.19090188),
-   vec2(-0.24188840,   0.99706507),
-   vec2(-0.81409955,   0.91437590),
-   vec2( 0.19984126,   0.78641367),
-   vec2( 0.14383161,  -0.14100790)
-);
-
-// Returns a random number based on a vec3 and an int.
-float random(vec3 seed, int i)
-{
-	vec4 seed4 = vec4(seed, i);
-	float dot_product = dot(seed4, vec4(12.9898, 78.233, 45.164, 94.673));
-	return fract(sin(dot_product) * 43758.5453);
-}
+// Compile-time features, defined by the program variant:
+//  - SHADOW_PCF: 4 taps on a Poisson disk instead of a single tap
+//  - SHADOW_RANDOM_SAMPLES: with SHADOW_PCF, pick the taps randomly per world position
+//  - SHADOW_VARIABLE_BIAS: bias following the slope instead of a fixed one
+#include "ShadowSampling.glsl"
 
 void main(){
 
@@ -82,31 +60,38 @@ void main(){
 	
 	float visibility = 1.0;
 
-	// Fixed bias, or...
+#ifdef SHADOW_VARIABLE_BIAS
+	// Variable bias
+	float bias = 0.005*tan(acos(cosTheta));
+	bias = clamp(bias, 0,0.01);
+#else
+	// Fixed bias
 	float bias = 0.005;
+#endif
 
-	// ...variable bias
-	// float bias = 0.005*tan(acos(cosTheta));
-	// bias = clamp(bias, 0,0.01);
-
+#ifdef SHADOW_PCF
 	// Sample the shadow map 4 times
 	for (int i = 0; i < 4; i++)
 	{
-		// use either :
-		//  - Always the same samples.
-		//    Gives a fixed pattern in the shadow, but no noise
+#ifdef SHADOW_RANDOM_SAMPLES
+		// A random sample, based on the pixel's position in world space.
+		// The position is rounded to the millimeter to avoid too much aliasing.
+		// No banding, but some noise.
+		int index = int(16.0*random(floor(Position_worldspace.xyz*1000.0), i))%16;
+#else
+		// Always the same samples.
+		// Gives a fixed pattern in the shadow, but no noise
 		int index = i;
-		//  - A random sample, based on the pixel's screen location. 
-		//    No banding, but the shadow moves with the camera, which looks weird.
-		// int index = int(16.0*random(gl_FragCoord.xyy, i))%16;
-		//  - A random sample, based on the pixel's position in world space.
-		//    The position is rounded to the millimeter to avoid too much aliasing
-		// int index = int(16.0*random(floor(Position_worldspace.xyz*1000.0), i))%16;
-		
+#endif
+
 		// being fully in the shadow will eat up 4*0.2 = 0.8
 		// 0.2 potentially remain, which is quite dark.
 		visibility -= 0.2 * (1.0 - texture(shadowMap, vec3(ShadowCoord.xy + poissonDisk[index] / 700.0, (ShadowCoord.z - bias) / ShadowCoord.w)));
 	}
+#else
+	// A single tap, bilinearly filtered by the comparison sampler
+	visibility -= 0.8 * (1.0 - texture(shadowMap, vec3(ShadowCoord.xy, (ShadowCoord.z - bias) / ShadowCoord.w)));
+#endif
 
 	// For spot lights, use either one of these lines instead.
 	// if ( texture( shadowMap, (ShadowCoord.xy/ShadowCoord.w) ).z  <  (ShadowCoord.z-bias)/ShadowCoord.w )
@@ -120,4 +105,4 @@ void main(){
 		// Specular : reflective highlight, like a mirror
 		visibility * MaterialSpecularColor * LightColor * LightPower * pow(cosAlpha,5);
 
-}
\ No newline at end of file
+}
\ No newline at end of file
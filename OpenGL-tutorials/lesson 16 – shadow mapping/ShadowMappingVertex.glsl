@@ -13,34 +13,31 @@ out vec3 EyeDirection_cameraspace;
 out vec3 LightDirection_cameraspace;
 out vec4 ShadowCoord;
 
-// Values that stay constant for the whole mesh.
-uniform mat4 MVP;
-uniform mat4 V;
-uniform mat4 M;
-uniform vec3 LightInvDirection_worldspace;
-uniform mat4 DepthBiasMVP;
+// View, projection and light come from the per-frame block, model matrices from
+// the per-object block.
+#include "../common/UniformBlocks.glsl"
 
 
 void main()
 {
 	// Output position of the vertex, in clip space : MVP * position.
-	gl_Position =  MVP * vec4(vertexPosition_modelspace, 1);
+	gl_Position =  ModelViewProjection * vec4(vertexPosition_modelspace, 1);
 
     // Same, but with the light's view matrix.
-	ShadowCoord = DepthBiasMVP * vec4(vertexPosition_modelspace, 1);
+	ShadowCoord = ShadowMatrix * vec4(vertexPosition_modelspace, 1);
 
 	// Position of the vertex, in worldspace : M * position.
-	Position_worldspace = (M * vec4(vertexPosition_modelspace, 1)).xyz;
+	Position_worldspace = (Model * vec4(vertexPosition_modelspace, 1)).xyz;
 	
 	// Vector that goes from the vertex to the camera, in camera space.
 	// In camera space, the camera is at the origin (0, 0, 0).
-	EyeDirection_cameraspace = vec3(0, 0, 0) - (V * M * vec4(vertexPosition_modelspace, 1)).xyz;
+	EyeDirection_cameraspace = vec3(0, 0, 0) - (View * Model * vec4(vertexPosition_modelspace, 1)).xyz;
 
 	// Vector that goes from the vertex to the light, in camera space.
-	LightDirection_cameraspace = (V * vec4(LightInvDirection_worldspace, 0)).xyz;
+	LightDirection_cameraspace = (View * vec4(Light_worldspace.xyz, 0)).xyz;
 	
 	// Normal of the the vertex, in camera space.
-	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz; // Only correct if ModelMatrix does not scale the model ! Use its inverse transpose if not.
+	Normal_cameraspace = (View * Model * vec4(vertexNormal_modelspace, 0)).xyz; // Only correct if ModelMatrix does not scale the model ! Use its inverse transpose if not.
 	
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
@@ -3,10 +3,10 @@
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 
-// Values that stay constant for the whole mesh.
-uniform mat4 depthMVP;
+// ModelViewProjection is the light's depth MVP during the shadow pass.
+#include "../common/UniformBlocks.glsl"
 
 void main()
 {
-	gl_Position =  depthMVP * vec4(vertexPosition_modelspace, 1);
+	gl_Position =  ModelViewProjection * vec4(vertexPosition_modelspace, 1);
 }
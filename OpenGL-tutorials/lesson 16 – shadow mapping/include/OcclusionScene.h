@@ -0,0 +1,45 @@
+#ifndef OCCLUSION_SCENE_H
+#define OCCLUSION_SCENE_H
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "PotentiallyVisibleSet.h"
+
+static const std::string ROOM_PATH = "../lesson 16 – shadow mapping/room.obj";
+static const std::string CAMERA_PATH = "../lesson 16 – shadow mapping/CameraPath.txt";
+static const std::string PVS_PATH = "../lesson 16 – shadow mapping/Props.pvs";
+
+/**
+ * Boxes laid on the floor on a grid, inside the room and all around it: the props
+ * culled by the frustum, then by the room walls.
+ */
+std::vector<BoundingBox> makeOcclusionProps();
+
+/**
+ * Bakes the potentially visible props of each cell the camera can be in, with the room
+ * as occluder, and saves them. Runs on the CPU only.
+ * @return The process exit code.
+ */
+int bakePotentiallyVisibleSet(const std::string & path);
+
+/**
+ * Loads the visibility set of PVS_PATH, or bakes and saves it again when the file is
+ * missing, invalid, or was baked for other props or another grid.
+ * @param roomVertices Triangles of the room, the occluder.
+ * @return Whether `pvs` holds a set for these props.
+ */
+bool loadPotentiallyVisibleSet(PotentiallyVisibleSet & pvs, const std::vector<BoundingBox> & props,
+                               const std::vector<glm::vec3> & roomVertices);
+
+/**
+ * Replays the camera path with the room as occluder and prints, for each key and in
+ * total, how many props are in the frustum, how many of those the room hides, and how
+ * many of the rest the baked visibility set rejects, baking it first when needed. Runs
+ * on the CPU only, without a window or a GL context.
+ * @return The process exit code: 1 when the totals differ from the expected ones.
+ */
+int runOcclusionReport(const std::string & cameraPath);
+#endif
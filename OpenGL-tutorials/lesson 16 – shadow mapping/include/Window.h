@@ -29,10 +29,27 @@ public:
      * Run the main loop for an application.
      */
     void Run();
+
+    /**
+     * Saves the camera poses of the next Run() to a path file, for the occlusion report.
+     * @param path Camera path file.
+     */
+    void RecordCameraPath(const std::string & path);
+
+    /**
+     * Exercises the texture budget without drawing and prints what it evicted.
+     * @return 0 when textures were evicted and restored and the budget was met, 1 otherwise.
+     */
+    int RunTextureResidencyReport();
 private:
     /**
      * GLFW window instance.
      */
    GLFWwindow* window;
+
+    /**
+     * Where to save the camera path; empty when not recording.
+     */
+    std::string cameraPathFile;
 };
 #endif
@@ -0,0 +1,182 @@
+#include "OcclusionScene.h"
+#include <cmath>
+#include <iostream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CameraPath.h"
+#include "Controls.h"
+#include "ObjLoader.h"
+#include "OcclusionCuller.h"
+#include "PotentiallyVisibleSet.h"
+
+// PROP_GRID x PROP_GRID props, PROP_SPACING apart, centered on the room.
+static const int PROP_GRID = 40;
+static const float PROP_SPACING = 1.f;
+static const float PROP_SIZE = 0.5f;
+static const float FLOOR_HEIGHT = 0.f;
+// The camera moves over the props, from the floor of the room to its ceiling.
+static const float CEILING_HEIGHT = 6.f;
+static const float PVS_CELL_SIZE = 2.5f;
+static const unsigned int PVS_SAMPLES = 64;
+
+// What the report must find along CameraPath.txt, summed over its keys. Edge pixels may
+// round differently with other compilers and SIMD widths, hence the tolerance.
+static const size_t EXPECTED_IN_FRUSTUM = 25044;
+static const size_t EXPECTED_OCCLUDED = 10266;
+static const double EXPECTED_TOLERANCE = 0.005;
+
+
+std::vector<BoundingBox> makeOcclusionProps()
+{
+    std::vector<BoundingBox> props;
+    props.reserve(PROP_GRID * PROP_GRID);
+    float first = -(PROP_GRID - 1) * PROP_SPACING * 0.5f;
+    for (int z = 0; z < PROP_GRID; z++)
+    {
+        for (int x = 0; x < PROP_GRID; x++)
+        {
+            BoundingBox box;
+            box.min = glm::vec3(first + x * PROP_SPACING - PROP_SIZE * 0.5f, FLOOR_HEIGHT,
+                                first + z * PROP_SPACING - PROP_SIZE * 0.5f);
+            box.max = box.min + glm::vec3(PROP_SIZE);
+            props.push_back(box);
+        }
+    }
+    return props;
+}
+
+
+// Where the camera can be: over the props, up to the ceiling.
+static BoundingBox getCameraBounds(const std::vector<BoundingBox> & props)
+{
+    BoundingBox bounds = props[0];
+    for (const BoundingBox & prop : props)
+    {
+        bounds.min = glm::min(bounds.min, prop.min);
+        bounds.max = glm::max(bounds.max, prop.max);
+    }
+    bounds.max.y = CEILING_HEIGHT;
+    return bounds;
+}
+
+
+// Bakes the props visible from each camera cell with the room as occluder and saves them.
+static bool bakeProps(PotentiallyVisibleSet & pvs, const std::vector<BoundingBox> & props,
+                      const std::vector<glm::vec3> & vertices, const std::string & path)
+{
+    BoundingVolumeHierarchy room;
+    room.Build(computeTriangleBoxes(vertices));
+    RayObjectTest roomTest = [&vertices](uint32_t triangle, const Ray & ray, float & distance) {
+        return intersectRayTriangle(ray, vertices[3 * triangle], vertices[3 * triangle + 1],
+                                    vertices[3 * triangle + 2], distance);
+    };
+
+    pvs.Bake(getCameraBounds(props), PVS_CELL_SIZE, props, room, roomTest, PVS_SAMPLES);
+    const PvsBakeStats & stats = pvs.GetBakeStats();
+    std::cout << "PVS: " << stats.cells << " cells, " << stats.objects << " props, " << stats.raysCast
+              << " rays in " << stats.seconds << " s, " << 100.0 * stats.visiblePairs / (stats.cells * stats.objects)
+              << "% visible, " << stats.compressedBytes << " bytes compressed from "
+              << stats.cells * ((stats.objects + 7) / 8) << std::endl;
+    return pvs.Save(path);
+}
+
+
+int bakePotentiallyVisibleSet(const std::string & path)
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    if (!loadOBJ(ROOM_PATH.c_str(), vertices, uvs, normals))
+        return 1;
+
+    PotentiallyVisibleSet pvs;
+    return bakeProps(pvs, makeOcclusionProps(), vertices, path) ? 0 : 1;
+}
+
+
+bool loadPotentiallyVisibleSet(PotentiallyVisibleSet & pvs, const std::vector<BoundingBox> & props,
+                               const std::vector<glm::vec3> & roomVertices)
+{
+    uint64_t hash = PotentiallyVisibleSet::HashScene(getCameraBounds(props), PVS_CELL_SIZE, props);
+    if (pvs.Load(PVS_PATH) && pvs.GetSceneHash() == hash)
+        return true;
+
+    // A set that cannot be saved is still good for this run.
+    std::cout << PVS_PATH << " was not baked for these props, baking it again." << std::endl;
+    bakeProps(pvs, props, roomVertices, PVS_PATH);
+    return !pvs.IsEmpty();
+}
+
+
+int runOcclusionReport(const std::string & cameraPath)
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    CameraPath path;
+    if (!loadOBJ(ROOM_PATH.c_str(), vertices, uvs, normals) || !path.Load(cameraPath))
+        return 1;
+
+    std::vector<BoundingBox> props = makeOcclusionProps();
+    FrustumCuller frustumCuller;
+    frustumCuller.Reserve(props.size());
+    for (const BoundingBox & prop : props)
+        frustumCuller.Add(prop);
+
+    OcclusionCuller occlusionCuller;
+    if (!occlusionCuller.Create())
+        return 1;
+    occlusionCuller.SetOccluders(vertices);
+
+    PotentiallyVisibleSet pvs;
+    if (!loadPotentiallyVisibleSet(pvs, props, vertices))
+        return 1;
+
+    std::cout << "Occlusion report: " << props.size() << " props, " << vertices.size() / 3
+              << " occluder triangles, " << path.GetSize() << " camera keys, " << occlusionCuller.GetWidth()
+              << "x" << occlusionCuller.GetHeight() << " depth buffer" << std::endl;
+
+    glm::mat4 projection = glm::perspective(glm::radians(FOV), ASPECT_RATIO, Z_NEAR, Z_FAR);
+    std::vector<uint32_t> visible;
+    size_t inFrustum = 0, rejected = 0, occluded = 0;
+    double renderMilliseconds = 0.0, cullMilliseconds = 0.0;
+    for (size_t key = 0; key < path.GetSize(); key++)
+    {
+        glm::mat4 viewProjection = projection * path.GetViewMatrix(key);
+        size_t count = frustumCuller.Cull(extractFrustum(viewProjection), visible);
+        // The depth buffer first, so its count does not depend on the visibility set.
+        occlusionCuller.Render(viewProjection);
+        size_t left = occlusionCuller.Cull(props, visible.data(), count);
+        size_t drawn = pvs.Cull(pvs.GetCell(path.GetKey(key).position), visible.data(), left);
+
+        const OcclusionStats & stats = occlusionCuller.GetStats();
+        inFrustum += count;
+        occluded += count - left;
+        rejected += left - drawn;
+        renderMilliseconds += stats.renderMilliseconds;
+        cullMilliseconds += stats.cullMilliseconds;
+        std::cout << "Key " << key << ": " << count << " in frustum, " << count - left << " occluded, "
+                  << left - drawn << " more rejected by the PVS, " << drawn << " drawn, "
+                  << stats.rasterizedTriangles << " triangles rasterized" << std::endl;
+    }
+
+    size_t keys = path.GetSize() ? path.GetSize() : 1;
+    std::cout << "Total: " << inFrustum << " in frustum, " << occluded << " occluded, " << rejected
+              << " more rejected by the PVS (" << (inFrustum ? 100.0 * (occluded + rejected) / inFrustum : 0.0)
+              << "% culled), " << renderMilliseconds / keys << " ms rasterizing and " << cullMilliseconds / keys
+              << " ms testing per key" << std::endl;
+    occlusionCuller.Destroy();
+
+    auto matches = [](size_t count, size_t expected)
+    {
+        return std::fabs(static_cast<double>(count) - expected) <= expected * EXPECTED_TOLERANCE;
+    };
+    if (!matches(inFrustum, EXPECTED_IN_FRUSTUM) || !matches(occluded, EXPECTED_OCCLUDED))
+    {
+        std::cout << "Expected " << EXPECTED_IN_FRUSTUM << " in frustum and " << EXPECTED_OCCLUDED
+                  << " occluded along " << cameraPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
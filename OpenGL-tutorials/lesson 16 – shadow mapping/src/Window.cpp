@@ -1,16 +1,98 @@
 #include "Window.h"
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Input.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "TextureResidency.h"
+#include "SamplerCache.h"
+#include "GLState.h"
+#include "ShaderReload.h"
+#include "ShaderProgram.h"
+#include "ShaderPermutations.h"
+#include "UniformBuffers.h"
 #include "Controls.h"
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
+#include "Mesh.h"
+#include "CameraPath.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "OcclusionScene.h"
+#include "PotentiallyVisibleSet.h"
+
+// GPU memory allowed for the loaded textures (the shadow map is not counted). The room's
+// texture is bound every frame and never evicted: --texture-report shows evictions.
+static const size_t TEXTURE_BUDGET_BYTES = 4 * 1024 * 1024;
+// Texture report: copies of the room's texture, the budget in copies, and frames run.
+static const unsigned int TEXTURE_REPORT_COPIES = 8;
+static const unsigned int TEXTURE_REPORT_BUDGET = 3;
+static const unsigned int TEXTURE_REPORT_FRAMES = 64;
+
+// Feature bits of the shadow shader variants (see ShadowMappingFragment.glsl), in the
+// order of their macro names given to ShaderPermutations.
+enum SHADOW_FEATURE
+{
+    SHADOW_PCF = 1 << 0,
+    SHADOW_RANDOM_SAMPLES = 1 << 1,
+    SHADOW_VARIABLE_BIAS = 1 << 2,
+};
+static const unsigned int SHADOW_FEATURES = SHADOW_PCF;
+
+// Props hidden by the room are not drawn; the report prints what that saved.
+static const bool OCCLUSION_CULLING = true;
+// GPU occlusion queries on the props the CPU culling keeps, whose depth buffer is coarse.
+static const bool OCCLUSION_QUERIES = true;
+// Seconds between two recorded camera poses.
+static const double CAMERA_RECORD_INTERVAL = 0.1;
+
+
+/**
+ * A unit cube from (0, 0, 0) to (1, 1, 1), four vertices per face so that each face
+ * has its own normal and texture coordinates.
+ */
+static void makeCube(std::vector<glm::vec3> & positions, std::vector<glm::vec2> & uvs,
+                     std::vector<glm::vec3> & normals, std::vector<unsigned short> & indices)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            glm::vec3 normal(0.f);
+            normal[axis] = side ? 1.f : -1.f;
+            // Two axes spanning the face, ordered so that its triangles face outwards.
+            glm::vec3 u(0.f), v(0.f);
+            u[(axis + (side ? 1 : 2)) % 3] = 1.f;
+            v[(axis + (side ? 2 : 1)) % 3] = 1.f;
+            glm::vec3 origin(0.f);
+            origin[axis] = static_cast<float>(side);
+
+            unsigned short first = static_cast<unsigned short>(positions.size());
+            for (int corner = 0; corner < 4; corner++)
+            {
+                float s = static_cast<float>(corner & 1);
+                float t = static_cast<float>(corner >> 1);
+                positions.push_back(origin + u * s + v * t);
+                uvs.push_back(glm::vec2(s, t));
+                normals.push_back(normal);
+            }
+            for (unsigned short corner : {0, 1, 3, 0, 3, 2})
+                indices.push_back(static_cast<unsigned short>(first + corner));
+        }
+    }
+}
 
 
+void Window::RecordCameraPath(const std::string & path)
+{
+    cameraPathFile = path;
+}
+
 Window::Window(int width, int height, const std::string name)
 {
     if (!glfwInit())
@@ -36,6 +118,50 @@ Window::Window(int width, int height, const std::string name)
 }
 
 
+int Window::RunTextureResidencyReport()
+{
+    std::vector<GLuint> textures;
+    for (unsigned int i = 0; i < TEXTURE_REPORT_COPIES; i++)
+        textures.push_back(loadDDS("../lesson 16 – shadow mapping/uvmap.dds"));
+    size_t textureBytes = getTextureResidencyStats().residentBytes / TEXTURE_REPORT_COPIES;
+    setTextureBudget(textureBytes * TEXTURE_REPORT_BUDGET);
+
+    // Each frame binds two copies, moving to the next ones every four frames: the copies
+    // left aside lose mipmaps, and get them back when their turn comes again.
+    TextureResidencyStats stats;
+    unsigned int frame = 0;
+    do
+    {
+        unsigned int first = (std::min(frame, TEXTURE_REPORT_FRAMES) / 4) % TEXTURE_REPORT_COPIES;
+        bindTexture2D(0, textures[first]);
+        bindTexture2D(1, textures[(first + 1) % TEXTURE_REPORT_COPIES]);
+        enforceTextureBudget();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));  // Lets the loader thread read
+        stats = getTextureResidencyStats();
+        frame++;
+    }
+    // Past the last frame, the same two copies stay bound until the reads in flight are in.
+    while (frame < TEXTURE_REPORT_FRAMES || (stats.loading > 0 && frame < 4 * TEXTURE_REPORT_FRAMES));
+
+    std::cout << "Texture report: " << TEXTURE_REPORT_COPIES << " textures of " << textureBytes / 1024.0
+              << " KB, " << stats.residentBytes / 1024.0 << " KB resident of " << stats.budgetBytes / 1024.0
+              << " KB budget, " << stats.evictions << " mipmaps evicted, " << stats.reuploads
+              << " re-uploads over " << frame << " frames" << std::endl;
+
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        deleteTexture(textures[i]);
+    }
+    shutdownTextureResidency();
+    glfwTerminate();
+
+    bool met = stats.evictions > 0 && stats.reuploads > 0 && stats.residentBytes <= stats.budgetBytes;
+    if (!met)
+        std::cout << "Texture report: the budget did not evict and restore as expected." << std::endl;
+    return met ? 0 : 1;
+}
+
+
 // Initialize OpenGL context.
 void Window::Initialize()
 {
@@ -73,21 +199,20 @@ void Window::Run()
     // But on MacOS X with a retina screen it'll be 1024*2 and 768*2, so we get the actual framebuffer size.
     glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
-    // Create and compile our GLSL program from the shaders
-    GLuint depthProgramID = LoadShaders(
+    // Submit our GLSL programs now: the driver compiles them while we load the assets.
+    // The render loop polls them and draws without them until the driver is done.
+    GLuint depthProgramID = QueueShaders(
             "../lesson 16 – shadow mapping/VertexShader.glsl",
             "../lesson 16 – shadow mapping/FragmentShader.glsl"
     );
+    GLuint quad_programID = QueueShaders(
+            "../lesson 16 – shadow mapping/Passthrough.glsl",
+            "../lesson 16 – shadow mapping/SimpleTexture.glsl"
+    );
 
-    // Get a handle for our "MVP" uniform
-    GLint depthMatrixID = glGetUniformLocation(depthProgramID, "depthMVP");
-
-    // Load the texture
+    // Load the texture. Textures left unused while over budget lose their finest mipmaps
+    // until they are bound again.
+    setTextureBudget(TEXTURE_BUDGET_BYTES);
     GLuint Texture = loadDDS("../lesson 16 – shadow mapping/uvmap.dds");
 
     // Read our .obj file
@@ -102,27 +227,45 @@ void Window::Run()
     std::vector<glm::vec3> indexed_normals;
     indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
 
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-    // Generate a buffer for the indices as well
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+    // Load it into VBOs; the mesh's VAO records the layout once. The depth pass
+    // only reads the vertices, the scene pass also reads the UVs and normals.
+    Mesh room;
+    room.AddAttribute(0, indexed_vertices);
+    room.AddAttribute(1, indexed_uvs);
+    room.AddAttribute(2, indexed_normals);
+    room.SetIndices(indices);
+
+    // Props scattered around the room, drawn as cubes when neither outside the view nor
+    // hidden by the room. The room is its own occluder: its triangles are few and large.
+    std::vector<BoundingBox> props = makeOcclusionProps();
+    FrustumCuller frustumCuller;
+    frustumCuller.Reserve(props.size());
+    for (const BoundingBox & prop : props)
+        frustumCuller.Add(prop);
+    OcclusionCuller occlusionCuller;
+    occlusionCuller.Create();
+    occlusionCuller.SetOccluders(vertices);
+    std::vector<uint32_t> visibleProps;
+    size_t propsInFrustum = 0, propsRejected = 0, propsOccluded = 0, cullFrames = 0;
+
+    // Props visible from each camera cell, baked again when the props or the grid changed.
+    PotentiallyVisibleSet pvs;
+    if (!loadPotentiallyVisibleSet(pvs, props, vertices))
+        pvs.Clear();
+    double occlusionMilliseconds = 0.0;
+
+    std::vector<glm::vec3> cubePositions, cubeNormals;
+    std::vector<glm::vec2> cubeUVs;
+    std::vector<unsigned short> cubeIndices;
+    makeCube(cubePositions, cubeUVs, cubeNormals, cubeIndices);
+    Mesh cube;
+    cube.AddAttribute(0, cubePositions);
+    cube.AddAttribute(1, cubeUVs);
+    cube.AddAttribute(2, cubeNormals);
+    cube.SetIndices(cubeIndices);
+
+    CameraPath cameraPath;
+    std::chrono::steady_clock::time_point lastCameraKey = std::chrono::steady_clock::now();
 
     // -------------------
     //  Render to Texture
@@ -138,12 +281,12 @@ void Window::Run()
     glGenTextures(1, &depthTexture);
     glBindTexture(GL_TEXTURE_2D, depthTexture);
     glTexImage2D(GL_TEXTURE_2D, 0,GL_DEPTH_COMPONENT16, 1024, 1024, 0,GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+
+    // The scene samples the depth texture with hardware comparison (sampler2DShadow),
+    // the debug quad reads raw depth values (sampler2D): same texture, two samplers.
+    GLuint shadowMapSampler = getSampler(shadowSampler());
+    GLuint depthSampler = getSampler(linearSampler(GL_CLAMP_TO_EDGE));
+    GLuint sceneSampler = getSampler(trilinearSampler(4.0f));
 
     glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
 
@@ -167,66 +310,123 @@ void Window::Run()
             1.0f,  1.0f, 0.0f,
     };
 
-    GLuint quad_vertexbuffer;
-    glGenBuffers(1, &quad_vertexbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, quad_vertexbuffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_quad_vertex_buffer_data), g_quad_vertex_buffer_data, GL_STATIC_DRAW);
+    Mesh quad;
+    GLuint quad_vertexbuffer = quad.AddBuffer(g_quad_vertex_buffer_data, sizeof(g_quad_vertex_buffer_data));
+    quad.AddAttribute(0, quad_vertexbuffer, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-    // Create and compile our GLSL program from the shaders
-    GLuint quad_programID = LoadShaders(
-            "../lesson 16 – shadow mapping/Passthrough.glsl",
-            "../lesson 16 – shadow mapping/SimpleTexture.glsl"
-    );
-    GLint texID = glGetUniformLocation(quad_programID, "texture_img");
-
-    // Create and compile our GLSL program from the shaders
-    GLuint programID = LoadShaders(
+    // The shadow shader is specialized per feature combination: only the variants
+    // actually used are compiled, and recompiled when their sources are saved.
+    ShaderPermutations shadowVariants(
             "../lesson 16 – shadow mapping/ShadowMappingVertex.glsl",
-            "../lesson 16 – shadow mapping/ShadowMappingFragment.glsl"
+            "../lesson 16 – shadow mapping/ShadowMappingFragment.glsl",
+            {"SHADOW_PCF", "SHADOW_RANDOM_SAMPLES", "SHADOW_VARIABLE_BIAS"},
+            true
     );
-
-    // Get a handle for our "myTextureSampler" uniform
-    GLint textureID  = glGetUniformLocation(programID, "myTextureSampler");
-
-    // Get a handle for our "MVP" uniform
-    GLint MatrixID = glGetUniformLocation(programID, "MVP");
-    GLint ViewMatrixID = glGetUniformLocation(programID, "V");
-    GLint ModelMatrixID = glGetUniformLocation(programID, "M");
-    GLint DepthBiasID = glGetUniformLocation(programID, "DepthBiasMVP");
-    GLint ShadowMapID = glGetUniformLocation(programID, "shadowMap");
-
-    // Get a handle for our "LightPosition" uniform
-    GLint lightInvDirID = glGetUniformLocation(programID, "LightInvDirection_worldspace");
+    GLuint programID = shadowVariants.Get(SHADOW_FEATURES);
+
+    // Reflect the uniforms of our programs once. Their setters skip values that did not change.
+    // The queued programs are reflected once they are ready.
+    ShaderProgram depthProgram;
+    ShaderProgram quadProgram;
+    bool depthProgramReady = false;
+    bool quadProgramReady = false;
+    ShaderProgram shadowProgram(programID);
+    // Look the sampler uniforms up once per reflection, not by name every frame.
+    int textureSamplerUniform = shadowProgram.GetUniform("myTextureSampler");
+    int shadowMapUniform = shadowProgram.GetUniform("shadowMap");
+    int quadTextureUniform = -1;
+    UniformUploadStats frameUniforms = {0, 0};
+
+    OcclusionQueries occlusionQueries;
+    bool useQueries = OCCLUSION_QUERIES && occlusionQueries.Create("../common/OcclusionBoxVertex.glsl",
+                                                                   "../common/OcclusionBoxFragment.glsl");
+    occlusionQueries.SetObjects(props);
+    OcclusionQueryStats queryTotals = {0, 0, 0, 0};
+    GLStateStats frameState = {0, 0};
+
+    // Per-frame and per-object uniform blocks, shared by the depth and the shadow programs.
+    // One object block per prop, at the largest offset alignment drivers use.
+    UniformRing uniformRing;
+    uniformRing.Create(4 * 1024 + props.size() * 256);
 
     // -------------------
     // Enable depth test.
-    glEnable(GL_DEPTH_TEST);
+    enableCapability(GL_DEPTH_TEST);
 
     // Accept fragment if it closer to the camera than the former one.
-    glDepthFunc(GL_LESS);
+    depthFunc(GL_LESS);
 
     // Cull triangles which normal is not towards the camera.
-    glEnable(GL_CULL_FACE);
+    enableCapability(GL_CULL_FACE);
 
     do
     {
+        ReloadChangedShaders();
+
+        // Compute the view and projection matrices from keyboard and mouse input
+        computeMatricesFromInputs(window);
+        glm::mat4 ProjectionMatrix = getProjectionMatrix();
+        glm::mat4 ViewMatrix = getViewMatrix();
+        //ViewMatrix = glm::lookAt(glm::vec3(14,6,4), glm::vec3(0,1,0), glm::vec3(0,1,0));
+
+        if (!cameraPathFile.empty() && std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - lastCameraKey).count() >= CAMERA_RECORD_INTERVAL)
+        {
+            cameraPath.Add(getCameraPosition(), getViewDirection(ViewMatrix));
+            lastCameraKey = std::chrono::steady_clock::now();
+        }
+
+        // Props in the view, then those the room does not hide.
+        glm::mat4 viewProjection = ProjectionMatrix * ViewMatrix;
+        size_t propCount = frustumCuller.Cull(extractFrustum(viewProjection), visibleProps);
+        propsInFrustum += propCount;
+        size_t potentiallyVisible = pvs.Cull(pvs.GetCell(getCameraPosition()), visibleProps.data(), propCount);
+        propsRejected += propCount - potentiallyVisible;
+        propCount = potentiallyVisible;
+        if (OCCLUSION_CULLING)
+        {
+            occlusionCuller.Render(viewProjection);
+            size_t left = occlusionCuller.Cull(props, visibleProps.data(), propCount);
+            propsOccluded += propCount - left;
+            propCount = left;
+            occlusionMilliseconds += occlusionCuller.GetStats().renderMilliseconds
+                                   + occlusionCuller.GetStats().cullMilliseconds;
+        }
+        cullFrames++;
+
+        glm::vec3 lightInvDir = glm::vec3(0.5f,2,2);
+
+        // Uploaded once, read by both passes.
+        uniformRing.BeginFrame();
+        FrameUniforms frame;
+        frame.view = ViewMatrix;
+        frame.projection = ProjectionMatrix;
+        frame.cameraPosition = glm::vec4(getCameraPosition(), 1);
+        frame.light = glm::vec4(lightInvDir, 0);
+        frame.lightColor = glm::vec4(1, 1, 1, 1);
+        uniformRing.Push(FRAME_UNIFORM_BINDING, frame);
+
         // Render to our framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, FramebufferName);
-        glViewport(0,0,1024,1024); // Render on the whole framebuffer, complete from the lower left corner to the upper right
+        bindFramebuffer(FramebufferName);
+        viewport(0,0,1024,1024); // Render on the whole framebuffer, complete from the lower left corner to the upper right
 
         // We don't use bias in the shader, but instead we draw back faces,
         // which are already separated from the front faces by a small distance
         // (if your geometry is made this way)
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK); // Cull back-facing triangles -> draw only front-facing triangles
+        // Every pass states what it needs, the state cache drops what is already set.
+        enableCapability(GL_CULL_FACE);
+        cullFace(GL_BACK); // Cull back-facing triangles -> draw only front-facing triangles
 
         // Clear the screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Use our shader
-        glUseProgram(depthProgramID);
-
-        glm::vec3 lightInvDir = glm::vec3(0.5f,2,2);
+        // Use our shader, once the driver has linked it. Until then the shadow map keeps
+        // its cleared depth and the scene is drawn without shadows.
+        if (!depthProgramReady && PollProgram(depthProgramID))
+        {
+            depthProgram.Reflect(depthProgramID);
+            depthProgramReady = true;
+        }
 
         // Compute the MVP matrix from the light's point of view
         glm::mat4 depthProjectionMatrix = glm::ortho<float>(-10,10,-10,10,-10,20);
@@ -239,41 +439,41 @@ void Window::Run()
         glm::mat4 depthModelMatrix = glm::mat4(1.0);
         glm::mat4 depthMVP = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
 
-        // Send our transformation to the currently bound shader,
-        // in the "MVP" uniform
-        glUniformMatrix4fv(depthMatrixID, 1, GL_FALSE, &depthMVP[0][0]);
-
-        // 1rst attribute buffer : vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        // Send our transformation to the object block
+        ObjectUniforms depthObject;
+        depthObject.model = depthModelMatrix;
+        depthObject.modelViewProjection = depthMVP;
+        depthObject.shadowMatrix = depthMVP;
 
         // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-
-        glDisableVertexAttribArray(0);
+        if (depthProgramReady)
+        {
+            depthProgram.Use();
+            uniformRing.Push(OBJECT_UNIFORM_BINDING, depthObject);
+            room.Draw();
+        }
 
         // Render to the screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0,0,windowWidth,windowHeight); // Render on the whole framebuffer, complete from the lower left corner to the upper right
+        bindFramebuffer(0);
+        viewport(0,0,windowWidth,windowHeight); // Render on the whole framebuffer, complete from the lower left corner to the upper right
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK); // Cull back-facing triangles -> draw only front-facing triangles
+        enableCapability(GL_CULL_FACE);
+        cullFace(GL_BACK); // Cull back-facing triangles -> draw only front-facing triangles
 
         // Clear the screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Use our shader
-        glUseProgram(programID);
+        // A hot reload or another feature set gives a new program: reflect it again.
+        GLuint shadowVariant = shadowVariants.Get(SHADOW_FEATURES);
+        if (shadowVariant != shadowProgram.GetID())
+        {
+            shadowProgram.Reflect(shadowVariant);
+            textureSamplerUniform = shadowProgram.GetUniform("myTextureSampler");
+            shadowMapUniform = shadowProgram.GetUniform("shadowMap");
+        }
+        shadowProgram.Use();
 
-        // Compute the MVP matrix from keyboard and mouse input
-        computeMatricesFromInputs(window);
-        glm::mat4 ProjectionMatrix = getProjectionMatrix();
-        glm::mat4 ViewMatrix = getViewMatrix();
-        //ViewMatrix = glm::lookAt(glm::vec3(14,6,4), glm::vec3(0,1,0), glm::vec3(0,1,0));
         glm::mat4 ModelMatrix = glm::mat4(1.0);
         glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
@@ -286,70 +486,86 @@ void Window::Run()
 
         glm::mat4 depthBiasMVP = biasMatrix*depthMVP;
 
-        // Send our transformation to the currently bound shader,
-        // in the "MVP" uniform
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-        glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-        glUniformMatrix4fv(DepthBiasID, 1, GL_FALSE, &depthBiasMVP[0][0]);
-
-        glUniform3f(lightInvDirID, lightInvDir.x, lightInvDir.y, lightInvDir.z);
+        // Send our transformation to the object block
+        ObjectUniforms object;
+        object.model = ModelMatrix;
+        object.modelViewProjection = MVP;
+        object.shadowMatrix = depthBiasMVP;
+        uniformRing.Push(OBJECT_UNIFORM_BINDING, object);
 
         // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, Texture);
+        bindTexture2D(0, Texture);
+        bindSampler(0, sceneSampler);
         // Set our "myTextureSampler" sampler to user Texture Unit 0
-        glUniform1i(textureID, 0);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-        glUniform1i(ShadowMapID, 1);
+        shadowProgram.Set(textureSamplerUniform, 0);
 
-        // 1rst attribute buffer : vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer : UVs
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        bindTexture(1, GL_TEXTURE_2D, depthTexture);
+        bindSampler(1, shadowMapSampler);
+        shadowProgram.Set(shadowMapUniform, 1);
 
         // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
-
-        // Optionally render the shadowmap (for debug only)
+        room.Draw();
+
+        // The props use the same program, one object block each.
+        auto drawProp = [&](uint32_t index)
+        {
+            const BoundingBox & prop = props[index];
+            glm::mat4 propModel = glm::scale(glm::translate(glm::mat4(1.0), prop.min), prop.max - prop.min);
+            ObjectUniforms propObject;
+            propObject.model = propModel;
+            propObject.modelViewProjection = viewProjection * propModel;
+            propObject.shadowMatrix = depthBiasMVP * propModel;
+            shadowProgram.Use();
+            enableCapability(GL_CULL_FACE);
+            uniformRing.Push(OBJECT_UNIFORM_BINDING, propObject);
+            cube.Draw();
+        };
+        if (useQueries)
+        {
+            // The room is drawn: the queries test the props against it.
+            occlusionQueries.Render(visibleProps.data(), propCount, viewProjection, drawProp);
+            const OcclusionQueryStats & queries = occlusionQueries.GetStats();
+            queryTotals.queriesIssued += queries.queriesIssued;
+            queryTotals.resultsRead += queries.resultsRead;
+            queryTotals.drawsSkipped += queries.drawsSkipped;
+            queryTotals.conditionalDraws += queries.conditionalDraws;
+        }
+        else
+        {
+            for (size_t i = 0; i < propCount; i++)
+                drawProp(visibleProps[i]);
+        }
+
+        // Optionally render the shadowmap (for debug only), once its program is linked
         // Render only on a corner of the window (or we we won't see the real rendering...)
-        glViewport(0, 0, 512, 512);
-
-        // Use our shader
-        glUseProgram(quad_programID);
-
-        // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-        // Set our "renderedTexture" sampler to user Texture Unit 0
-        glUniform1i(texID, 0);
-
-        // 1rst attribute buffer : vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, quad_vertexbuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Draw the triangle.
-        glDisableVertexAttribArray(0);
+        if (!quadProgramReady && PollProgram(quad_programID))
+        {
+            quadProgram.Reflect(quad_programID);
+            quadTextureUniform = quadProgram.GetUniform("texture_img");
+            quadProgramReady = true;
+        }
+        if (quadProgramReady)
+        {
+            viewport(0, 0, 512, 512);
+
+            // Use our shader
+            quadProgram.Use();
+
+            // Bind our texture in Texture Unit 0
+            bindTexture(0, GL_TEXTURE_2D, depthTexture);
+            bindSampler(0, depthSampler);
+            // Set our "renderedTexture" sampler to user Texture Unit 0
+            quadProgram.Set(quadTextureUniform, 0);
+
+            // Draw the triangle.
+            // quad.Draw();  // Uncomment to show the shadow map in the corner.
+        }
+
+        enforceTextureBudget();
+        frameUniforms = getUniformUploadStats();
+        resetUniformUploadStats();
+        frameState = getGLStateStats();
+        resetGLStateStats();
 
         // Swap buffers.
         glfwSwapBuffers(window);
@@ -358,19 +574,51 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteBuffers(1, &elementBuffer);
-    glDeleteProgram(programID);
+    room.Destroy();
+    cube.Destroy();
+    occlusionCuller.Destroy();
+    occlusionQueries.Destroy();
+    if (cullFrames)
+    {
+        std::cout << "Props per frame: " << propsInFrustum / cullFrames << " in frustum, "
+                  << propsRejected / cullFrames << " rejected by the PVS, " << propsOccluded / cullFrames << " occluded, " << occlusionMilliseconds / cullFrames
+                  << " ms of occlusion culling" << std::endl;
+        if (useQueries)
+        {
+            std::cout << "Occlusion queries per frame: " << queryTotals.queriesIssued / cullFrames << " issued, "
+                      << queryTotals.resultsRead / cullFrames << " read, " << queryTotals.drawsSkipped / cullFrames
+                      << " draws skipped, " << queryTotals.conditionalDraws / cullFrames << " conditional draws"
+                      << std::endl;
+        }
+    }
+    // First run compiles the three programs, later runs restore them from the binary cache.
+    ShaderCacheStats shaderCache = GetShaderCacheStats();
+    std::cout << "Shaders: " << shaderCache.hits + shaderCache.misses << " programs, "
+              << shaderCache.seconds * 1000.0 << " ms blocked (" << shaderCache.hits << " from cache, "
+              << shaderCache.misses << " compiled)" << std::endl;
+    if (!cameraPathFile.empty() && cameraPath.Save(cameraPathFile))
+        std::cout << "Camera path: " << cameraPath.GetSize() << " keys saved to " << cameraPathFile << std::endl;
+    shadowVariants.Clear();
+    uniformRing.Destroy();
     glDeleteProgram(depthProgramID);
     glDeleteProgram(quad_programID);
-    glDeleteTextures(1, &Texture);
+    std::cout << "Uniforms in the last frame: " << frameUniforms.issued << " uploaded, "
+              << frameUniforms.skipped << " skipped as unchanged" << std::endl;
+    std::cout << "GL state in the last frame: " << frameState.issued << " calls issued, "
+              << frameState.filtered << " filtered as redundant" << std::endl;
+
+    TextureResidencyStats residency = getTextureResidencyStats();
+    std::cout << "Textures: " << residency.residentBytes / 1024 << " KB resident of "
+              << residency.budgetBytes / 1024 << " KB budget, " << residency.evictions
+              << " mipmaps evicted, " << residency.reuploads << " re-uploads" << std::endl;
+    deleteTexture(Texture);
+    shutdownTextureResidency();
 
     glDeleteFramebuffers(1, &FramebufferName);
     glDeleteTextures(1, &depthTexture);
-    glDeleteBuffers(1, &quad_vertexbuffer);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteSamplers();
+    StopShaderWatcher();
+    quad.Destroy();
 
     glfwTerminate();
 }
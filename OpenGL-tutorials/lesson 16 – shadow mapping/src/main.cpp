@@ -1,10 +1,34 @@
+#include <cstring>
+
 #include "Window.h"
+#include "OcclusionScene.h"
 
 
-int main()
+// --occlusion-report replays the camera path on the CPU only, without opening a window.
+// --bake-pvs precomputes the props visible from each camera cell, also without a window.
+// --record-camera-path saves the camera of the session as the path to replay.
+// --texture-report runs the texture budget over copies of the room's texture, in a window.
+int main(int argc, char * argv[])
 {
+    bool record = false, report = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--occlusion-report") == 0)
+            return runOcclusionReport(CAMERA_PATH);
+        if (strcmp(argv[i], "--bake-pvs") == 0)
+            return bakePotentiallyVisibleSet(PVS_PATH);
+        if (strcmp(argv[i], "--record-camera-path") == 0)
+            record = true;
+        if (strcmp(argv[i], "--texture-report") == 0)
+            report = true;
+    }
+
     Window window(1024, 768);
     window.Initialize();
+    if (report)
+        return window.RunTextureResidencyReport();
+    if (record)
+        window.RecordCameraPath(CAMERA_PATH);
     window.Run();
     return 0;
 }
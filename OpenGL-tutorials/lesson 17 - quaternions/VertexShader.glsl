@@ -5,6 +5,12 @@ layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 vertexNormal_modelspace;
 
+#ifndef PER_OBJECT
+// Input instance data, one value per copy of the mesh (see InstancedRenderer.h).
+layout(location = 3) in vec4 instanceRotation;       // Quaternion x, y, z, w
+layout(location = 4) in vec4 instancePositionScale;  // World position, uniform scale in w
+#endif
+
 // Output data ; will be interpolated for each fragment.
 out vec2 UV;
 out vec3 Position_worldspace;
@@ -13,30 +19,48 @@ out vec3 EyeDirection_cameraspace;
 out vec3 LightDirection_cameraspace;
 
 // Values that stay constant for the whole mesh.
-uniform mat4 MVP;
+uniform mat4 VP;
 uniform mat4 V;
-uniform mat4 M;
 uniform vec3 LightPosition_worldspace;
+#ifdef PER_OBJECT
+// One draw per object, with its model matrix: the path instancing replaces, benchmarked against it.
+uniform mat4 M;
+#endif
 
-void main()
+// Rotates v by the unit quaternion q.
+vec3 rotate(vec4 q, vec3 v)
 {
-	// Output position of the vertex, in clip space : MVP * position
-	gl_Position =  MVP * vec4(vertexPosition_modelspace, 1);
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
-	// Position of the vertex, in worldspace : M * position
+void main()
+{
+#ifdef PER_OBJECT
 	Position_worldspace = (M * vec4(vertexPosition_modelspace, 1)).xyz;
+#else
+	// Position of the vertex, in worldspace : rotation, scale, then translation
+	Position_worldspace = rotate(instanceRotation, vertexPosition_modelspace) * instancePositionScale.w
+	                    + instancePositionScale.xyz;
+#endif
+
+	// Output position of the vertex, in clip space
+	gl_Position = VP * vec4(Position_worldspace, 1);
 
 	// Vector that goes from the vertex to the camera, in camera space.
 	// In camera space, the camera is at the origin (0,0,0).
-	vec3 vertexPosition_cameraspace = (V * M * vec4(vertexPosition_modelspace, 1)).xyz;
+	vec3 vertexPosition_cameraspace = (V * vec4(Position_worldspace, 1)).xyz;
 	EyeDirection_cameraspace = vec3(0, 0, 0) - vertexPosition_cameraspace;
 
-	// Vector that goes from the vertex to the light, in camera space. M is ommited because it's identity.
+	// Vector that goes from the vertex to the light, in camera space.
 	vec3 LightPosition_cameraspace = (V * vec4(LightPosition_worldspace, 1)).xyz;
 	LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
 
-	// Normal of the the vertex, in camera space
-	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz; // Only correct if ModelMatrix does not scale the model ! Use its inverse transpose if not.
+	// Normal of the the vertex, in camera space. The scale is uniform: rotating is enough.
+#ifdef PER_OBJECT
+	Normal_cameraspace = (V * M * vec4(vertexNormal_modelspace, 0)).xyz;
+#else
+	Normal_cameraspace = (V * vec4(rotate(instanceRotation, vertexNormal_modelspace), 0)).xyz;
+#endif
 
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
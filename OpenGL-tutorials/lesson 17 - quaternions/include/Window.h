@@ -29,10 +29,20 @@ public:
      * Run the main loop for an application.
      */
     void Run();
+
+    /**
+     * Times instanced draws against one draw per object before the first frame of Run().
+     */
+    void EnableInstancingBenchmark() { instancingBenchmark = true; }
 private:
     /**
      * GLFW window instance.
      */
    GLFWwindow* window;
+
+    /**
+     * Whether Run() starts with the instancing benchmark.
+     */
+    bool instancingBenchmark = false;
 };
 #endif
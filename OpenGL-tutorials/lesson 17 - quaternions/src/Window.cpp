@@ -12,6 +12,14 @@
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
 #include "QuaternionUtils.h"
+#include "GLState.h"
+#include "Mesh.h"
+#include "InstancedRenderer.h"
+#include <chrono>
+
+// Instance counts swept by the benchmark run before the first frame (--instancing-benchmark).
+static const unsigned int INSTANCING_BENCHMARK_COUNTS[] = {1, 10, 100, 1000, 10000, 100000};
+static const unsigned int INSTANCING_BENCHMARK_MAX = 100000;
 
 
 vec3 gPosition1(-1.5f, 0.0f, 0.0f);
@@ -65,6 +73,98 @@ void Window::Initialize()
 }
 
 
+// Draws `count` copies of the mesh either with one instanced draw, or the way the lesson
+// did before instancing: the per-object program, a model matrix uniform and a
+// glDrawElements per copy. Rasterizer discarded. Returns the CPU time of the submission
+// and the GPU time, both in milliseconds.
+static void timeInstancedDraws(InstancedRenderer & renderer, Mesh & mesh,
+                               const std::vector<InstanceTransform> & instances, const std::vector<glm::mat4> & models,
+                               size_t count, bool oneDrawEach, GLuint instancedProgram, GLuint perObjectProgram,
+                               GLint modelID, GLuint query, double & cpuMilliseconds, double & gpuMilliseconds)
+{
+    glFinish();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    if (oneDrawEach)
+    {
+        useProgram(perObjectProgram);
+        for (size_t i = 0; i < count; i++)
+        {
+            glUniformMatrix4fv(modelID, 1, GL_FALSE, &models[i][0][0]);
+            mesh.Draw();
+        }
+    }
+    else
+    {
+        useProgram(instancedProgram);
+        renderer.Draw(mesh, &instances[0], count);
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    cpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    renderer.EndFrame();
+
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    gpuMilliseconds = elapsed / 1e6;
+}
+
+
+// Sweeps the instance counts and prints instanced against one draw per copy. Only the
+// vertex stage runs, so the numbers are the submission and vertex costs. The per-object
+// program gets the same view, projection and light as `instancedProgram`.
+static void benchmarkInstancing(InstancedRenderer & renderer, Mesh & mesh, GLuint instancedProgram,
+                                const glm::mat4 & viewProjection, const glm::mat4 & view)
+{
+    std::vector<InstanceTransform> instances(INSTANCING_BENCHMARK_MAX);
+    std::vector<glm::mat4> models(INSTANCING_BENCHMARK_MAX);
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        float x = float(i % 400) / 400.f * 6.f - 3.f;
+        float y = float(i / 400) / 250.f * 4.f - 2.f;
+        instances[i] = InstanceTransform(quat(), vec3(x, y, 0.f), 0.02f);
+        models[i] = glm::scale(glm::translate(glm::mat4(1.0f), vec3(x, y, 0.f)), vec3(0.02f));
+    }
+
+    GLuint perObjectProgram = LoadShaders(
+        "../lesson 17 - quaternions/VertexShader.glsl",
+        "../lesson 17 - quaternions/FragmentShader.glsl",
+        {"PER_OBJECT"}
+    );
+    GLint modelID = glGetUniformLocation(perObjectProgram, "M");
+    useProgram(perObjectProgram);
+    glUniformMatrix4fv(glGetUniformLocation(perObjectProgram, "VP"), 1, GL_FALSE, &viewProjection[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(perObjectProgram, "V"), 1, GL_FALSE, &view[0][0]);
+    glUniform3f(glGetUniformLocation(perObjectProgram, "LightPosition_worldspace"), 4, 4, 4);
+    glUniform1i(glGetUniformLocation(perObjectProgram, "myTextureSampler"), 0);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    enableCapability(GL_RASTERIZER_DISCARD);
+
+    std::cout << "Instances: instanced draw CPU / GPU ms, one draw each CPU / GPU ms" << std::endl;
+    for (unsigned int count : INSTANCING_BENCHMARK_COUNTS)
+    {
+        double times[2][2];
+        for (int oneDrawEach = 0; oneDrawEach < 2; oneDrawEach++)
+        {
+            // A warm-up run, then the timed one.
+            for (int run = 0; run < 2; run++)
+            {
+                timeInstancedDraws(renderer, mesh, instances, models, count, oneDrawEach, instancedProgram,
+                                   perObjectProgram, modelID, query, times[oneDrawEach][0], times[oneDrawEach][1]);
+            }
+        }
+        std::cout << "  " << count << ": " << times[0][0] << " / " << times[0][1] << " ms, "
+                  << times[1][0] << " / " << times[1][1] << " ms" << std::endl;
+    }
+
+    disableCapability(GL_RASTERIZER_DISCARD);
+    glDeleteQueries(1, &query);
+    useProgram(instancedProgram);
+    glDeleteProgram(perObjectProgram);
+}
+
+
 void Window::Run()
 {
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
@@ -72,26 +172,15 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
     // Create and compile our GLSL program from the shaders
     GLuint programID = LoadShaders(
         "../lesson 17 - quaternions/VertexShader.glsl",
         "../lesson 17 - quaternions/FragmentShader.glsl"
     );
 
-    // Get a handle for our "MVP" uniform
-    GLint MatrixID = glGetUniformLocation(programID, "MVP");
+    // Get a handle for our "VP" uniform: the model transform comes with each instance
+    GLint ViewProjectionID = glGetUniformLocation(programID, "VP");
     GLint ViewMatrixID = glGetUniformLocation(programID, "V");
-    GLint ModelMatrixID = glGetUniformLocation(programID, "M");
-
-    // Get a handle for our buffers
-    GLint vertexPosition_modelspaceID = glGetAttribLocation(programID, "vertexPosition_modelspace");
-    GLint vertexUVID = glGetAttribLocation(programID, "vertexUV");
-    GLint vertexNormal_modelspaceID = glGetAttribLocation(programID, "vertexNormal_modelspace");
 
     // Load the texture
     GLuint texture = loadDDS("../resources/suzanne_uvmap.DDS");
@@ -106,46 +195,46 @@ void Window::Run()
     bool res = loadOBJ("../resources/suzanne.obj", vertices, uvs, normals);
 
     std::vector<unsigned short> indices;
-    std::vector<glm::vec3> indexed_vertices;
-    std::vector<glm::vec2> indexed_uvs;
-    std::vector<glm::vec3> indexed_normals;
-    indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
-
-    // Load it into a VBO
-
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-    // Generate a buffer for the indices as well
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
+    std::vector<InterleavedVertex> indexed_vertices;
+    indexVBO(vertices, uvs, normals, indices, indexed_vertices);
+
+    // Load it into a mesh; the instance attributes are added to its VAO by the renderer
+    Mesh suzanne;
+    suzanne.AddInterleaved(indexed_vertices);
+    suzanne.SetIndices(indices);
+
+    // Both Suzannes are drawn by one instanced draw call
+    InstancedRenderer instancedRenderer;
+    instancedRenderer.Create(instancingBenchmark ? INSTANCING_BENCHMARK_MAX : 2);
 
     // Get a handle for our "LightPosition" uniform
-    glUseProgram(programID);
+    useProgram(programID);
     GLint LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
 
     // Enable depth test.
-    glEnable(GL_DEPTH_TEST);
+    enableCapability(GL_DEPTH_TEST);
 
     // Accept fragment if it closer to the camera than the former one.
-    glDepthFunc(GL_LESS);
+    depthFunc(GL_LESS);
 
     // Cull triangles which normal is not towards the camera.
-    glEnable(GL_CULL_FACE);
+    enableCapability(GL_CULL_FACE);
+
+    if (instancingBenchmark)
+    {
+        // Same camera and light as the frames below.
+        glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+        glm::mat4 ViewMatrix = glm::lookAt(glm::vec3(0, 0, 7), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+        glm::mat4 ViewProjection = ProjectionMatrix * ViewMatrix;
+        glUniformMatrix4fv(ViewProjectionID, 1, GL_FALSE, &ViewProjection[0][0]);
+        glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
+        glUniform3f(LightID, 4, 4, 4);
+
+        // Set our "myTextureSampler" sampler to user Texture Unit 0
+        bindTexture(0, GL_TEXTURE_2D, texture);
+        glUniform1i(TextureID, 0);
+        benchmarkInstancing(instancedRenderer, suzanne, programID, ViewProjection, ViewMatrix);
+    }
 
     // For speed computation.
     double lastTime = glfwGetTime();
@@ -171,7 +260,7 @@ void Window::Run()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Use our shader
-        glUseProgram(programID);
+        useProgram(programID);
 
         glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
         glm::mat4 ViewMatrix = glm::lookAt(
@@ -179,55 +268,30 @@ void Window::Run()
                 glm::vec3(0, 0, 0), // and looks here
                 glm::vec3(0, 1, 0)  // Head is up (set to 0,-1,0 to look upside-down)
         );
+        glm::mat4 ViewProjection = ProjectionMatrix * ViewMatrix;
+
+        // Send our transformation to the currently bound shader
+        glUniformMatrix4fv(ViewProjectionID, 1, GL_FALSE, &ViewProjection[0][0]);
+        glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
 
         // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        bindTexture(0, GL_TEXTURE_2D, texture);
         // Set our "myTextureSampler" sampler to user Texture Unit 0
         glUniform1i(TextureID, 0);
 
-        // 1rst attribute buffer : vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(vertexPosition_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer : UVs
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(vertexUVID, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(vertexNormal_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-
         glm::vec3 lightPos = glm::vec3(4,4,4);
         glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
 
+        InstanceTransform instances[2];
+
         { // Euler
 
             // As an example, rotate arount the vertical axis at 180°/sec
             gOrientation1.y += 3.14159f/2.0f * deltaTime;
 
-            // Build the model matrix
+            // Build the instance transform: same rotation as eulerAngleYXZ, as a quaternion
             glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-            glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-            glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-            glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-
-            glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-            // Send our transformation to the currently bound shader,
-            // in the "MVP" uniform
-            glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-            glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-            glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-
-            // Draw the triangles !
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
+            instances[0] = InstanceTransform(quat_cast(RotationMatrix), gPosition1); // A bit to the left
         }
         { // Quaternion
 
@@ -244,26 +308,13 @@ void Window::Run()
                 gOrientation2 = RotateTowards(gOrientation2, targetOrientation, 1.0f*deltaTime);
             }
 
-            glm::mat4 RotationMatrix = mat4_cast(gOrientation2);
-            glm::mat4 TranslationMatrix = translate(mat4(), gPosition2); // A bit to the right
-            glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-            glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-
-            glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-            // Send our transformation to the currently bound shader,
-            // in the "MVP" uniform
-            glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-            glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-            glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-
-            // Draw the triangles.
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
+            instances[1] = InstanceTransform(gOrientation2, gPosition2); // A bit to the right
         }
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        // Draw the triangles of both instances.
+        instancedRenderer.Draw(suzanne, instances, 2);
+        instancedRenderer.EndFrame();
+
         // Swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -271,12 +322,10 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
+    suzanne.Destroy();
+    instancedRenderer.Destroy();
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteTexture(texture);
 
     glfwTerminate();
 }
@@ -1,9 +1,17 @@
+#include <cstring>
+
 #include "Window.h"
 
 
-int main()
+// --instancing-benchmark times instanced draws against one draw per object first.
+int main(int argc, char * argv[])
 {
     Window window;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--instancing-benchmark") == 0)
+            window.EnableInstancingBenchmark();
+    }
     window.Initialize();
     window.Run();
     return 0;
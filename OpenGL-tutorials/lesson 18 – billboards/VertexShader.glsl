@@ -12,6 +12,7 @@ uniform vec3 CameraUp_worldspace;
 uniform mat4 VP; // Model-View-Projection matrix, but without the Model (the position is in BillboardPos; the orientation depends on the camera)
 uniform vec3 BillboardPos; // Position of the center of the billboard
 uniform vec2 BillboardSize; // Size of the billboard, in world units (probably meters)
+uniform vec4 AtlasRect = vec4(0, 0, 1, 1); // Region of the texture atlas: xy = origin, zw = size
 
 void main()
 {
@@ -35,5 +36,5 @@ void main()
 	// Same thing, just use (ScreenSizeInPixels / BillboardSizeInPixels) instead of BillboardSizeInScreenPercentage.
 
 	// UV of the vertex. No special space for this one.
-	UV = squareVertices.xy + vec2(0.5, 0.5);
+	UV = AtlasRect.xy + (squareVertices.xy + vec2(0.5, 0.5)) * AtlasRect.zw;
 }
@@ -296,7 +296,7 @@ void Window::Run()
     // Cleanup VBO and shader
     glDeleteBuffers(1, &billboard_vertex_buffer);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
+    deleteTexture(texture);
     glDeleteVertexArrays(1, &vertexArrayID);
     glDeleteProgram(cubeProgramID);
 	glDeleteVertexArrays(1, &cubevertexbuffer);
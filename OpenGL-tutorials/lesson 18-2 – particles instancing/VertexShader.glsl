@@ -13,6 +13,7 @@ out vec4 particlecolor;
 uniform vec3 CameraRight_worldspace;
 uniform vec3 CameraUp_worldspace;
 uniform mat4 VP; // Model-View-Projection matrix, but without the Model (the position is in BillboardPos; the orientation depends on the camera)
+uniform vec4 AtlasRect = vec4(0, 0, 1, 1); // Region of the texture atlas: xy = origin, zw = size
 
 void main()
 {
@@ -28,6 +29,6 @@ void main()
 	gl_Position = VP * vec4(vertexPosition_worldspace, 1.0f);
 
 	// UV of the vertex. No special space for this one.
-	UV = squareVertices.xy + vec2(0.5, 0.5);
+	UV = AtlasRect.xy + (squareVertices.xy + vec2(0.5, 0.5)) * AtlasRect.zw;
 	particlecolor = color;
 }
@@ -8,6 +8,8 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "Controls.h"
+#include "GLState.h"
+#include "StreamBuffer.h"
 #include <iostream>
 
 // CPU representation of a particle
@@ -132,9 +134,6 @@ void Window::Run()
     // Fragment shader.
     GLint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
 
-    static GLfloat* g_particule_position_size_data = new GLfloat[MAX_PARTICLES * 4];
-    static GLubyte* g_particule_color_data = new GLubyte[MAX_PARTICLES * 4];
-
     for(int i=0; i < MAX_PARTICLES; i++)
     {
         ParticlesContainer[i].life = -1.0f;
@@ -156,30 +155,26 @@ void Window::Run()
     glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
 
-    // The VBO containing the positions and sizes of the particles.
-    GLuint particles_position_buffer;
-    glGenBuffers(1, &particles_position_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-    // Initialize with empty (NULL) buffer : it will be updated later, each frame.
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
-
-    // The VBO containing the colors of the particles.
-    GLuint particles_color_buffer;
-    glGenBuffers(1, &particles_color_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-    // Initialize with empty (NULL) buffer : it will be updated later, each frame.
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW);
+    // The streaming VBO containing the positions and sizes, then the colors of the particles.
+    // Each frame writes its own region while the GPU still reads the previous ones.
+    const size_t positionBytes = MAX_PARTICLES * 4 * sizeof(GLfloat);
+    const size_t colorBytes = MAX_PARTICLES * 4 * sizeof(GLubyte);
+    StreamBuffer particlesStream;
+    particlesStream.Create(GL_ARRAY_BUFFER, positionBytes + colorBytes + 16);
+    std::cout << "Particles: streamed through a "
+              << (particlesStream.IsPersistent() ? "persistent mapped" : "glMapBufferRange") << " ring" << std::endl;
 
     // Enable depth test.
-    glEnable(GL_DEPTH_TEST);
+    enableCapability(GL_DEPTH_TEST);
 
     // Accept fragment if it closer to the camera than the former one.
-    glDepthFunc(GL_LESS);
+    depthFunc(GL_LESS);
 
     // Cull triangles which normal is not towards the camera.
-    glEnable(GL_CULL_FACE);
+    enableCapability(GL_CULL_FACE);
 
     double lastTime = glfwGetTime();
+    GLStateStats frameState = {0, 0};
 
     do
     {
@@ -234,6 +229,12 @@ void Window::Run()
             ParticlesContainer[particleIndex].size = (rand()%1000)/2000.0f + 0.1f;
         }
 
+        // The simulation writes straight into this frame's region of the buffer.
+        size_t streamOffset;
+        unsigned char * stream = static_cast<unsigned char*>(particlesStream.Map(positionBytes + colorBytes, streamOffset));
+        GLfloat * g_particule_position_size_data = reinterpret_cast<GLfloat*>(stream);
+        GLubyte * g_particule_color_data = stream + positionBytes;
+
         // Simulate all particles
         int ParticlesCount = 0;
         for(int i = 0; i < MAX_PARTICLES; i++)
@@ -278,27 +279,19 @@ void Window::Run()
         SortParticles();
 
         //printf("%d ",ParticlesCount);
-        // Update the buffers that OpenGL uses for rendering.
-        // There are much more sophisticated means to stream data from the CPU to the GPU,
-        // but this is outside the scope of this tutorial.
-        // http://www.opengl.org/wiki/Buffer_Object_Streaming
-        glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-        glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-        glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLfloat) * 4, g_particule_position_size_data);
+        // The data is already in the buffer: no orphaning and no glBufferSubData copy.
+        // See http://www.opengl.org/wiki/Buffer_Object_Streaming
+        particlesStream.Unmap();
 
-        glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-        glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-        glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLubyte) * 4, g_particule_color_data);
-
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // Only the first frame reaches the driver for the state below, the cache filters the rest.
+        enableCapability(GL_BLEND);
+        blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         // Use our shader.
-        glUseProgram(programID);
+        useProgram(programID);
 
         // Bind our texture in Texture Unit 0.
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        bindTexture(0, GL_TEXTURE_2D, texture);
         // Set our "myTextureSampler" sampler to user Texture Unit 0.
         glUniform1i(TextureID, 0);
 
@@ -309,27 +302,25 @@ void Window::Run()
         glUniformMatrix4fv(ViewProjMatrixID, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
 
         // 1rst attribute buffer : vertices.
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        bindVertexArray(vertexArrayID);
+        enableVertexAttribArray(0);
+        vertexAttribPointer(0, billboard_vertex_buffer, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-        // 2nd attribute buffer : positions of particles' centers.
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        // 2nd attribute buffer : positions of particles' centers, in this frame's region.
+        enableVertexAttribArray(1);
+        vertexAttribPointer(1, particlesStream.GetBuffer(), 4, GL_FLOAT, GL_FALSE, 0, static_cast<GLsizei>(streamOffset));
 
         // 3rd attribute buffer : particles' colors.
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*)0);
+        enableVertexAttribArray(2);
+        vertexAttribPointer(2, particlesStream.GetBuffer(), 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, static_cast<GLsizei>(streamOffset + positionBytes));
 
         // These functions are specific to glDrawArrays*Instanced*.
         // The first parameter is the attribute buffer we're talking about.
         // The second parameter is the "rate at which generic vertex attributes advance when rendering multiple instances"
         // http://www.opengl.org/sdk/docs/man/xhtml/glVertexAttribDivisor.xml
-        glVertexAttribDivisor(0, 0); // particles vertices : always reuse the same 4 vertices -> 0
-        glVertexAttribDivisor(1, 1); // positions : one per quad (its center) -> 1
-        glVertexAttribDivisor(2, 1); // color : one per quad -> 1
+        vertexAttribDivisor(0, 0); // particles vertices : always reuse the same 4 vertices -> 0
+        vertexAttribDivisor(1, 1); // positions : one per quad (its center) -> 1
+        vertexAttribDivisor(2, 1); // color : one per quad -> 1
 
         // Draw the particules.
         // This draws many times a small triangle_strip (which looks like a quad).
@@ -338,9 +329,11 @@ void Window::Run()
         // but faster.
         glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ParticlesCount);
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        // Fence this frame's region; waits only if the GPU is two frames behind.
+        particlesStream.NextRegion();
+
+        frameState = getGLStateStats();
+        resetGLStateStats();
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -348,14 +341,15 @@ void Window::Run()
     }
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
-    delete[] g_particule_position_size_data;
+    std::cout << "Particles: " << particlesStream.GetStalls() << " frames waited for the GPU" << std::endl;
+    std::cout << "GL state in the last frame: " << frameState.issued << " calls issued, "
+              << frameState.filtered << " filtered as redundant" << std::endl;
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &particles_color_buffer);
-    glDeleteBuffers(1, &particles_position_buffer);
+    particlesStream.Destroy();
     glDeleteBuffers(1, &billboard_vertex_buffer);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
+    deleteTexture(texture);
     glDeleteVertexArrays(1, &vertexArrayID);
 
     glfwTerminate();
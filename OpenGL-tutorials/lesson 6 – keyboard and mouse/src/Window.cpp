@@ -6,6 +6,7 @@
 #include "Input.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "SamplerCache.h"
 #include "Controls.h"
 
 static const int TRIANGLE_VERTICES = 3;
@@ -202,6 +203,7 @@ void Window::Run()
         // Bind our texture in Texture Unit 0
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
+        bindSampler(0, nearestSampler());
 
         // Set our "myTextureSampler" sampler to user Texture Unit 0
         glUniform1i(textureID, 0);
@@ -232,7 +234,8 @@ void Window::Run()
     glDeleteBuffers(1, &vertexBuffer);
     glDeleteBuffers(1, &uvBuffer);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
+    deleteTexture(texture);
+    deleteSamplers();
     glDeleteVertexArrays(1, &vertexArrayID);
 
     glfwTerminate();
@@ -157,7 +157,7 @@ void Window::Run()
     glDeleteBuffers(1, &vertexBuffer);
     glDeleteBuffers(1, &uvBuffer);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
+    deleteTexture(texture);
     glDeleteVertexArrays(1, &vertexArrayID);
 
     glfwTerminate();
@@ -8,6 +8,7 @@
 #include "Texture.h"
 #include "Controls.h"
 #include "ObjLoader.h"
+#include "Mesh.h"
 
 static const int TRIANGLE_VERTICES = 3;
 static const int CUBE_VERTICES = 12 * TRIANGLE_VERTICES;
@@ -62,11 +63,6 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
     // Load shaders from the GLSL sources.
     GLuint programID = LoadShaders(
             "../lesson 8 – basic shading/VertexShader.glsl",
@@ -93,21 +89,12 @@ void Window::Run()
     std::vector<glm::vec3> normals;
     bool res = loadOBJ("../resources/suzanne.obj", vertices, uvs, normals);
 
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+    // Load it into VBOs, recording the attribute layout in the mesh's VAO once:
+    // 1st attribute: vertices, 2nd: UVs, 3rd: normals.
+    Mesh suzanne;
+    suzanne.AddAttribute(0, vertices);
+    suzanne.AddAttribute(1, uvs);
+    suzanne.AddAttribute(2, normals);
 
     // Enable depth test.
     glEnable(GL_DEPTH_TEST);
@@ -147,27 +134,8 @@ void Window::Run()
         // Set our "myTextureSampler" sampler to user Texture Unit 0
         glUniform1i(textureID, 0);
 
-        // 1st attribute buffer: vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer: colors
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Draw the triangle.
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        // Draw the triangles: the VAO already knows the attribute buffers.
+        suzanne.Draw();
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -176,12 +144,9 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
+    suzanne.Destroy();
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteTexture(texture);
 
     glfwTerminate();
 }
@@ -29,10 +29,20 @@ public:
      * Run the main loop for an application.
      */
     void Run();
+
+    /**
+     * Times the split and interleaved vertex layouts in every frame of Run().
+     */
+    void EnableLayoutBenchmark() { layoutBenchmark = true; }
 private:
     /**
      * GLFW window instance.
      */
    GLFWwindow* window;
+
+    /**
+     * Whether Run() draws the layout benchmark.
+     */
+    bool layoutBenchmark = false;
 };
 #endif
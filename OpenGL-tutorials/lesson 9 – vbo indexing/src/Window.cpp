@@ -9,6 +9,11 @@
 #include "Controls.h"
 #include "ObjLoader.h"
 #include "VBOIndexer.h"
+#include "Mesh.h"
+
+// Vertex throughput benchmark (--layout-benchmark): each frame draws the model this many
+// times with each layout, rasterizer discarded, and times both on the GPU.
+static const int LAYOUT_BENCHMARK_DRAWS = 200;
 
 
 Window::Window(int width, int height, const std::string name)
@@ -60,11 +65,6 @@ void Window::Run()
     // Clear the screen.
     glClearColor(0.f, 0.f, 0.f, 0.f);
 
-    // Create Vertex Array Object (VAO).
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
-
     // Load shaders from the GLSL sources.
     GLuint programID = LoadShaders(
             "../lesson 9 – vbo indexing/VertexShader.glsl",
@@ -92,31 +92,32 @@ void Window::Run()
     bool res = loadOBJ("../resources/suzanne.obj", vertices, uvs, normals);
 
     std::vector<unsigned short> indices;
+    std::vector<InterleavedVertex> interleaved_vertices;
+    indexVBO(vertices, uvs, normals, indices, interleaved_vertices);
+
+    // Load it into a single VBO: each vertex fetch reads one 32-byte record.
+    Mesh suzanne;
+    suzanne.AddInterleaved(interleaved_vertices);
+    suzanne.SetIndices(indices);
+
+    // The same model with one VBO per attribute, for the benchmark.
+    std::vector<unsigned short> split_indices;
     std::vector<glm::vec3> indexed_vertices;
     std::vector<glm::vec2> indexed_uvs;
     std::vector<glm::vec3> indexed_normals;
-    indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
-
-    // Load it into a VBO
-    GLuint vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-    GLuint uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
+    indexVBO(vertices, uvs, normals, split_indices, indexed_vertices, indexed_uvs, indexed_normals);
 
-    GLuint normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
+    Mesh splitSuzanne;
+    splitSuzanne.AddAttribute(0, indexed_vertices);
+    splitSuzanne.AddAttribute(1, indexed_uvs);
+    splitSuzanne.AddAttribute(2, indexed_normals);
+    splitSuzanne.SetIndices(split_indices);
 
-    GLuint elementBuffer;
-    glGenBuffers(1, &elementBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
+    // Timer queries of the two layouts, double buffered so results are read a frame late.
+    GLuint layoutQueries[2][2];
+    glGenQueries(4, &layoutQueries[0][0]);
+    GLuint64 layoutNanoseconds[2] = {0, 0};
+    int benchmarkFrame = 0;
 
     // Enable depth test.
     glEnable(GL_DEPTH_TEST);
@@ -139,6 +140,13 @@ void Window::Run()
         if (currentTime - lastTime >= 1.0)
         {
             std::cout << 1000.0/double(nbFrames) << " ms/frame" << std::endl;
+            if (layoutBenchmark)
+            {
+                std::cout << "  " << LAYOUT_BENCHMARK_DRAWS << " draws: split "
+                          << layoutNanoseconds[0] / 1e6 / nbFrames << " ms, interleaved "
+                          << layoutNanoseconds[1] / 1e6 / nbFrames << " ms" << std::endl;
+                layoutNanoseconds[0] = layoutNanoseconds[1] = 0;
+            }
             nbFrames = 0;
             lastTime += 1.0;
         }
@@ -170,30 +178,37 @@ void Window::Run()
         // Set our "myTextureSampler" sampler to user Texture Unit 0
         glUniform1i(textureID, 0);
 
-        // 1st attribute buffer: vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 2nd attribute buffer: colors
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        if (layoutBenchmark)
+        {
+            // Only the vertex stage runs. The order alternates so neither layout
+            // always gets the warm caches.
+            GLuint (&queries)[2] = layoutQueries[benchmarkFrame % 2];
+            if (benchmarkFrame >= 2)
+            {
+                for (int layout = 0; layout < 2; layout++)
+                {
+                    GLuint64 elapsed;
+                    glGetQueryObjectui64v(queries[layout], GL_QUERY_RESULT, &elapsed);
+                    layoutNanoseconds[layout] += elapsed;
+                }
+            }
+
+            glEnable(GL_RASTERIZER_DISCARD);
+            for (int n = 0; n < 2; n++)
+            {
+                int layout = (n + benchmarkFrame) % 2;
+                const Mesh & mesh = layout == 0 ? splitSuzanne : suzanne;
+                glBeginQuery(GL_TIME_ELAPSED, queries[layout]);
+                for (int i = 0; i < LAYOUT_BENCHMARK_DRAWS; i++)
+                    mesh.Draw();
+                glEndQuery(GL_TIME_ELAPSED);
+            }
+            glDisable(GL_RASTERIZER_DISCARD);
+            benchmarkFrame++;
+        }
 
         // Draw the triangles.
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        suzanne.Draw();
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -202,12 +217,11 @@ void Window::Run()
     while (Input::IsKeyPressed(window, KEYBOARD_KEY::ESC) && glfwWindowShouldClose(window) == 0);
 
     // Cleanup VBO and shader
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
+    suzanne.Destroy();
+    splitSuzanne.Destroy();
+    glDeleteQueries(4, &layoutQueries[0][0]);
     glDeleteProgram(programID);
-    glDeleteTextures(1, &texture);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    deleteTexture(texture);
 
     glfwTerminate();
 }
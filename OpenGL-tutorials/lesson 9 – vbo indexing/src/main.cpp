@@ -1,9 +1,17 @@
+#include <cstring>
+
 #include "Window.h"
 
 
-int main()
+// --layout-benchmark times the split and interleaved vertex layouts every frame.
+int main(int argc, char * argv[])
 {
     Window window;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--layout-benchmark") == 0)
+            window.EnableLayoutBenchmark();
+    }
     window.Initialize();
     window.Run();
     return 0;